@@ -7,17 +7,27 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <learnopengl/shader.h>
+#include <learnopengl/gl_state.h>
 
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <vector>
+#include <map>
+#include <algorithm>
+#include <cfloat>
 
 #include "ogldev_util.h"
 #include "math_3d.h"
+#include "materialLibrary.h"
+#include "geometryArena.h"
 
 #define BONE_INFO_NUM 4
+// first of the four vec4 attributes holding the model matrix (animatedModel.vs)
+#define INSTANCE_MODEL_LOCATION 4
+// first texel of the bone palette in the palette buffer texture
+#define PALETTE_BASE_LOCATION 8
 
 struct Vertex {
 	// position
@@ -66,18 +76,13 @@ struct Vertex {
 
 };
 
-struct Material {
-	//ɫ
-	glm::vec4 Ka;
-	//
-	glm::vec4 Kd;
-	//
-	glm::vec4 Ks;
-	//ָ
-	float Ni;
+// bind-space box around the vertices one bone moves; bone -1 for the vertices no bone moves
+struct BoneBounds {
+	int bone;
+	glm::vec3 boxMin;
+	glm::vec3 boxMax;
 };
 
-
 class AnimatedMesh
 {
 public:
@@ -85,14 +90,31 @@ public:
 	vector<unsigned int> indices;
 	unsigned int VAO;
 	Material mats;
+	// slot of mats in the MaterialLibrary table
+	unsigned int materialIndex;
+	// bind-pose bounds in model space, for culling
+	glm::vec3 aabbMin;
+	glm::vec3 aabbMax;
+	glm::vec3 sphereCenter;
+	float sphereRadius;
+	// per bone, for posedBounds()
+	vector<BoneBounds> boneBounds;
+	// first vertex and index of this mesh in its buffers; 0 unless it lives in the GeometryArena
+	unsigned int baseVertex;
+	unsigned int firstIndex;
 
 	AnimatedMesh(vector<Vertex> vertices, vector<unsigned int> indices, Material mats) {
 		this->vertices = vertices;
 		this->indices = indices;
 		this->mats = mats;
-
-		// now that we have all the required data, set the vertex buffers and its attribute pointers.
-		setupMesh();
+		materialIndex = MaterialLibrary::getInstance()->add(mats);
+		computeBounds();
+		VAO = 0;
+		VBO = EBO = 0;
+		baseVertex = firstIndex = 0;
+		inArena = false;
+		// GL buffers are created later by setupMesh(), on the thread that owns the context,
+		// so that meshes can be built by the asset streamer's worker thread.
 	}
 	~AnimatedMesh() {
 
@@ -100,35 +122,198 @@ public:
 
 	void Draw(Shader shader)
 	{
-		shader.setVec3("material.ambient", mats.Ka.x, mats.Ka.y, mats.Ka.z);
-		shader.setVec3("material.diffuse", mats.Kd.x, mats.Kd.y, mats.Kd.z);
-		shader.setVec3("material.specular", mats.Ks.x, mats.Ks.y, mats.Ks.z); // specular lighting doesn't have full effect on this object's material
-		shader.setFloat("material.shininess", mats.Ni);
+		setMaterial(shader);
+		drawElements();
+	}
 
-		// draw mesh
-		glBindVertexArray(VAO);
-		glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-		glBindVertexArray(0);
+	void setMaterial(Shader& shader)
+	{
+		// the material itself lives in the MaterialTable block
+		shader.setInt("materialIndex", materialIndex);
 	}
-private:
-	unsigned int VBO, EBO;
+
+	void drawElements()
+	{
+		// draw mesh; the VAO stays bound so the next draw of this mesh skips the bind
+		GLState::get().bindVertexArray(VAO);
+		glDrawElementsBaseVertex(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, indexOffset(), baseVertex);
+	}
+
+	// count copies, each with the model matrix read from instanceBuffer at modelOffset
+	// onwards and, unless paletteOffset is -1, its palette base from paletteOffset onwards
+	void drawInstanced(GLuint instanceBuffer, GLintptr modelOffset, GLintptr paletteOffset, GLsizei count)
+	{
+		GLState::get().bindVertexArray(VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+		for (unsigned int column = 0; column < 4; column++) {
+			GLuint location = INSTANCE_MODEL_LOCATION + column;
+			glEnableVertexAttribArray(location);
+			glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(modelOffset + column * sizeof(glm::vec4)));
+			glVertexAttribDivisor(location, 1);
+		}
+		if (paletteOffset >= 0) {
+			glEnableVertexAttribArray(PALETTE_BASE_LOCATION);
+			glVertexAttribIPointer(PALETTE_BASE_LOCATION, 1, GL_INT, sizeof(GLint), (void*)paletteOffset);
+			glVertexAttribDivisor(PALETTE_BASE_LOCATION, 1);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glDrawElementsInstancedBaseVertex(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, indexOffset(), count, baseVertex);
+		// the VAO may be shared; its other draws take these from the constant attributes
+		for (unsigned int column = 0; column < 4; column++) {
+			glDisableVertexAttribArray(INSTANCE_MODEL_LOCATION + column);
+		}
+		glDisableVertexAttribArray(PALETTE_BASE_LOCATION);
+	}
+
+	// model matrix of the non-instanced draws that follow; the attribute array is disabled
+	// for them, so every vertex reads this constant value. Its normal matrix goes to
+	// shader, worked out here once instead of per vertex.
+	static void setModel(Shader& shader, const glm::mat4& model)
+	{
+		setModel(shader, model, glm::mat3(glm::transpose(glm::inverse(model))));
+	}
+
+	static void setModel(Shader& shader, const glm::mat4& model, const glm::mat3& normalMatrix)
+	{
+		for (unsigned int column = 0; column < 4; column++) {
+			glVertexAttrib4fv(INSTANCE_MODEL_LOCATION + column, &model[column][0]);
+		}
+		shader.setMat3("normalMatrix", normalMatrix);
+	}
+
+	// palette base of the non-instanced draws that follow, constant like setModel()
+	static void setPaletteBase(GLint texel)
+	{
+		glVertexAttribI4i(PALETTE_BASE_LOCATION, texel, 0, 0, 0);
+	}
+
+	// byte offset of the first index, as glDrawElements* expects it
+	const GLvoid* indexOffset() const {
+		return (const GLvoid*)(firstIndex * sizeof(unsigned int));
+	}
+
+	bool isUploaded() const {
+		return VAO != 0;
+	}
+
+	// model space box of the mesh posed by palette: each bone's bind-space box moved by its
+	// matrix. A skinned vertex is a weighted average of its bones' transforms of it, so it
+	// stays inside the box around those; conservative, and far cheaper than skinning.
+	void posedBounds(const Matrix4f* palette, unsigned int count, glm::vec3& boxMin, glm::vec3& boxMax) const {
+		if (boneBounds.empty()) {
+			boxMin = aabbMin;
+			boxMax = aabbMax;
+			return;
+		}
+		boxMin = glm::vec3(FLT_MAX);
+		boxMax = glm::vec3(-FLT_MAX);
+		for (auto& bounds : boneBounds) {
+			if (bounds.bone < 0 || bounds.bone >= (int)count) {
+				boxMin = glm::min(boxMin, bounds.boxMin);
+				boxMax = glm::max(boxMax, bounds.boxMax);
+				continue;
+			}
+			// centre moved, half extent through the absolute rotation and scale
+			const Matrix4f& m = palette[bounds.bone];
+			glm::vec3 center = (bounds.boxMin + bounds.boxMax) * 0.5f;
+			glm::vec3 extent = (bounds.boxMax - bounds.boxMin) * 0.5f;
+			for (unsigned int r = 0; r < 3; r++) {
+				float c = m.m[r][0] * center.x + m.m[r][1] * center.y + m.m[r][2] * center.z + m.m[r][3];
+				float e = fabsf(m.m[r][0]) * extent.x + fabsf(m.m[r][1]) * extent.y + fabsf(m.m[r][2]) * extent.z;
+				boxMin[r] = std::min(boxMin[r], c - e);
+				boxMax[r] = std::max(boxMax[r], c + e);
+			}
+		}
+	}
+
+	// buffer holding this mesh's indices, from firstIndex on
+	GLuint getIndexBuffer() const {
+		return inArena ? GeometryArena::getInstance()->getIndexBuffer() : EBO;
+	}
+
+	// set the vertex buffers and its attribute pointers.
 	void setupMesh()
 	{
-		// create buffers/arrays
-		glGenVertexArrays(1, &VAO);
+		uploadBuffers();
+		setupVertexArray();
+	}
+
+	// load data into the vertex and index buffers. Buffer objects are shared between
+	// contexts, so this may run on the asset streamer's loader context.
+	void uploadBuffers()
+	{
+		GeometryArena* arena = GeometryArena::getInstance();
+		inArena = arena->allocate(vertices.size(), indices.size(), baseVertex, firstIndex);
+		if (inArena) {
+			glBindBuffer(GL_ARRAY_BUFFER, arena->getVertexBuffer());
+			glBufferSubData(GL_ARRAY_BUFFER, baseVertex * sizeof(Vertex), vertices.size() * sizeof(Vertex), &vertices[0]);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, arena->getIndexBuffer());
+			glBufferSubData(GL_COPY_WRITE_BUFFER, firstIndex * sizeof(unsigned int), indices.size() * sizeof(unsigned int), &indices[0]);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+			return;
+		}
+		// arena full: buffers of our own
+		baseVertex = firstIndex = 0;
 		glGenBuffers(1, &VBO);
 		glGenBuffers(1, &EBO);
 
-		glBindVertexArray(VAO);
 		// load data into vertex buffers
 		glBindBuffer(GL_ARRAY_BUFFER, VBO);
 		// A great thing about structs is that their memory layout is sequential for all its items.
 		// The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
 		// again translates to 3/2 floats which translates to a byte array.
 		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+		// no VAO is bound here, so fill the index buffer through the copy target
+		glBindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+		glBufferData(GL_COPY_WRITE_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+
+	// create the VAO over the uploaded buffers. VAOs are not shared between
+	// contexts, so this must run on the render thread.
+	void setupVertexArray()
+	{
+		if (inArena) {
+			// all arena meshes share one VAO over the arena buffers
+			GeometryArena* arena = GeometryArena::getInstance();
+			if (arena->getVertexArray() == 0) {
+				arena->setVertexArray(createVertexArray(arena->getVertexBuffer(), arena->getIndexBuffer()));
+			}
+			VAO = arena->getVertexArray();
+			return;
+		}
+		VAO = createVertexArray(VBO, EBO);
+	}
+
+	// give the buffer space back, for unloading; render thread. Nothing to do for a mesh
+	// that was never uploaded, such as one only parsed for a bake.
+	void releaseBuffers()
+	{
+		if (!inArena && VBO == 0) {
+			return;
+		}
+		if (inArena) {
+			GeometryArena::getInstance()->release(baseVertex, vertices.size(), firstIndex, indices.size());
+		}
+		else {
+			glDeleteVertexArrays(1, &VAO);
+			glDeleteBuffers(1, &VBO);
+			glDeleteBuffers(1, &EBO);
+		}
+		VAO = VBO = EBO = 0;
+		inArena = false;
+	}
+private:
+	static GLuint createVertexArray(GLuint vertexBuffer, GLuint indexBuffer)
+	{
+		GLuint vao;
+		glGenVertexArrays(1, &vao);
+		GLState::get().bindVertexArray(vao);
+		glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
 
 		// set the vertex attribute pointers
 		// vertex Positions
@@ -144,8 +329,57 @@ private:
 		glEnableVertexAttribArray(3);
 		glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, boneWeight));
 
-		glBindVertexArray(0);
+		GLState::get().bindVertexArray(0);
+		return vao;
 	}
+
+	// box around all vertices, and a sphere around the box centre through the furthest vertex
+	void computeBounds()
+	{
+		aabbMin = glm::vec3(FLT_MAX);
+		aabbMax = glm::vec3(-FLT_MAX);
+		for (auto& vertex : vertices) {
+			aabbMin = glm::min(aabbMin, vertex.Position);
+			aabbMax = glm::max(aabbMax, vertex.Position);
+		}
+		if (vertices.empty()) {
+			aabbMin = aabbMax = glm::vec3(0.0f);
+		}
+		sphereCenter = (aabbMin + aabbMax) * 0.5f;
+		float radius2 = 0.0f;
+		for (auto& vertex : vertices) {
+			glm::vec3 offset = vertex.Position - sphereCenter;
+			radius2 = std::max(radius2, glm::dot(offset, offset));
+		}
+		sphereRadius = sqrtf(radius2);
+
+		// one box per influencing bone; the vertices of a static mesh make the only, unmoved one
+		std::map<int, unsigned int> slots;
+		for (auto& vertex : vertices) {
+			for (unsigned int i = 0; i < BONE_INFO_NUM; i++) {
+				int bone = vertex.boneID[i];
+				// -1 in the first slot marks a vertex no bone moves
+				bool unmoved = i == 0 && bone < 0;
+				if (!unmoved && (bone < 0 || vertex.boneWeight[i] <= 0.0f))
+					continue;
+				std::map<int, unsigned int>::iterator slot = slots.find(bone);
+				if (slot == slots.end()) {
+					BoneBounds bounds;
+					bounds.bone = bone;
+					bounds.boxMin = bounds.boxMax = vertex.Position;
+					slots[bone] = boneBounds.size();
+					boneBounds.push_back(bounds);
+					continue;
+				}
+				BoneBounds& bounds = boneBounds[slot->second];
+				bounds.boxMin = glm::min(bounds.boxMin, vertex.Position);
+				bounds.boxMax = glm::max(bounds.boxMax, vertex.Position);
+			}
+		}
+	}
+
+	unsigned int VBO, EBO;
+	bool inArena;
 };
 
 
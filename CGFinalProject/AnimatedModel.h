@@ -7,6 +7,22 @@
 #include <assimp/postprocess.h> // Post processing flags
 
 #include <map>
+#include <cfloat>
+#include <chrono>
+
+#include "animationClip.h"
+#include "assetReport.h"
+#include "renderQueue.h"
+
+// one node of the flattened hierarchy, see AnimatedModel::buildNodeTable()
+struct AnimNode {
+	int parent;
+	int channel;
+	int bone;
+	// bind-pose local transform, for nodes without a channel; for nodes without a parent
+	// in the table, the global transform
+	Matrix4f transform;
+};
 
 struct Bone {
 	std::string name;
@@ -18,25 +34,29 @@ struct Bone {
 
 class AnimatedModel
 {
+DISALLOW_COPY_AND_ASSIGN(AnimatedModel)
 public:
 	vector<AnimatedMesh> meshes;
 	string directory;
-	const aiScene* pScene;
 	Matrix4f globalInverseTransform;
 	vector<Bone> allBones;
 	std::map<string, unsigned int> boneMap;
 	unsigned int numBones;
+	// bind-pose bounds of all meshes, in model space
+	glm::vec3 aabbMin;
+	glm::vec3 aabbMax;
 
 	void Draw(Shader shader, float time) {
-		if (pScene->HasAnimations()) {
+		if (!loaded) {
+			return;
+		}
+		if (!clip.empty()) {
 		//if(false) {
 			vector<Matrix4f> Transforms;
 			BoneTransform(time, Transforms);
-			char uniformName[50];
-			for (unsigned int i = 0; i < numBones; i++) {
-				sprintf(uniformName, "gBones[%d]", i);
-				GLuint location = glGetUniformLocation(shader.ID, uniformName);
-				glUniformMatrix4fv(location, 1, GL_TRUE, (const GLfloat*)Transforms[i]);
+			// whole palette streamed in one go
+			if (numBones > 0) {
+				RenderQueue::bindPalette(shader, &Transforms[0], numBones);
 			}
 		}
 		for (auto& mesh : meshes)
@@ -45,18 +65,229 @@ public:
 		}
 	}
 
-	AnimatedModel(string const &path) {
+	// queue every mesh for this frame; the bone palette is evaluated once and shared by all passes
+	void collect(RenderQueue& queue, const glm::mat4& model, float time, unsigned int passMask = PASS_ALL) {
+		if (!loaded) {
+			return;
+		}
+		vector<Matrix4f> Transforms;
+		if (isAnimated()) {
+			BoneTransform(time, Transforms);
+		}
+		collectPosed(queue, model, Transforms, passMask);
+	}
+
+	// queue every mesh with a palette taken earlier by poseAt(), such as one the
+	// AnimationScheduler kept from a previous frame; empty for a static model
+	void collectPosed(RenderQueue& queue, const glm::mat4& model, const vector<Matrix4f>& palette, unsigned int passMask = PASS_ALL) {
+		if (!loaded) {
+			return;
+		}
+		if (palette.empty()) {
+			for (auto& mesh : meshes) {
+				queue.submit(&mesh, model, NO_PALETTE, numBones, passMask);
+			}
+			return;
+		}
+		// each mesh culled by the box of this pose rather than never
+		unsigned int index = queue.addPalette(palette);
+		glm::vec3 bounds[2];
+		for (auto& mesh : meshes) {
+			mesh.posedBounds(&palette[0], palette.size(), bounds[0], bounds[1]);
+			queue.submit(&mesh, model, index, numBones, passMask, bounds);
+		}
+	}
+
+	// model space box of all meshes in the pose of palette; the bind-pose box when empty
+	void posedBounds(const vector<Matrix4f>& palette, glm::vec3& boxMin, glm::vec3& boxMax) const {
+		if (palette.empty()) {
+			boxMin = aabbMin;
+			boxMax = aabbMax;
+			return;
+		}
+		boxMin = glm::vec3(FLT_MAX);
+		boxMax = glm::vec3(-FLT_MAX);
+		for (auto& mesh : meshes) {
+			glm::vec3 meshMin, meshMax;
+			mesh.posedBounds(&palette[0], palette.size(), meshMin, meshMax);
+			boxMin = glm::min(boxMin, meshMin);
+			boxMax = glm::max(boxMax, meshMax);
+		}
+	}
+
+	// evaluate the bone palette at time into the queue; NO_PALETTE for a static model.
+	// poseBounds, if given, receives the model space box (min, max) of the pose.
+	unsigned int addPose(RenderQueue& queue, float time, glm::vec3* poseBounds = NULL) {
+		if (!loaded || clip.empty() || numBones == 0) {
+			return NO_PALETTE;
+		}
+		vector<Matrix4f> Transforms;
+		BoneTransform(time, Transforms);
+		if (poseBounds) {
+			posedBounds(Transforms, poseBounds[0], poseBounds[1]);
+		}
+		return queue.addPalette(Transforms);
+	}
+
+	// queue count copies of every mesh; palettes holds each copy's addPose() result, or is
+	// NULL for a static model. worldBounds, if given, is the world space box around every
+	// copy in its pose, see RenderQueue::submitInstanced().
+	void collectInstanced(RenderQueue& queue, const glm::mat4* models, const unsigned int* palettes,
+		unsigned int count, unsigned int passMask = PASS_ALL, const glm::vec3* worldBounds = NULL) {
+		if (!loaded || count == 0) {
+			return;
+		}
+		for (auto& mesh : meshes) {
+			queue.submitInstanced(&mesh, models, palettes, count, passMask, worldBounds);
+		}
+	}
+
+	// deferred models are loaded by the caller through parse() and upload(),
+	// which lets the asset streamer run the expensive half on its worker thread
+	AnimatedModel(string const &path, bool deferred = false) {
+		this->path = path;
+		numBones = 0;
+		aabbMin = glm::vec3(FLT_MAX);
+		aabbMax = glm::vec3(-FLT_MAX);
+		loaded = false;
+		if (!deferred) {
+			parse();
+			upload();
+		}
+	}
+	// meshes give their arena ranges back for later models to reuse
+	~AnimatedModel() {
+		for (auto& mesh : meshes) {
+			mesh.releaseBuffers();
+		}
+	}
+
+	// CPU half of loading: Assimp import and vertex/bone processing, no GL calls
+	bool parse() {
 		loadModel(path);
+		return !meshes.empty();
+	}
+
+	// GL half of loading, on the thread that owns the render context
+	void upload() {
+		uploadBuffers();
+		publish();
+	}
+
+	// vertex/index data only; may run on a context shared with the render context
+	void uploadBuffers() {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (auto& mesh : meshes) {
+			mesh.uploadBuffers();
+		}
+		loadStats.uploadMs += msSince(start);
+	}
+
+	// create the per-context VAOs and make the model drawable; render thread only
+	void publish() {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (auto& mesh : meshes) {
+			mesh.setupVertexArray();
+		}
+		loadStats.uploadMs += msSince(start);
+		loaded = true;
+		AssetReport::getInstance()->add(collectStats());
+	}
+
+	// counts and byte sizes for the asset report; timings were taken while loading
+	ModelStats collectStats() const {
+		ModelStats stats = loadStats;
+		stats.name = path;
+		stats.meshes = meshes.size();
+		stats.bones = numBones;
+		for (auto& mesh : meshes) {
+			stats.vertices += mesh.vertices.size();
+			stats.indices += mesh.indices.size();
+		}
+		stats.gpuBytes = stats.vertices * sizeof(Vertex) + stats.indices * sizeof(unsigned int);
+		// the Assimp scene is gone after loading; the clip and the node table replace it
+		const ClipStats& clipStats = clip.getStats();
+		stats.channels = clip.channelCount();
+		stats.positionKeys = clipStats.sourceKeys[CLIP_POSITION];
+		stats.rotationKeys = clipStats.sourceKeys[CLIP_ROTATION];
+		stats.scalingKeys = clipStats.sourceKeys[CLIP_SCALING];
+		stats.clipKeys = clipStats.keys[CLIP_POSITION] + clipStats.keys[CLIP_ROTATION] + clipStats.keys[CLIP_SCALING];
+		stats.clipSourceBytes = clipStats.sourceBytes;
+		stats.clipBytes = clipStats.bytes;
+		stats.positionError = clipStats.maxError[CLIP_POSITION];
+		stats.rotationError = clipStats.maxError[CLIP_ROTATION];
+		stats.scalingError = clipStats.maxError[CLIP_SCALING];
+		stats.cpuBytes = stats.gpuBytes + allBones.size() * sizeof(Bone) + clipStats.bytes + animNodes.size() * sizeof(AnimNode);
+		return stats;
+	}
+
+	bool isReady() const {
+		return loaded;
+	}
+
+	bool hasBounds() const {
+		return aabbMin.x <= aabbMax.x;
+	}
+
+	// skinned and animated, so the bind-pose bounds do not hold (see posedBounds()); only valid once ready
+	bool isAnimated() const {
+		return !clip.empty() && numBones > 0;
+	}
+
+	const string& getPath() const {
+		return path;
+	}
+
+	// bone palette of the first clip at time seconds, wrapping like playback; animated models only
+	void poseAt(float time, vector<Matrix4f>& transforms) {
+		BoneTransform(time, transforms);
+	}
+
+	// interpolate the clip's rotations with slerp instead of normalised lerp
+	void setSlerp(bool enabled) {
+		clip.setSlerp(enabled);
+	}
+
+	// length of the first clip in seconds, 0 without animation
+	float clipDuration() const {
+		if (clip.empty()) {
+			return 0.0f;
+		}
+		return clip.getDuration() / clip.getTicksPerSecond();
+	}
+
+	const AnimationClip& getClip() const {
+		return clip;
+	}
+
+	// the node hierarchy, parents before children; see buildNodeTable()
+	const vector<AnimNode>& getNodes() const {
+		return animNodes;
 	}
-	//~AnimatedModel();
 
 private:
-	Assimp::Importer importer;
+	string path;
+	bool loaded;
+	ModelStats loadStats;
+	// first clip in structure of arrays and the hierarchy it drives
+	AnimationClip clip;
+	vector<AnimNode> animNodes;
+	// per pose scratch
+	vector<Matrix4f> channelLocals;
+	vector<Matrix4f> nodeGlobals;
+
+	static double msSince(std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
 
 	void loadModel(string const &path)
 	{
-		// read file via ASSIMP
-		pScene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_JoinIdenticalVertices);
+		// read file via ASSIMP; the scene lives only as long as the importer, everything
+		// kept is copied out of it below
+		Assimp::Importer importer;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		const aiScene* pScene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_JoinIdenticalVertices);
+		loadStats.parseMs = msSince(start);
 		// check for errors
 		if (!pScene || pScene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !pScene->mRootNode) // if is Not Zero
 		{
@@ -71,7 +302,14 @@ private:
 
 
 		// process ASSIMP's root node recursively
+		start = std::chrono::steady_clock::now();
 		processNode(pScene->mRootNode, pScene);
+		loadStats.animations = pScene->mNumAnimations;
+		if (pScene->HasAnimations()) {
+			clip.load(pScene->mAnimations[0], AnimationClip::toleranceFor(path));
+			buildNodeTable(pScene->mRootNode);
+		}
+		loadStats.processMs = msSince(start);
 	}
 
 	void processNode(aiNode *node, const aiScene *scene)
@@ -108,6 +346,8 @@ private:
 			vector.y = mesh->mVertices[i].y;
 			vector.z = mesh->mVertices[i].z;
 			vertex.Position = vector;
+			aabbMin = glm::min(aabbMin, vector);
+			aabbMax = glm::max(aabbMax, vector);
 			// normals
 			vector.x = mesh->mNormals[i].x;
 			vector.y = mesh->mNormals[i].y;
@@ -211,14 +451,21 @@ private:
 
 	void BoneTransform(float TimeInSeconds, vector<Matrix4f>& Transforms)
 	{
-		Matrix4f Identity;
-		Identity.InitIdentity();
-
-		float TicksPerSecond = (float)(pScene->mAnimations[0]->mTicksPerSecond != 0 ? pScene->mAnimations[0]->mTicksPerSecond : 25.0f);
-		float TimeInTicks = TimeInSeconds * TicksPerSecond;
-		float AnimationTime = fmod(TimeInTicks, (float)pScene->mAnimations[0]->mDuration);
-
-		ReadNodeHeirarchy(AnimationTime, pScene->mRootNode, Identity);
+		float TimeInTicks = TimeInSeconds * clip.getTicksPerSecond();
+		// a clip without duration holds its first keys rather than turning into NaN
+		float AnimationTime = clip.getDuration() > 0.0f ? fmod(TimeInTicks, clip.getDuration()) : 0.0f;
+
+		// every channel at once, then the hierarchy in table order: parents come first
+		clip.sample(AnimationTime, channelLocals);
+		nodeGlobals.resize(animNodes.size());
+		for (uint i = 0; i < animNodes.size(); i++) {
+			const AnimNode& node = animNodes[i];
+			const Matrix4f& local = node.channel >= 0 ? channelLocals[node.channel] : node.transform;
+			nodeGlobals[i] = node.parent >= 0 ? nodeGlobals[node.parent] * local : local;
+			if (node.bone >= 0) {
+				allBones[node.bone].FinalTransformation = globalInverseTransform * nodeGlobals[i] * allBones[node.bone].boneOffset;
+			}
+		}
 
 		Transforms.resize(numBones);
 
@@ -227,176 +474,72 @@ private:
 		}
 	}
 
-	void ReadNodeHeirarchy(float AnimationTime, const aiNode* pNode, const Matrix4f& ParentTransform)
-	{
-		string NodeName(pNode->mName.data);
-
-		const aiAnimation* pAnimation = pScene->mAnimations[0]; //ѡ񶯻
-
-		Matrix4f NodeTransformation(pNode->mTransformation);
-
-		const aiNodeAnim* pNodeAnim = FindNodeAnim(pAnimation, NodeName);
-
-		if (pNodeAnim) {
-			// Interpolate scaling and generate scaling transformation matrix
-			aiVector3D Scaling;
-			CalcInterpolatedScaling(Scaling, AnimationTime, pNodeAnim);
-			// scaleӰ
-			Matrix4f ScalingM;
-			//ScalingM.InitIdentity();
-			ScalingM.InitScaleTransform(Scaling.x, Scaling.y, Scaling.z);
-
-			//float* m = static_cast<float*>(&ScalingM.m[0][0]);
-			//for (int i = 0; i < 16;) {
-			//	printf("%.2f %.2f %.2f %.2f\n", m[i], m[i+1], m[i + 2], m[i + 3]);
-			//	i += 4;
-			//}
-			//printf("\n\n");
-
-			// Interpolate rotation and generate rotation transformation matrix
-			aiQuaternion RotationQ;
-			CalcInterpolatedRotation(RotationQ, AnimationTime, pNodeAnim);
-			Matrix4f RotationM = Matrix4f(RotationQ.GetMatrix());
-
-			// Interpolate translation and generate translation transformation matrix
-			aiVector3D Translation;
-			CalcInterpolatedPosition(Translation, AnimationTime, pNodeAnim);
-			Matrix4f TranslationM;
-			TranslationM.InitTranslationTransform(Translation.x, Translation.y, Translation.z);
-
-			// Combine the above transformations
-			NodeTransformation = TranslationM * RotationM * ScalingM;
-		}
-
-		Matrix4f GlobalTransformation = ParentTransform * NodeTransformation;
-
-		if (boneMap.find(NodeName) != boneMap.end()) {
-			uint BoneIndex = boneMap[NodeName];
-			allBones[BoneIndex].FinalTransformation = globalInverseTransform * GlobalTransformation * allBones[BoneIndex].boneOffset;
-		}
-
-		for (uint i = 0; i < pNode->mNumChildren; i++) {
-			ReadNodeHeirarchy(AnimationTime, pNode->mChildren[i], GlobalTransformation);
-		}
-	}
-
-
-	void CalcInterpolatedPosition(aiVector3D& Out, float AnimationTime, const aiNodeAnim* pNodeAnim)
+	// the node hierarchy depth first, each node with its parent's index, its channel in
+	// the clip and its bone, so that posing needs no names and no recursion. Only nodes
+	// that are or lead to a bone or a channel are kept; whole static subtrees (scenery
+	// next to a rig) would be multiplied for nothing. Kept nodes with no channel above
+	// them never move, so they get their global transform once here and no parent.
+	void buildNodeTable(const aiNode* root)
 	{
-		if (pNodeAnim->mNumPositionKeys == 1) {
-			Out = pNodeAnim->mPositionKeys[0].mValue;
-			return;
+		std::map<string, int> channels;
+		for (uint i = 0; i < clip.channelCount(); i++) {
+			channels[clip.channelName(i)] = i;
 		}
-
-		uint PositionIndex = FindPosition(AnimationTime, pNodeAnim);
-		uint NextPositionIndex = (PositionIndex + 1);
-		assert(NextPositionIndex < pNodeAnim->mNumPositionKeys);
-		float DeltaTime = (float)(pNodeAnim->mPositionKeys[NextPositionIndex].mTime - pNodeAnim->mPositionKeys[PositionIndex].mTime);
-		float Factor = (AnimationTime - (float)pNodeAnim->mPositionKeys[PositionIndex].mTime) / DeltaTime;
-		assert(Factor >= 0.0f && Factor <= 1.0f);
-		const aiVector3D& Start = pNodeAnim->mPositionKeys[PositionIndex].mValue;
-		const aiVector3D& End = pNodeAnim->mPositionKeys[NextPositionIndex].mValue;
-		aiVector3D Delta = End - Start;
-		Out = Start + Factor * Delta;
-	}
-
-
-	void CalcInterpolatedRotation(aiQuaternion& Out, float AnimationTime, const aiNodeAnim* pNodeAnim)
-	{
-		// we need at least two values to interpolate...
-		if (pNodeAnim->mNumRotationKeys == 1) {
-			Out = pNodeAnim->mRotationKeys[0].mValue;
-			return;
-		}
-
-		uint RotationIndex = FindRotation(AnimationTime, pNodeAnim);
-		uint NextRotationIndex = (RotationIndex + 1);
-		assert(NextRotationIndex < pNodeAnim->mNumRotationKeys);
-		float DeltaTime = (float)(pNodeAnim->mRotationKeys[NextRotationIndex].mTime - pNodeAnim->mRotationKeys[RotationIndex].mTime);
-		float Factor = (AnimationTime - (float)pNodeAnim->mRotationKeys[RotationIndex].mTime) / DeltaTime;
-		assert(Factor >= 0.0f && Factor <= 1.0f);
-		const aiQuaternion& StartRotationQ = pNodeAnim->mRotationKeys[RotationIndex].mValue;
-		const aiQuaternion& EndRotationQ = pNodeAnim->mRotationKeys[NextRotationIndex].mValue;
-		aiQuaternion::Interpolate(Out, StartRotationQ, EndRotationQ, Factor);
-		Out = Out.Normalize();
-	}
-
-
-	void CalcInterpolatedScaling(aiVector3D& Out, float AnimationTime, const aiNodeAnim* pNodeAnim)
-	{
-		if (pNodeAnim->mNumScalingKeys == 1) {
-			Out = pNodeAnim->mScalingKeys[0].mValue;
-			return;
-		}
-
-		uint ScalingIndex = FindScaling(AnimationTime, pNodeAnim);
-		uint NextScalingIndex = (ScalingIndex + 1);
-		assert(NextScalingIndex < pNodeAnim->mNumScalingKeys);
-		float DeltaTime = (float)(pNodeAnim->mScalingKeys[NextScalingIndex].mTime - pNodeAnim->mScalingKeys[ScalingIndex].mTime);
-		float Factor = (AnimationTime - (float)pNodeAnim->mScalingKeys[ScalingIndex].mTime) / DeltaTime;
-		assert(Factor >= 0.0f && Factor <= 1.0f);
-		const aiVector3D& Start = pNodeAnim->mScalingKeys[ScalingIndex].mValue;
-		const aiVector3D& End = pNodeAnim->mScalingKeys[NextScalingIndex].mValue;
-		aiVector3D Delta = End - Start;
-		Out = Start + Factor * Delta;
-	}
-
-	uint FindPosition(float AnimationTime, const aiNodeAnim* pNodeAnim)
-	{
-		for (uint i = 0; i < pNodeAnim->mNumPositionKeys - 1; i++) {
-			if (AnimationTime < (float)pNodeAnim->mPositionKeys[i + 1].mTime) {
-				return i;
+		vector<AnimNode> nodes;
+		vector<std::pair<const aiNode*, int> > pending(1, std::make_pair(root, -1));
+		while (!pending.empty()) {
+			const aiNode* pNode = pending.back().first;
+			AnimNode node;
+			node.parent = pending.back().second;
+			pending.pop_back();
+			string NodeName(pNode->mName.data);
+			std::map<string, int>::iterator channel = channels.find(NodeName);
+			node.channel = channel != channels.end() ? channel->second : -1;
+			std::map<string, unsigned int>::iterator bone = boneMap.find(NodeName);
+			node.bone = bone != boneMap.end() ? (int)bone->second : -1;
+			node.transform = Matrix4f(pNode->mTransformation);
+			nodes.push_back(node);
+			// reversed so that children keep their order
+			for (uint i = pNode->mNumChildren; i > 0; i--) {
+				pending.push_back(std::make_pair((const aiNode*)pNode->mChildren[i - 1], (int)nodes.size() - 1));
 			}
 		}
 
-		assert(0);
-
-		return 0;
-	}
-
-
-	uint FindRotation(float AnimationTime, const aiNodeAnim* pNodeAnim)
-	{
-		assert(pNodeAnim->mNumRotationKeys > 0);
-
-		for (uint i = 0; i < pNodeAnim->mNumRotationKeys - 1; i++) {
-			if (AnimationTime < (float)pNodeAnim->mRotationKeys[i + 1].mTime) {
-				return i;
+		// children come after their parents: live flows up in reverse, moving down forwards
+		vector<bool> live(nodes.size(), false);
+		for (uint i = nodes.size(); i > 0; i--) {
+			const AnimNode& node = nodes[i - 1];
+			if (node.bone >= 0 || node.channel >= 0) {
+				live[i - 1] = true;
 			}
-		}
-
-		assert(0);
-
-		return 0;
-	}
-
-
-	uint FindScaling(float AnimationTime, const aiNodeAnim* pNodeAnim)
-	{
-		assert(pNodeAnim->mNumScalingKeys > 0);
-
-		for (uint i = 0; i < pNodeAnim->mNumScalingKeys - 1; i++) {
-			if (AnimationTime < (float)pNodeAnim->mScalingKeys[i + 1].mTime) {
-				return i;
+			if (live[i - 1] && node.parent >= 0) {
+				live[node.parent] = true;
 			}
 		}
-
-		assert(0);
-
-		return 0;
-	}
-
-	const aiNodeAnim* FindNodeAnim(const aiAnimation* pAnimation, const string NodeName)
-	{
-		for (uint i = 0; i < pAnimation->mNumChannels; i++) {
-			const aiNodeAnim* pNodeAnim = pAnimation->mChannels[i];
-
-			if (string(pNodeAnim->mNodeName.data) == NodeName) {
-				return pNodeAnim;
+		vector<bool> moving(nodes.size(), false);
+		vector<int> index(nodes.size(), -1);
+		for (uint i = 0; i < nodes.size(); i++) {
+			AnimNode node = nodes[i];
+			moving[i] = node.channel >= 0 || (node.parent >= 0 && moving[node.parent]);
+			if (!moving[i]) {
+				// left in place for the fixed children below, whose parents are fixed too
+				if (node.parent >= 0) {
+					nodes[i].transform = nodes[node.parent].transform * node.transform;
+				}
+				node.transform = nodes[i].transform;
+				node.parent = -1;
+			}
+			if (!live[i]) {
+				continue;
 			}
+			if (node.parent >= 0) {
+				node.parent = index[node.parent];
+			}
+			index[i] = animNodes.size();
+			animNodes.push_back(node);
 		}
-
-		return NULL;
+		loadStats.nodes = nodes.size();
+		loadStats.animatedNodes = animNodes.size();
 	}
 };
 
@@ -0,0 +1,121 @@
+#version 330 core
+// One point per (node of this level, copy), node-major; captured by transform feedback.
+// Tables are laid out as described in gpuAnimator.h.
+uniform samplerBuffer nodeTable;
+uniform samplerBuffer keyframes;
+// clip time in ticks of every copy, four per texel, from float timeBase on
+uniform samplerBuffer instanceTimes;
+// rows of the global transforms of the levels done so far, node-major
+uniform samplerBuffer globals;
+uniform int levelFirst;
+uniform int instanceCount;
+uniform int timeBase;
+// rotations as AnimationClip::usesSlerp() says; normalised lerp otherwise
+uniform bool useSlerp;
+
+// rows of this node's global transform
+out vec4 row0;
+out vec4 row1;
+out vec4 row2;
+out vec4 row3;
+
+// four texels of rows, as Matrix4f stores them
+mat4 rows(samplerBuffer table, int texel)
+{
+    return transpose(mat4(texelFetch(table, texel), texelFetch(table, texel + 1),
+                          texelFetch(table, texel + 2), texelFetch(table, texel + 3)));
+}
+
+// the key pair to interpolate: the last of count keys, stride texels apart, whose tick
+// (component of the texel at tickTexel within the key) is not after t
+int findKey(int first, int count, int stride, int tickTexel, int component, float t)
+{
+    int low = 0;
+    int high = count - 2;
+    while (low < high) {
+        int middle = (low + high + 1) / 2;
+        if (texelFetch(keyframes, first + middle * stride + tickTexel)[component] <= t)
+            low = middle;
+        else
+            high = middle - 1;
+    }
+    return low;
+}
+
+// position and scaling keys: (x, y, z, tick)
+vec3 sampleVector(int first, int count, float t)
+{
+    if (count == 1)
+        return texelFetch(keyframes, first).xyz;
+    int key = findKey(first, count, 1, 0, 3, t);
+    vec4 start = texelFetch(keyframes, first + key);
+    vec4 end = texelFetch(keyframes, first + key + 1);
+    float span = end.w - start.w;
+    float factor = span > 0.0 ? clamp((t - start.w) / span, 0.0, 1.0) : 0.0;
+    return mix(start.xyz, end.xyz, factor);
+}
+
+// shortest arc, like aiQuaternion::Interpolate; nlerp unless the clip asked for slerp
+vec4 interpolate(vec4 a, vec4 b, float factor)
+{
+    float cosine = dot(a, b);
+    if (cosine < 0.0) {
+        b = -b;
+        cosine = -cosine;
+    }
+    if (!useSlerp || cosine > 0.9999)
+        return normalize(mix(a, b, factor));
+    float angle = acos(cosine);
+    return normalize((sin((1.0 - factor) * angle) * a + sin(factor * angle) * b) / sin(angle));
+}
+
+// rotation keys: (x, y, z, w), (tick, 0, 0, 0)
+vec4 sampleRotation(int first, int count, float t)
+{
+    if (count == 1)
+        return texelFetch(keyframes, first);
+    int key = findKey(first, count, 2, 1, 0, t);
+    int texel = first + key * 2;
+    float startTick = texelFetch(keyframes, texel + 1).x;
+    float endTick = texelFetch(keyframes, texel + 3).x;
+    float span = endTick - startTick;
+    float factor = span > 0.0 ? clamp((t - startTick) / span, 0.0, 1.0) : 0.0;
+    return interpolate(texelFetch(keyframes, texel), texelFetch(keyframes, texel + 2), factor);
+}
+
+// translation * rotation * scaling, as ReadNodeHeirarchy builds it
+mat4 sampleChannel(int channel, float t)
+{
+    vec4 header0 = texelFetch(keyframes, channel * 2);
+    vec4 header1 = texelFetch(keyframes, channel * 2 + 1);
+    vec3 position = sampleVector(int(header0.x), int(header0.y), t);
+    vec4 q = sampleRotation(int(header0.z), int(header0.w), t);
+    vec3 scaling = sampleVector(int(header1.x), int(header1.y), t);
+
+    mat4 local = mat4(1.0);
+    local[0] = vec4(1.0 - 2.0 * (q.y * q.y + q.z * q.z), 2.0 * (q.x * q.y + q.w * q.z), 2.0 * (q.x * q.z - q.w * q.y), 0.0) * scaling.x;
+    local[1] = vec4(2.0 * (q.x * q.y - q.w * q.z), 1.0 - 2.0 * (q.x * q.x + q.z * q.z), 2.0 * (q.y * q.z + q.w * q.x), 0.0) * scaling.y;
+    local[2] = vec4(2.0 * (q.x * q.z + q.w * q.y), 2.0 * (q.y * q.z - q.w * q.x), 1.0 - 2.0 * (q.x * q.x + q.y * q.y), 0.0) * scaling.z;
+    local[3] = vec4(position, 1.0);
+    return local;
+}
+
+void main()
+{
+    int node = levelFirst + gl_VertexID / instanceCount;
+    int instance = gl_VertexID % instanceCount;
+    int time = timeBase + instance;
+    float t = texelFetch(instanceTimes, time / 4)[time % 4];
+
+    vec4 info = texelFetch(nodeTable, node * 5);
+    int parent = int(info.x);
+    int channel = int(info.y);
+    mat4 local = channel < 0 ? rows(nodeTable, node * 5 + 1) : sampleChannel(channel, t);
+    mat4 global = parent < 0 ? local : rows(globals, (parent * instanceCount + instance) * 4) * local;
+
+    mat4 transposed = transpose(global);
+    row0 = transposed[0];
+    row1 = transposed[1];
+    row2 = transposed[2];
+    row3 = transposed[3];
+}
\ No newline at end of file
@@ -0,0 +1,40 @@
+#version 330 core
+// One point per (copy, bone), copy-major, so each copy's palette is contiguous; captured
+// by transform feedback into the texel StreamBuffer (see gpuAnimator.h).
+uniform samplerBuffer nodeTable;
+uniform samplerBuffer globals;
+// first texel of the bone entries in nodeTable
+uniform int boneTable;
+uniform int boneCount;
+uniform int instanceCount;
+uniform mat4 globalInverse;
+
+// rows of the bone's palette matrix, as the skinning shaders read them
+out vec4 row0;
+out vec4 row1;
+out vec4 row2;
+out vec4 row3;
+
+mat4 rows(samplerBuffer table, int texel)
+{
+    return transpose(mat4(texelFetch(table, texel), texelFetch(table, texel + 1),
+                          texelFetch(table, texel + 2), texelFetch(table, texel + 3)));
+}
+
+void main()
+{
+    int instance = gl_VertexID / boneCount;
+    int bone = gl_VertexID % boneCount;
+    int entry = boneTable + bone * 5;
+    int node = int(texelFetch(nodeTable, entry).x);
+
+    mat4 palette = mat4(1.0);
+    if (node >= 0)
+        palette = globalInverse * rows(globals, (node * instanceCount + instance) * 4) * rows(nodeTable, entry + 1);
+
+    mat4 transposed = transpose(palette);
+    row0 = transposed[0];
+    row1 = transposed[1];
+    row2 = transposed[2];
+    row3 = transposed[3];
+}
\ No newline at end of file
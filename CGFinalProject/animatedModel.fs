@@ -1,18 +1,16 @@
 #version 330 core
 out vec4 FragColor;
 
+// one slot of the MaterialLibrary table; specular.w is the shininess
 struct Material {
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;    
-    float shininess;
-}; 
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+};
 
-struct Light {
-	vec3 direction;
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
+const int MAX_MATERIALS = 256;
+layout (std140) uniform MaterialTable {
+    Material materials[MAX_MATERIALS];
 };
 
 in VS_OUT {
@@ -23,9 +21,21 @@ in VS_OUT {
 
 uniform sampler2D shadowMap;
 
-uniform vec3 viewPos;
-uniform Material material;
-uniform Light light;
+// shared with every program, written once per frame (see uniform_blocks.h)
+layout (std140) uniform ViewData {
+    mat4 view;
+    mat4 projection;
+    vec4 viewPos;
+};
+layout (std140) uniform LightData {
+    mat4 spaceMatrix;
+    vec3 direction;
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+} light;
+
+uniform int materialIndex;
 uniform bool gamma;
 
 float ShadowCalculation(vec4 fragPosLightSpace)
@@ -68,20 +78,21 @@ float ShadowCalculation(vec4 fragPosLightSpace)
 void main()
 {
 	vec3 normal = normalize(fs_in.Normal);
+    Material material = materials[materialIndex];
 
     // ambient
-    vec3 ambient = light.ambient * material.ambient;
+    vec3 ambient = light.ambient * material.ambient.rgb;
   	
     // diffuse 
 	vec3 lightDir = normalize(-light.direction);
     float diff = max(dot(normal, lightDir), 0.0);
-    vec3 diffuse = light.diffuse * (diff * material.diffuse);
+    vec3 diffuse = light.diffuse * (diff * material.diffuse.rgb);
     
     // specular
-    vec3 viewDir = normalize(viewPos - fs_in.FragPos);
+    vec3 viewDir = normalize(viewPos.xyz - fs_in.FragPos);
     vec3 halfwayDir = normalize(lightDir + viewDir);  
-    float spec = pow(max(dot(normal, halfwayDir), 0.0), material.shininess);
-    vec3 specular = light.specular * (spec * material.specular);  
+    float spec = pow(max(dot(normal, halfwayDir), 0.0), material.specular.w);
+    vec3 specular = light.specular * (spec * material.specular.rgb);  
     
 	 // calculate shadow
     float shadow = ShadowCalculation(fs_in.FragPosLightSpace);                      
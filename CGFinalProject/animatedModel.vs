@@ -3,6 +3,10 @@ layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in ivec4 BoneIDs;
 layout (location = 3) in vec4 Weights;
+// per instance for instanced draws, a constant attribute set per draw otherwise
+layout (location = 4) in mat4 model;
+// first texel of this draw's or instance's bone palette, likewise
+layout (location = 8) in int paletteBase;
 
 out VS_OUT {
     vec3 FragPos;
@@ -11,26 +15,54 @@ out VS_OUT {
 } vs_out;
 
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-uniform mat4 lightSpaceMatrix;
+// shared with every program, written once per frame (see uniform_blocks.h)
+layout (std140) uniform ViewData {
+    mat4 view;
+    mat4 projection;
+    vec4 viewPos;
+};
+layout (std140) uniform LightData {
+    mat4 spaceMatrix;
+    vec3 direction;
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+} light;
 
-const int MAX_BONES = 100;
-uniform mat4 gBones[MAX_BONES];
+// transpose of the inverse of model for non-instanced draws, set with it
+uniform mat3 normalMatrix;
+uniform bool instanced;
+
+// every bone palette of the frame, four RGBA32F texels (the rows of a Matrix4f) per bone
+uniform samplerBuffer bonePalette;
+
+mat4 bone(int id)
+{
+    int texel = paletteBase + id * 4;
+    // rows in, GLSL builds from columns
+    return transpose(mat4(texelFetch(bonePalette, texel), texelFetch(bonePalette, texel + 1),
+                          texelFetch(bonePalette, texel + 2), texelFetch(bonePalette, texel + 3)));
+}
 
 void main()
 {
 	mat4 BoneTransform = mat4(1.0);
 	if(BoneIDs[0] != -1) {
-		BoneTransform = gBones[BoneIDs[0]] * Weights[0];
-		BoneTransform     += gBones[BoneIDs[1]] * Weights[1];
-		BoneTransform     += gBones[BoneIDs[2]] * Weights[2];
-		BoneTransform     += gBones[BoneIDs[3]] * Weights[3];
+		BoneTransform = bone(BoneIDs[0]) * Weights[0];
+		BoneTransform     += bone(BoneIDs[1]) * Weights[1];
+		BoneTransform     += bone(BoneIDs[2]) * Weights[2];
+		BoneTransform     += bone(BoneIDs[3]) * Weights[3];
 	}
     vs_out.FragPos = vec3(model * BoneTransform * vec4(aPos, 1.0));
 	vec3 NormalT = vec3(BoneTransform * vec4(aNormal, 0.0));
-	vs_out.Normal = mat3(transpose(inverse(model))) * NormalT;  
-    vs_out.FragPosLightSpace = lightSpaceMatrix * vec4(vs_out.FragPos, 1.0);
+	mat3 normals = normalMatrix;
+	if (instanced) {
+		// cofactors of model: its inverse transpose scaled by the determinant
+		mat3 m = mat3(model);
+		normals = mat3(cross(m[1], m[2]), cross(m[2], m[0]), cross(m[0], m[1]));
+		normals *= sign(dot(m[0], normals[0]));
+	}
+	vs_out.Normal = normals * NormalT;
+    vs_out.FragPosLightSpace = light.spaceMatrix * vec4(vs_out.FragPos, 1.0);
     gl_Position = projection * view * vec4(vs_out.FragPos, 1.0);
 }
\ No newline at end of file
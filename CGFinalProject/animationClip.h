@@ -0,0 +1,582 @@
+#ifndef ANIMATION_CLIP__H
+#define ANIMATION_CLIP__H
+
+#include <assimp/scene.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "math_3d.h"
+#include "ogldev_util.h"
+
+// SSE is baseline on x64 and on x86 builds with /arch:SSE or above (the default since
+// VS2012); anything else takes the scalar path
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1) || defined(__SSE__)
+#define ANIMATION_CLIP_SSE
+#include <xmmintrin.h>
+#endif
+
+// channels sampled together by one pass of the SSE path
+#define CLIP_BATCH 4
+#define CLIP_TOLERANCES_FILE "resources/clipTolerances.txt"
+// the smallest three components of a unit quaternion lie within +-1/sqrt(2)
+#define CLIP_SQRT1_2 0.70710678f
+
+enum ClipTrack { CLIP_POSITION, CLIP_ROTATION, CLIP_SCALING, CLIP_TRACKS };
+
+// how far key reduction may move a clip: model units for positions and scalings,
+// radians for rotations
+struct ClipTolerance
+{
+	float position;
+	float rotation;
+	float scaling;
+
+	ClipTolerance() : position(0.01f), rotation(0.002f), scaling(0.001f) {}
+};
+
+// what compression did to one clip, per ClipTrack
+struct ClipStats
+{
+	unsigned int sourceKeys[CLIP_TRACKS];
+	unsigned int keys[CLIP_TRACKS];
+	// largest distance of a source key from the stored curve, in ClipTolerance units
+	float maxError[CLIP_TRACKS];
+	size_t sourceBytes;    // as aiVectorKey / aiQuatKey
+	size_t bytes;          // as stored
+
+	ClipStats() : sourceBytes(0), bytes(0) {
+		for (unsigned int i = 0; i < CLIP_TRACKS; i++) {
+			sourceKeys[i] = keys[i] = 0;
+			maxError[i] = 0.0f;
+		}
+	}
+
+	float ratio() const { return bytes ? (float)sourceBytes / bytes : 0.0f; }
+};
+
+// One aiAnimation compressed at load into structure of arrays. For each ClipTrack the
+// key times and components of all channels lie back to back (channel c owns keys
+// first[c] .. first[c] + count[c] - 1):
+//   positions, scalings  16 bits per component, between the channel's minimum and
+//                        maximum of that component
+//   rotations            48 bits, smallest three: the index of the largest component
+//                        and the other three in 15 bits each, the largest is rebuilt
+//                        from unit length
+// Before that each track drops the keys that interpolating their kept neighbours
+// reproduces within the clip's ClipTolerance; a constant track keeps one key.
+// sample() evaluates every channel at once into its local transform (translation *
+// rotation * scaling), CLIP_BATCH channels per pass: the key pairs are found and
+// dequantised per channel, the interpolation and the matrix build then run on four
+// lanes. Rotations use normalised lerp, which is what the blend of nearby keys needs;
+// clips whose keys are far apart can switch back to slerp.
+class AnimationClip
+{
+public:
+	AnimationClip() {
+		ticksPerSecond = 25.0f;
+		duration = 0.0f;
+		slerp = false;
+	}
+
+	void load(const aiAnimation* animation, const ClipTolerance& tolerance = ClipTolerance());
+	// tolerance of the clips of the model at path, from CLIP_TOLERANCES_FILE:
+	//   name position rotation scaling match,match,...
+	// the first line with a match word in path wins, then the "default" line
+	static ClipTolerance toleranceFor(const std::string& path);
+
+	bool empty() const { return channelNames.empty(); }
+	unsigned int channelCount() const { return channelNames.size(); }
+	const std::string& channelName(unsigned int channel) const { return channelNames[channel]; }
+	float getTicksPerSecond() const { return ticksPerSecond; }
+	float getDuration() const { return duration; }
+	const ClipStats& getStats() const { return stats; }
+
+	// stored keys of one kind of channel, dequantised: tick, then x, y, z and for
+	// rotations w
+	unsigned int keyCount(ClipTrack kind, unsigned int channel) const { return tracks[kind].count[channel]; }
+	void key(ClipTrack kind, unsigned int channel, unsigned int k, float& tick, float* value) const;
+
+	// exact spherical interpolation of rotations, for clips with widely spaced keys
+	void setSlerp(bool enabled) { slerp = enabled; }
+	bool usesSlerp() const { return slerp; }
+
+	// local transform of every channel at tick, which must lie within the clip
+	void sample(float tick, vector<Matrix4f>& locals) const;
+
+private:
+	// keys of one kind for all channels
+	struct Track
+	{
+		vector<unsigned int> first;
+		vector<unsigned int> count;
+		vector<float> time;
+		vector<unsigned short> x, y, z;
+		// position and scaling only, 3 per channel: the value of 0 and of one step
+		vector<float> base, step;
+
+		// the keys around tick in channel and how far between them it lies
+		void locate(unsigned int channel, float tick, unsigned int& start, unsigned int& end, float& factor) const;
+		void vectorKey(unsigned int channel, unsigned int key, float* v) const;
+		void rotationKey(unsigned int key, float* q) const;
+		size_t bytes() const;
+	};
+
+	// reduce and quantise one channel's keys of one kind; values holds x, y, z, w per key
+	void addTrack(ClipTrack kind, const vector<float>& times, const vector<float>& values, float tolerance);
+	// largest distance of keys start..end from the interpolation of decoded[start] and decoded[end]
+	static float spanError(const vector<float>& times, const vector<float>& values, const vector<float>& decoded,
+		unsigned int start, unsigned int end, bool rotation);
+	static void interpolate(const float* a, const float* b, float factor, bool rotation, float* out);
+	static float distance(const float* a, const float* b, bool rotation);
+	static void packRotation(const float* q, unsigned short* packed);
+	static void unpackRotation(unsigned short a, unsigned short b, unsigned short c, float* q);
+	// channels [first, first + CLIP_BATCH), missing lanes repeat the last channel
+	void sampleBatch(unsigned int first, float tick, Matrix4f* locals, unsigned int lanes) const;
+	static void slerpLane(const float* a, const float* b, float factor, float* q);
+
+	vector<std::string> channelNames;
+	Track tracks[CLIP_TRACKS];
+	float ticksPerSecond;
+	float duration;
+	bool slerp;
+	ClipStats stats;
+};
+
+void AnimationClip::load(const aiAnimation* animation, const ClipTolerance& tolerance)
+{
+	ticksPerSecond = (float)(animation->mTicksPerSecond != 0 ? animation->mTicksPerSecond : 25.0f);
+	duration = (float)animation->mDuration;
+	float tolerances[CLIP_TRACKS] = { tolerance.position, tolerance.rotation, tolerance.scaling };
+	// what a channel without keys of a kind holds
+	float rest[CLIP_TRACKS][4] = { { 0.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 1.0f }, { 1.0f, 1.0f, 1.0f, 0.0f } };
+	vector<float> times, values;
+	for (unsigned int c = 0; c < animation->mNumChannels; c++) {
+		const aiNodeAnim* channel = animation->mChannels[c];
+		channelNames.push_back(channel->mNodeName.data);
+		unsigned int counts[CLIP_TRACKS] = { channel->mNumPositionKeys, channel->mNumRotationKeys, channel->mNumScalingKeys };
+		for (unsigned int kind = 0; kind < CLIP_TRACKS; kind++) {
+			times.clear();
+			values.clear();
+			for (unsigned int k = 0; k < counts[kind]; k++) {
+				if (kind == CLIP_ROTATION) {
+					const aiQuatKey& key = channel->mRotationKeys[k];
+					float value[4] = { key.mValue.x, key.mValue.y, key.mValue.z, key.mValue.w };
+					times.push_back((float)key.mTime);
+					values.insert(values.end(), value, value + 4);
+				}
+				else {
+					const aiVectorKey& key = kind == CLIP_POSITION ? channel->mPositionKeys[k] : channel->mScalingKeys[k];
+					float value[4] = { key.mValue.x, key.mValue.y, key.mValue.z, 0.0f };
+					times.push_back((float)key.mTime);
+					values.insert(values.end(), value, value + 4);
+				}
+			}
+			// assimp always writes one key of each kind; keep locate() in range if it did not
+			if (times.empty()) {
+				times.push_back(0.0f);
+				values.insert(values.end(), rest[kind], rest[kind] + 4);
+			}
+			stats.sourceKeys[kind] += counts[kind];
+			addTrack((ClipTrack)kind, times, values, tolerances[kind]);
+		}
+	}
+	stats.sourceBytes = (stats.sourceKeys[CLIP_POSITION] + stats.sourceKeys[CLIP_SCALING]) * sizeof(aiVectorKey)
+		+ stats.sourceKeys[CLIP_ROTATION] * sizeof(aiQuatKey);
+	for (unsigned int kind = 0; kind < CLIP_TRACKS; kind++) {
+		stats.bytes += tracks[kind].bytes();
+	}
+}
+
+ClipTolerance AnimationClip::toleranceFor(const std::string& path)
+{
+	ClipTolerance fallback;
+	std::ifstream file(CLIP_TOLERANCES_FILE);
+	std::string line;
+	while (std::getline(file, line)) {
+		if (line.empty() || line[0] == '#')
+			continue;
+		std::istringstream fields(line);
+		std::string name, matches;
+		ClipTolerance tolerance;
+		if (!(fields >> name >> tolerance.position >> tolerance.rotation >> tolerance.scaling))
+			continue;
+		if (name == "default") {
+			fallback = tolerance;
+			continue;
+		}
+		fields >> matches;
+		std::istringstream words(matches);
+		std::string word;
+		while (std::getline(words, word, ',')) {
+			if (!word.empty() && path.find(word) != std::string::npos)
+				return tolerance;
+		}
+	}
+	return fallback;
+}
+
+void AnimationClip::key(ClipTrack kind, unsigned int channel, unsigned int k, float& tick, float* value) const
+{
+	const Track& track = tracks[kind];
+	unsigned int index = track.first[channel] + k;
+	tick = track.time[index];
+	if (kind == CLIP_ROTATION)
+		track.rotationKey(index, value);
+	else
+		track.vectorKey(channel, index, value);
+}
+
+void AnimationClip::addTrack(ClipTrack kind, const vector<float>& times, const vector<float>& values, float tolerance)
+{
+	Track& track = tracks[kind];
+	bool rotation = kind == CLIP_ROTATION;
+	unsigned int keys = times.size();
+
+	// quantise every key and keep what it decodes to, which is what sample() will see
+	vector<unsigned short> packed(keys * 3);
+	vector<float> decoded(keys * 4, 0.0f);
+	if (rotation) {
+		for (unsigned int k = 0; k < keys; k++) {
+			packRotation(&values[k * 4], &packed[k * 3]);
+			unpackRotation(packed[k * 3], packed[k * 3 + 1], packed[k * 3 + 2], &decoded[k * 4]);
+		}
+	}
+	else {
+		for (unsigned int i = 0; i < 3; i++) {
+			float low = values[i], high = values[i];
+			for (unsigned int k = 1; k < keys; k++) {
+				low = std::min(low, values[k * 4 + i]);
+				high = std::max(high, values[k * 4 + i]);
+			}
+			float step = (high - low) / 65535.0f;
+			track.base.push_back(low);
+			track.step.push_back(step);
+			for (unsigned int k = 0; k < keys; k++) {
+				float steps = step > 0.0f ? floorf((values[k * 4 + i] - low) / step + 0.5f) : 0.0f;
+				packed[k * 3 + i] = (unsigned short)std::min(std::max(steps, 0.0f), 65535.0f);
+				decoded[k * 4 + i] = low + packed[k * 3 + i] * step;
+			}
+		}
+	}
+
+	// a constant track keeps its first key; otherwise each kept key reaches as far as the
+	// keys up to the next one stay within tolerance of the line between them
+	vector<unsigned int> kept(1, 0);
+	float error = 0.0f;
+	for (unsigned int k = 0; k < keys; k++) {
+		error = std::max(error, distance(&decoded[0], &values[k * 4], rotation));
+	}
+	if (error > tolerance) {
+		error = 0.0f;
+		for (unsigned int start = 0; start + 1 < keys; ) {
+			unsigned int end = start + 1;
+			while (end + 1 < keys && spanError(times, values, decoded, start, end + 1, rotation) <= tolerance)
+				end++;
+			error = std::max(error, spanError(times, values, decoded, start, end, rotation));
+			kept.push_back(end);
+			start = end;
+		}
+	}
+	stats.maxError[kind] = std::max(stats.maxError[kind], error);
+	stats.keys[kind] += kept.size();
+
+	track.first.push_back(track.time.size());
+	track.count.push_back(kept.size());
+	for (auto k : kept) {
+		track.time.push_back(times[k]);
+		track.x.push_back(packed[k * 3]);
+		track.y.push_back(packed[k * 3 + 1]);
+		track.z.push_back(packed[k * 3 + 2]);
+	}
+}
+
+float AnimationClip::spanError(const vector<float>& times, const vector<float>& values, const vector<float>& decoded,
+	unsigned int start, unsigned int end, bool rotation)
+{
+	float error = 0.0f;
+	float delta = times[end] - times[start];
+	for (unsigned int k = start; k <= end; k++) {
+		float factor = delta > 0.0f ? std::min(std::max((times[k] - times[start]) / delta, 0.0f), 1.0f) : 0.0f;
+		float value[4];
+		interpolate(&decoded[start * 4], &decoded[end * 4], factor, rotation, value);
+		error = std::max(error, distance(value, &values[k * 4], rotation));
+	}
+	return error;
+}
+
+// lerp, or for rotations nlerp along the shorter arc, as sampleBatch() does it
+void AnimationClip::interpolate(const float* a, const float* b, float factor, bool rotation, float* out)
+{
+	float sign = rotation && a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3] < 0.0f ? -1.0f : 1.0f;
+	float length = 0.0f;
+	for (unsigned int i = 0; i < 4; i++) {
+		out[i] = a[i] + (b[i] * sign - a[i]) * factor;
+		length += out[i] * out[i];
+	}
+	if (rotation && length > 0.0f) {
+		length = sqrtf(length);
+		for (unsigned int i = 0; i < 4; i++)
+			out[i] /= length;
+	}
+}
+
+// euclidean distance, or for rotations the angle between them
+float AnimationClip::distance(const float* a, const float* b, bool rotation)
+{
+	if (!rotation) {
+		float dx = a[0] - b[0], dy = a[1] - b[1], dz = a[2] - b[2];
+		return sqrtf(dx * dx + dy * dy + dz * dz);
+	}
+	// from the chord between the unit quaternions on the same side, which unlike acos
+	// of their dot product keeps its precision for small angles
+	float lengthA = sqrtf(a[0] * a[0] + a[1] * a[1] + a[2] * a[2] + a[3] * a[3]);
+	float lengthB = sqrtf(b[0] * b[0] + b[1] * b[1] + b[2] * b[2] + b[3] * b[3]);
+	if (lengthA == 0.0f || lengthB == 0.0f)
+		return 0.0f;
+	float sign = a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3] < 0.0f ? -1.0f : 1.0f;
+	float chord = 0.0f;
+	for (unsigned int i = 0; i < 4; i++) {
+		float d = a[i] / lengthA - sign * b[i] / lengthB;
+		chord += d * d;
+	}
+	return 4.0f * asinf(std::min(sqrtf(chord) * 0.5f, 1.0f));
+}
+
+// normalised and turned so the largest component is positive; its index goes into the
+// top bits of the first two words, the other three components into 15 bits each
+void AnimationClip::packRotation(const float* q, unsigned short* packed)
+{
+	float length = sqrtf(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+	unsigned int largest = 0;
+	for (unsigned int i = 1; i < 4; i++) {
+		if (fabsf(q[i]) > fabsf(q[largest]))
+			largest = i;
+	}
+	float scale = (q[largest] < 0.0f ? -1.0f : 1.0f) / (length > 0.0f ? length : 1.0f);
+	unsigned short small[3];
+	for (unsigned int i = 0, j = 0; i < 4; i++) {
+		if (i == largest)
+			continue;
+		float steps = floorf(q[i] * scale / CLIP_SQRT1_2 * 16383.0f + 0.5f) + 16384.0f;
+		small[j++] = (unsigned short)std::min(std::max(steps, 1.0f), 32767.0f);
+	}
+	packed[0] = (unsigned short)(small[0] | (largest >> 1) << 15);
+	packed[1] = (unsigned short)(small[1] | (largest & 1) << 15);
+	packed[2] = small[2];
+}
+
+void AnimationClip::unpackRotation(unsigned short a, unsigned short b, unsigned short c, float* q)
+{
+	unsigned int largest = (a >> 15) << 1 | b >> 15;
+	unsigned short small[3] = { a, b, c };
+	float sum = 0.0f;
+	for (unsigned int i = 0, j = 0; i < 4; i++) {
+		if (i == largest)
+			continue;
+		q[i] = ((int)(small[j++] & 0x7fff) - 16384) * (CLIP_SQRT1_2 / 16383.0f);
+		sum += q[i] * q[i];
+	}
+	q[largest] = sqrtf(std::max(1.0f - sum, 0.0f));
+}
+
+// the last key not after tick, paired with the next one; a single key is held
+void AnimationClip::Track::locate(unsigned int channel, float tick, unsigned int& start, unsigned int& end, float& factor) const
+{
+	unsigned int begin = first[channel];
+	unsigned int keys = count[channel];
+	if (keys < 2) {
+		start = end = begin;
+		factor = 0.0f;
+		return;
+	}
+	const float* times = &time[begin];
+	unsigned int key = (unsigned int)(std::upper_bound(times + 1, times + keys - 1, tick) - times) - 1;
+	start = begin + key;
+	end = start + 1;
+	float delta = time[end] - time[start];
+	factor = delta > 0.0f ? std::min(std::max((tick - time[start]) / delta, 0.0f), 1.0f) : 0.0f;
+}
+
+void AnimationClip::Track::vectorKey(unsigned int channel, unsigned int key, float* v) const
+{
+	const float* zero = &base[channel * 3];
+	const float* unit = &step[channel * 3];
+	v[0] = zero[0] + x[key] * unit[0];
+	v[1] = zero[1] + y[key] * unit[1];
+	v[2] = zero[2] + z[key] * unit[2];
+}
+
+void AnimationClip::Track::rotationKey(unsigned int key, float* q) const
+{
+	unpackRotation(x[key], y[key], z[key], q);
+}
+
+size_t AnimationClip::Track::bytes() const
+{
+	return (first.size() + count.size() + time.size() + base.size() + step.size()) * sizeof(float)
+		+ (x.size() + y.size() + z.size()) * sizeof(unsigned short);
+}
+
+void AnimationClip::sample(float tick, vector<Matrix4f>& locals) const
+{
+	unsigned int channels = channelNames.size();
+	locals.resize(channels);
+	for (unsigned int first = 0; first < channels; first += CLIP_BATCH) {
+		sampleBatch(first, tick, &locals[first], std::min((unsigned int)CLIP_BATCH, channels - first));
+	}
+}
+
+void AnimationClip::sampleBatch(unsigned int first, float tick, Matrix4f* locals, unsigned int lanes) const
+{
+	// gather the key pairs of each lane; unused lanes repeat the last one
+	float px0[CLIP_BATCH], py0[CLIP_BATCH], pz0[CLIP_BATCH], px1[CLIP_BATCH], py1[CLIP_BATCH], pz1[CLIP_BATCH], pf[CLIP_BATCH];
+	float sx0[CLIP_BATCH], sy0[CLIP_BATCH], sz0[CLIP_BATCH], sx1[CLIP_BATCH], sy1[CLIP_BATCH], sz1[CLIP_BATCH], sf[CLIP_BATCH];
+	float qx0[CLIP_BATCH], qy0[CLIP_BATCH], qz0[CLIP_BATCH], qw0[CLIP_BATCH];
+	float qx1[CLIP_BATCH], qy1[CLIP_BATCH], qz1[CLIP_BATCH], qw1[CLIP_BATCH], qf[CLIP_BATCH];
+	float sq[CLIP_BATCH][4];
+	const Track& positions = tracks[CLIP_POSITION];
+	const Track& rotations = tracks[CLIP_ROTATION];
+	const Track& scalings = tracks[CLIP_SCALING];
+	for (unsigned int lane = 0; lane < CLIP_BATCH; lane++) {
+		unsigned int channel = first + std::min(lane, lanes - 1);
+		unsigned int start, end;
+		float a[4], b[4];
+		positions.locate(channel, tick, start, end, pf[lane]);
+		positions.vectorKey(channel, start, a);
+		positions.vectorKey(channel, end, b);
+		px0[lane] = a[0]; py0[lane] = a[1]; pz0[lane] = a[2];
+		px1[lane] = b[0]; py1[lane] = b[1]; pz1[lane] = b[2];
+		scalings.locate(channel, tick, start, end, sf[lane]);
+		scalings.vectorKey(channel, start, a);
+		scalings.vectorKey(channel, end, b);
+		sx0[lane] = a[0]; sy0[lane] = a[1]; sz0[lane] = a[2];
+		sx1[lane] = b[0]; sy1[lane] = b[1]; sz1[lane] = b[2];
+		rotations.locate(channel, tick, start, end, qf[lane]);
+		rotations.rotationKey(start, a);
+		rotations.rotationKey(end, b);
+		if (slerp) {
+			slerpLane(a, b, qf[lane], sq[lane]);
+			continue;
+		}
+		qx0[lane] = a[0]; qy0[lane] = a[1]; qz0[lane] = a[2]; qw0[lane] = a[3];
+		qx1[lane] = b[0]; qy1[lane] = b[1]; qz1[lane] = b[2]; qw1[lane] = b[3];
+	}
+
+	// the nine rotation terms, the scale and the translation of each lane
+	float m[15][CLIP_BATCH];
+#ifdef ANIMATION_CLIP_SSE
+	__m128 f = _mm_loadu_ps(pf);
+	__m128 tx = _mm_add_ps(_mm_loadu_ps(px0), _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(px1), _mm_loadu_ps(px0)), f));
+	__m128 ty = _mm_add_ps(_mm_loadu_ps(py0), _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(py1), _mm_loadu_ps(py0)), f));
+	__m128 tz = _mm_add_ps(_mm_loadu_ps(pz0), _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(pz1), _mm_loadu_ps(pz0)), f));
+	f = _mm_loadu_ps(sf);
+	__m128 scaleX = _mm_add_ps(_mm_loadu_ps(sx0), _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(sx1), _mm_loadu_ps(sx0)), f));
+	__m128 scaleY = _mm_add_ps(_mm_loadu_ps(sy0), _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(sy1), _mm_loadu_ps(sy0)), f));
+	__m128 scaleZ = _mm_add_ps(_mm_loadu_ps(sz0), _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(sz1), _mm_loadu_ps(sz0)), f));
+
+	__m128 x, y, z, w;
+	if (slerp) {
+		x = _mm_set_ps(sq[3][0], sq[2][0], sq[1][0], sq[0][0]);
+		y = _mm_set_ps(sq[3][1], sq[2][1], sq[1][1], sq[0][1]);
+		z = _mm_set_ps(sq[3][2], sq[2][2], sq[1][2], sq[0][2]);
+		w = _mm_set_ps(sq[3][3], sq[2][3], sq[1][3], sq[0][3]);
+	}
+	else {
+		// nlerp along the shorter arc: flip the end key where the dot product is negative
+		__m128 ax = _mm_loadu_ps(qx0), ay = _mm_loadu_ps(qy0), az = _mm_loadu_ps(qz0), aw = _mm_loadu_ps(qw0);
+		__m128 bx = _mm_loadu_ps(qx1), by = _mm_loadu_ps(qy1), bz = _mm_loadu_ps(qz1), bw = _mm_loadu_ps(qw1);
+		__m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_add_ps(_mm_mul_ps(az, bz), _mm_mul_ps(aw, bw)));
+		__m128 sign = _mm_and_ps(dot, _mm_set1_ps(-0.0f));
+		bx = _mm_xor_ps(bx, sign); by = _mm_xor_ps(by, sign); bz = _mm_xor_ps(bz, sign); bw = _mm_xor_ps(bw, sign);
+		f = _mm_loadu_ps(qf);
+		x = _mm_add_ps(ax, _mm_mul_ps(_mm_sub_ps(bx, ax), f));
+		y = _mm_add_ps(ay, _mm_mul_ps(_mm_sub_ps(by, ay), f));
+		z = _mm_add_ps(az, _mm_mul_ps(_mm_sub_ps(bz, az), f));
+		w = _mm_add_ps(aw, _mm_mul_ps(_mm_sub_ps(bw, aw), f));
+		__m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_add_ps(_mm_mul_ps(z, z), _mm_mul_ps(w, w))));
+		x = _mm_div_ps(x, length); y = _mm_div_ps(y, length); z = _mm_div_ps(z, length); w = _mm_div_ps(w, length);
+	}
+
+	// aiQuaternion::GetMatrix, row-major
+	__m128 one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f);
+	__m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+	__m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+	__m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+	_mm_storeu_ps(m[0], _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))));
+	_mm_storeu_ps(m[1], _mm_mul_ps(two, _mm_sub_ps(xy, wz)));
+	_mm_storeu_ps(m[2], _mm_mul_ps(two, _mm_add_ps(xz, wy)));
+	_mm_storeu_ps(m[3], _mm_mul_ps(two, _mm_add_ps(xy, wz)));
+	_mm_storeu_ps(m[4], _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))));
+	_mm_storeu_ps(m[5], _mm_mul_ps(two, _mm_sub_ps(yz, wx)));
+	_mm_storeu_ps(m[6], _mm_mul_ps(two, _mm_sub_ps(xz, wy)));
+	_mm_storeu_ps(m[7], _mm_mul_ps(two, _mm_add_ps(yz, wx)));
+	_mm_storeu_ps(m[8], _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))));
+	_mm_storeu_ps(m[9], scaleX);
+	_mm_storeu_ps(m[10], scaleY);
+	_mm_storeu_ps(m[11], scaleZ);
+	_mm_storeu_ps(m[12], tx);
+	_mm_storeu_ps(m[13], ty);
+	_mm_storeu_ps(m[14], tz);
+#else
+	for (unsigned int lane = 0; lane < CLIP_BATCH; lane++) {
+		float x, y, z, w;
+		if (slerp) {
+			x = sq[lane][0]; y = sq[lane][1]; z = sq[lane][2]; w = sq[lane][3];
+		}
+		else {
+			float sign = qx0[lane] * qx1[lane] + qy0[lane] * qy1[lane] + qz0[lane] * qz1[lane] + qw0[lane] * qw1[lane] < 0.0f ? -1.0f : 1.0f;
+			x = qx0[lane] + (qx1[lane] * sign - qx0[lane]) * qf[lane];
+			y = qy0[lane] + (qy1[lane] * sign - qy0[lane]) * qf[lane];
+			z = qz0[lane] + (qz1[lane] * sign - qz0[lane]) * qf[lane];
+			w = qw0[lane] + (qw1[lane] * sign - qw0[lane]) * qf[lane];
+			float length = sqrtf(x * x + y * y + z * z + w * w);
+			x /= length; y /= length; z /= length; w /= length;
+		}
+		m[0][lane] = 1.0f - 2.0f * (y * y + z * z);
+		m[1][lane] = 2.0f * (x * y - w * z);
+		m[2][lane] = 2.0f * (x * z + w * y);
+		m[3][lane] = 2.0f * (x * y + w * z);
+		m[4][lane] = 1.0f - 2.0f * (x * x + z * z);
+		m[5][lane] = 2.0f * (y * z - w * x);
+		m[6][lane] = 2.0f * (x * z - w * y);
+		m[7][lane] = 2.0f * (y * z + w * x);
+		m[8][lane] = 1.0f - 2.0f * (x * x + y * y);
+		m[9][lane] = sx0[lane] + (sx1[lane] - sx0[lane]) * sf[lane];
+		m[10][lane] = sy0[lane] + (sy1[lane] - sy0[lane]) * sf[lane];
+		m[11][lane] = sz0[lane] + (sz1[lane] - sz0[lane]) * sf[lane];
+		m[12][lane] = px0[lane] + (px1[lane] - px0[lane]) * pf[lane];
+		m[13][lane] = py0[lane] + (py1[lane] - py0[lane]) * pf[lane];
+		m[14][lane] = pz0[lane] + (pz1[lane] - pz0[lane]) * pf[lane];
+	}
+#endif
+
+	// translation * rotation * scaling: the rotation's columns scaled, translation last
+	for (unsigned int lane = 0; lane < lanes; lane++) {
+		Matrix4f& local = locals[lane];
+		for (unsigned int row = 0; row < 3; row++) {
+			local.m[row][0] = m[row * 3][lane] * m[9][lane];
+			local.m[row][1] = m[row * 3 + 1][lane] * m[10][lane];
+			local.m[row][2] = m[row * 3 + 2][lane] * m[11][lane];
+			local.m[row][3] = m[12 + row][lane];
+		}
+		local.m[3][0] = 0.0f; local.m[3][1] = 0.0f; local.m[3][2] = 0.0f; local.m[3][3] = 1.0f;
+	}
+}
+
+// aiQuaternion::Interpolate per lane, for clips that asked for slerp
+void AnimationClip::slerpLane(const float* a, const float* b, float factor, float* q)
+{
+	aiQuaternion from(a[3], a[0], a[1], a[2]);
+	aiQuaternion to(b[3], b[0], b[1], b[2]);
+	aiQuaternion out;
+	aiQuaternion::Interpolate(out, from, to, factor);
+	out.Normalize();
+	q[0] = out.x; q[1] = out.y; q[2] = out.z; q[3] = out.w;
+}
+
+#endif // !ANIMATION_CLIP__H
@@ -0,0 +1,174 @@
+#ifndef ANIMATION_SCHEDULER__H
+#define ANIMATION_SCHEDULER__H
+
+#include <glm/glm.hpp>
+
+#include <cfloat>
+#include <chrono>
+#include <vector>
+
+#include "AnimatedModel.h"
+#include "frustum.h"
+#include "renderQueue.h"
+
+// within this distance of the camera poses update every frame; each doubling of the
+// distance beyond it halves the rate, down to one update every ANIM_LOD_MAX_INTERVAL frames
+#define ANIM_LOD_NEAR_RADIUS 30.0f
+#define ANIM_LOD_MAX_INTERVAL 8
+// CPU time per frame for pose evaluation before due updates start to wait
+#define ANIM_LOD_BUDGET_MS 2.0
+// frames a due update may be put off by the budget before it runs regardless
+#define ANIM_LOD_MAX_DEFERRED 16
+
+// Decides once per frame for every animated Spirit whether its pose is evaluated again
+// through AnimatedModel::poseAt() or the last one is drawn once more:
+//   - outside every pass's frustum (camera and light) the pose is frozen;
+//   - coming back into view, or never posed yet, it updates at once: poses are taken
+//     at absolute time, so catching up is a single evaluation at the current time;
+//   - otherwise it updates every interval frames, 1 within the near radius, with the
+//     phase staggered per object so far ones do not all land on the same frame;
+//   - all due updates share one per-frame time budget; once it is spent they wait for
+//     a later frame, but never longer than ANIM_LOD_MAX_DEFERRED frames.
+// Catch-ups and never-posed objects ignore the budget: a wrong pose on screen is worse
+// than a slow frame.
+class AnimationScheduler
+{
+DISALLOW_COPY_AND_ASSIGN(AnimationScheduler)
+public:
+	// what the scheduler remembers of one object; kept by the object
+	struct Slot
+	{
+		unsigned int id;
+		unsigned int lastUpdate;
+		unsigned int nextUpdate;
+		bool posed;
+		bool visible;
+
+		Slot() : id(0), lastUpdate(0), nextUpdate(0), posed(false), visible(false) {}
+	};
+
+	struct Stats
+	{
+		unsigned int updated;
+		unsigned int caughtUp;     // of updated, on coming into view
+		unsigned int reused;       // not due at their distance
+		unsigned int frozen;       // out of view
+		unsigned int deferred;     // due, but over budget
+		double poseMs;
+	};
+
+	static AnimationScheduler* getInstance() {
+		if (!instance) {
+			instance = new AnimationScheduler();
+		}
+		return instance;
+	}
+
+	// off: every object updates every frame, as before
+	void setEnabled(bool enabled) { this->enabled = enabled; }
+	// start a frame seen from viewPosition; call before any object is collected
+	void beginFrame(const glm::vec3& viewPosition, const Frustum frusta[PASS_COUNT]);
+	// whether the object of slot, which lies within the world box, should evaluate its pose now
+	bool shouldUpdate(Slot& slot, const glm::vec3& boxMin, const glm::vec3& boxMax);
+	// evaluate model's pose at time into palette, charged to this frame's budget
+	void evaluate(AnimatedModel& model, float time, vector<Matrix4f>& palette);
+
+	const Stats& getStats() const { return stats; }
+
+private:
+	AnimationScheduler();
+
+	// frames between updates at distance
+	static unsigned int interval(float distance);
+
+	static AnimationScheduler* instance;
+	bool enabled;
+	glm::vec3 viewPosition;
+	Frustum frusta[PASS_COUNT];
+	unsigned int frame;
+	unsigned int nextId;
+	Stats stats;
+};
+AnimationScheduler* AnimationScheduler::instance = nullptr;
+
+AnimationScheduler::AnimationScheduler()
+{
+	enabled = true;
+	viewPosition = glm::vec3(0.0f);
+	frame = 0;
+	nextId = 0;
+	stats = Stats();
+}
+
+void AnimationScheduler::beginFrame(const glm::vec3& viewPosition, const Frustum frusta[PASS_COUNT])
+{
+	this->viewPosition = viewPosition;
+	for (unsigned int pass = 0; pass < PASS_COUNT; pass++) {
+		this->frusta[pass] = frusta[pass];
+	}
+	frame++;
+	stats = Stats();
+}
+
+bool AnimationScheduler::shouldUpdate(Slot& slot, const glm::vec3& boxMin, const glm::vec3& boxMax)
+{
+	if (slot.id == 0) {
+		slot.id = ++nextId;
+	}
+	bool wasVisible = slot.visible;
+	slot.visible = false;
+	for (unsigned int pass = 0; pass < PASS_COUNT && !slot.visible; pass++) {
+		slot.visible = frusta[pass].testAABB(boxMin, boxMax);
+	}
+
+	bool catchUp = !slot.posed || (slot.visible && !wasVisible);
+	unsigned int every = interval(glm::length(glm::clamp(viewPosition, boxMin, boxMax) - viewPosition));
+	if (enabled && !catchUp) {
+		if (!slot.visible) {
+			stats.frozen++;
+			return false;
+		}
+		if (frame < slot.nextUpdate) {
+			stats.reused++;
+			return false;
+		}
+		// counted from the frame the update fell due, not from the last one that ran
+		if (stats.poseMs >= ANIM_LOD_BUDGET_MS && frame - slot.nextUpdate < ANIM_LOD_MAX_DEFERRED) {
+			stats.deferred++;
+			return false;
+		}
+	}
+
+	// after a catch-up the next update is pulled forward by the object's phase; otherwise
+	// it stays on that phase grid, so a deferred update does not shift the later ones
+	if (catchUp) {
+		slot.nextUpdate = frame + every - slot.id % every;
+	} else if (frame >= slot.nextUpdate) {
+		slot.nextUpdate += ((frame - slot.nextUpdate) / every + 1) * every;
+	}
+	slot.lastUpdate = frame;
+	if (catchUp && slot.posed) {
+		stats.caughtUp++;
+	}
+	slot.posed = true;
+	stats.updated++;
+	return true;
+}
+
+void AnimationScheduler::evaluate(AnimatedModel& model, float time, vector<Matrix4f>& palette)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	model.poseAt(time, palette);
+	stats.poseMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+unsigned int AnimationScheduler::interval(float distance)
+{
+	unsigned int every = 1;
+	for (float radius = ANIM_LOD_NEAR_RADIUS; distance > radius && every < ANIM_LOD_MAX_INTERVAL; radius *= 2.0f) {
+		every *= 2;
+	}
+	return every;
+}
+
+#endif // !ANIMATION_SCHEDULER__H
@@ -0,0 +1,251 @@
+#ifndef ASSET_REPORT__H
+#define ASSET_REPORT__H
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdio.h>
+
+#include "ogldev_util.h"
+
+#define ASSET_BUDGETS_FILE "resources/assetBudgets.txt"
+#define ASSET_REPORT_FILE "assetReport.json"
+
+// what one AnimatedModel costs, filled in while it loads
+struct ModelStats
+{
+	string name;
+	unsigned int meshes;
+	unsigned int vertices;
+	unsigned int indices;
+	unsigned int bones;
+	unsigned int animations;
+	unsigned int channels;
+	unsigned int nodes;           // in the hierarchy
+	unsigned int animatedNodes;   // kept for posing, see AnimatedModel::buildNodeTable()
+	unsigned int positionKeys;
+	unsigned int rotationKeys;
+	unsigned int scalingKeys;
+	// the first clip after compression (animationClip.h); the key counts above are Assimp's
+	unsigned int clipKeys;
+	size_t clipSourceBytes;
+	size_t clipBytes;
+	float positionError;
+	float rotationError;   // radians
+	float scalingError;
+	double parseMs;    // Assimp ReadFile
+	double processMs;  // processNode / processMesh
+	double uploadMs;   // buffer upload plus VAO setup
+	size_t cpuBytes;   // vertex/index copies, bones, the compressed clip and its node table
+	size_t gpuBytes;   // VBO + EBO
+
+	ModelStats() : meshes(0), vertices(0), indices(0), bones(0), animations(0), channels(0),
+		nodes(0), animatedNodes(0), positionKeys(0), rotationKeys(0), scalingKeys(0), clipKeys(0), clipSourceBytes(0), clipBytes(0),
+		positionError(0.0f), rotationError(0.0f), scalingError(0.0f), parseMs(0.0), processMs(0.0), uploadMs(0.0),
+		cpuBytes(0), gpuBytes(0) {}
+
+	unsigned int triangles() const { return indices / 3; }
+	unsigned int keys() const { return positionKeys + rotationKeys + scalingKeys; }
+	float clipRatio() const { return clipBytes ? (float)clipSourceBytes / clipBytes : 0.0f; }
+};
+
+// Load-time cost report for every AnimatedModel. Each model is printed as it becomes
+// resident and checked against the budget of its category; save() writes the whole
+// report as JSON once booting is done.
+// Budgets come from ASSET_BUDGETS_FILE, one category per line:
+//   name maxTriangles maxVertices maxBones maxKeys maxGpuKB match,match,...
+// A model belongs to the first category with a match word in its path, otherwise to
+// the "default" category. Without the file nothing is checked.
+class AssetReport
+{
+DISALLOW_COPY_AND_ASSIGN(AssetReport)
+public:
+	static AssetReport* getInstance() {
+		if (!instance) {
+			instance = new AssetReport();
+		}
+		return instance;
+	}
+
+	void add(const ModelStats& stats);
+	void save() const;
+
+private:
+	AssetReport();
+
+	struct Budget
+	{
+		string category;
+		unsigned int triangles;
+		unsigned int vertices;
+		unsigned int bones;
+		unsigned int keys;
+		unsigned int gpuKB;
+		vector<string> matches;
+	};
+
+	struct Entry
+	{
+		ModelStats stats;
+		string category;
+		vector<string> violations;
+	};
+
+	void loadBudgets();
+	const Budget* budgetFor(const string& name) const;
+	static void check(vector<string>& violations, const char* what, size_t value, size_t limit);
+	// text as a quoted JSON string
+	static string quoted(const string& text);
+
+	static AssetReport* instance;
+	vector<Budget> budgets;
+	vector<Entry> entries;
+};
+AssetReport* AssetReport::instance = nullptr;
+
+AssetReport::AssetReport()
+{
+	loadBudgets();
+}
+
+void AssetReport::add(const ModelStats& stats)
+{
+	Entry entry;
+	entry.stats = stats;
+	const Budget* budget = budgetFor(stats.name);
+	entry.category = budget ? budget->category : "default";
+	if (budget) {
+		check(entry.violations, "triangles", stats.triangles(), budget->triangles);
+		check(entry.violations, "vertices", stats.vertices, budget->vertices);
+		check(entry.violations, "bones", stats.bones, budget->bones);
+		check(entry.violations, "keys", stats.keys(), budget->keys);
+		check(entry.violations, "gpuKB", stats.gpuBytes / 1024, budget->gpuKB);
+	}
+
+	printf("[asset] %-40s %-11s %3u meshes %7u verts %7u tris %3u bones %6u/%u/%u keys (pos/rot/scl)"
+		"  parse %.1f ms  process %.1f ms  upload %.1f ms  cpu %u KB  gpu %u KB\n",
+		stats.name.c_str(), entry.category.c_str(), stats.meshes, stats.vertices, stats.triangles(), stats.bones,
+		stats.positionKeys, stats.rotationKeys, stats.scalingKeys, stats.parseMs, stats.processMs, stats.uploadMs,
+		(unsigned int)(stats.cpuBytes / 1024), (unsigned int)(stats.gpuBytes / 1024));
+	if (stats.clipBytes) {
+		printf("[asset] %-40s clip %u -> %u keys  %u -> %u KB (%.1fx)  max error %.4f / %.5f rad / %.4f (pos/rot/scl)"
+			"  %u of %u nodes posed\n",
+			stats.name.c_str(), stats.keys(), stats.clipKeys, (unsigned int)(stats.clipSourceBytes / 1024),
+			(unsigned int)(stats.clipBytes / 1024), stats.clipRatio(), stats.positionError, stats.rotationError, stats.scalingError,
+			stats.animatedNodes, stats.nodes);
+	}
+	for (auto& violation : entry.violations) {
+		std::cout << "WARNING::ASSET_BUDGET:: " << stats.name << " (" << entry.category << ") " << violation << std::endl;
+	}
+	entries.push_back(entry);
+}
+
+string AssetReport::quoted(const string& text)
+{
+	string result = "\"";
+	for (unsigned char c : text) {
+		if (c == '"' || c == '\\') {
+			result += '\\';
+			result += (char)c;
+		}
+		else if (c < 0x20) {
+			char escape[8];
+			SNPRINTF(escape, sizeof(escape), "\\u%04x", c);
+			result += escape;
+		}
+		else {
+			result += (char)c;
+		}
+	}
+	return result + "\"";
+}
+
+void AssetReport::save() const
+{
+	std::ofstream file(ASSET_REPORT_FILE);
+	if (!file) {
+		std::cout << "ERROR::ASSET_REPORT:: cannot write " << ASSET_REPORT_FILE << std::endl;
+		return;
+	}
+	file << "{\n  \"models\": [";
+	for (size_t i = 0; i < entries.size(); i++) {
+		const ModelStats& s = entries[i].stats;
+		file << (i ? "," : "") << "\n    {\n"
+			<< "      \"name\": " << quoted(s.name) << ",\n"
+			<< "      \"category\": " << quoted(entries[i].category) << ",\n"
+			<< "      \"meshes\": " << s.meshes << ",\n"
+			<< "      \"vertices\": " << s.vertices << ",\n"
+			<< "      \"indices\": " << s.indices << ",\n"
+			<< "      \"triangles\": " << s.triangles() << ",\n"
+			<< "      \"bones\": " << s.bones << ",\n"
+			<< "      \"animations\": " << s.animations << ",\n"
+			<< "      \"channels\": " << s.channels << ",\n"
+			<< "      \"nodes\": { \"total\": " << s.nodes << ", \"posed\": " << s.animatedNodes << " },\n"
+			<< "      \"keys\": { \"position\": " << s.positionKeys << ", \"rotation\": " << s.rotationKeys
+			<< ", \"scaling\": " << s.scalingKeys << " },\n"
+			<< "      \"clip\": { \"keys\": " << s.clipKeys << ", \"sourceBytes\": " << s.clipSourceBytes
+			<< ", \"bytes\": " << s.clipBytes << ", \"ratio\": " << s.clipRatio()
+			<< ", \"maxError\": { \"position\": " << s.positionError << ", \"rotation\": " << s.rotationError
+			<< ", \"scaling\": " << s.scalingError << " } },\n"
+			<< "      \"timeMs\": { \"parse\": " << s.parseMs << ", \"processMesh\": " << s.processMs
+			<< ", \"upload\": " << s.uploadMs << " },\n"
+			<< "      \"cpuBytes\": " << s.cpuBytes << ",\n"
+			<< "      \"gpuBytes\": " << s.gpuBytes << ",\n"
+			<< "      \"violations\": [";
+		for (size_t v = 0; v < entries[i].violations.size(); v++) {
+			file << (v ? ", " : "") << quoted(entries[i].violations[v]);
+		}
+		file << "]\n    }";
+	}
+	file << "\n  ]\n}\n";
+}
+
+void AssetReport::loadBudgets()
+{
+	std::ifstream file(ASSET_BUDGETS_FILE);
+	string line;
+	while (std::getline(file, line)) {
+		if (line.empty() || line[0] == '#')
+			continue;
+		std::istringstream fields(line);
+		Budget budget;
+		string matches;
+		if (!(fields >> budget.category >> budget.triangles >> budget.vertices >> budget.bones >> budget.keys >> budget.gpuKB))
+			continue;
+		fields >> matches;
+		std::istringstream words(matches);
+		string word;
+		while (std::getline(words, word, ',')) {
+			if (!word.empty())
+				budget.matches.push_back(word);
+		}
+		budgets.push_back(budget);
+	}
+}
+
+const AssetReport::Budget* AssetReport::budgetFor(const string& name) const
+{
+	const Budget* fallback = NULL;
+	for (auto& budget : budgets) {
+		if (budget.category == "default")
+			fallback = &budget;
+		for (auto& match : budget.matches) {
+			if (name.find(match) != string::npos)
+				return &budget;
+		}
+	}
+	return fallback;
+}
+
+void AssetReport::check(vector<string>& violations, const char* what, size_t value, size_t limit)
+{
+	if (value <= limit)
+		return;
+	char message[128];
+	SNPRINTF(message, sizeof(message), "%s %u over budget %u", what, (unsigned int)value, (unsigned int)limit);
+	violations.push_back(message);
+}
+
+#endif // !ASSET_REPORT__H
@@ -0,0 +1,376 @@
+#ifndef ASSET_STREAMER__H
+#define ASSET_STREAMER__H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <stdio.h>
+
+#include <learnopengl/gl_state.h>
+#include "ogldev_util.h"
+
+#define BOOT_BOUNDS_CACHE "resources/bootBounds.txt"
+
+// Background asset loader used by the progressive boot path.
+// Every asset is split into three steps:
+//   load    - CPU work (file IO, Assimp, stb_image, FreeType) on the worker thread
+//   upload  - buffer and texture uploads, also on the worker thread, through a hidden
+//             GLFW context shared with the render window; followed by a glFenceSync
+//   publish - render thread, inside pump(), only once the upload fence has signalled;
+//             creates per-context objects (VAOs) and flips the asset to visible
+//   discard - render thread, inside pump(), instead of upload and publish when load
+//             failed; frees whatever load and the caller set up for the asset
+// Without a shared context (attachContext failed) upload runs inside pump() instead.
+// The streamer also keeps the boot timeline, and a cache of model bounds from the last
+// run so the very first frame can draw proxy boxes for models that are not parsed yet.
+class AssetStreamer
+{
+DISALLOW_COPY_AND_ASSIGN(AssetStreamer)
+public:
+	static AssetStreamer* getInstance() {
+		if (!instance) {
+			instance = new AssetStreamer();
+		}
+		return instance;
+	}
+
+	void start();
+	// create the loader context; main thread, after glad has been loaded for window
+	void attachContext(GLFWwindow* window);
+	void shutdown();
+	// load must not touch GL; upload may only create shareable objects (buffers, textures)
+	void submit(const std::string& name, std::function<bool()> load, std::function<void()> upload,
+		std::function<void()> publish = std::function<void()>(),
+		std::function<void()> discard = std::function<void()>());
+	// publish finished assets on the render thread until budgetMs is spent
+	void pump(double budgetMs);
+	// block until every submitted asset is resident (non-progressive boot)
+	void flush();
+	bool isIdle();
+
+	double elapsedMs() const;
+	void logEvent(const std::string& what);
+
+	bool cachedBounds(const std::string& name, glm::vec3& min, glm::vec3& max) const;
+	void storeBounds(const std::string& name, const glm::vec3& min, const glm::vec3& max);
+
+private:
+	AssetStreamer();
+
+	struct Job
+	{
+		std::string name;
+		std::function<bool()> load;
+		std::function<void()> upload;
+		std::function<void()> publish;
+		std::function<void()> discard;
+		bool loaded;
+		bool uploaded;
+		GLsync fence;
+		double loadMs;
+		double uploadMs;
+	};
+
+	enum ContextState { CONTEXT_PENDING, CONTEXT_SHARED, CONTEXT_NONE };
+
+	void workerLoop();
+	bool waitForContext();
+	void loadBoundsCache();
+	void saveBoundsCache();
+
+	static AssetStreamer* instance;
+	std::chrono::steady_clock::time_point bootTime;
+	std::thread worker;
+	std::mutex mutex;
+	std::condition_variable jobQueued;
+	std::condition_variable jobFinished;
+	std::condition_variable contextAttached;
+	GLFWwindow* loaderWindow;
+	ContextState contextState;
+	std::deque<Job> queued;
+	std::deque<Job> finished;
+	unsigned int pendingCount;
+	bool stopping;
+	bool residentLogged;
+	std::map<std::string, std::pair<glm::vec3, glm::vec3> > bounds;
+};
+AssetStreamer* AssetStreamer::instance = nullptr;
+
+AssetStreamer::AssetStreamer()
+{
+	bootTime = std::chrono::steady_clock::now();
+	pendingCount = 0;
+	stopping = false;
+	residentLogged = true;
+	loaderWindow = NULL;
+	contextState = CONTEXT_PENDING;
+}
+
+inline void AssetStreamer::start()
+{
+	loadBoundsCache();
+	worker = std::thread(&AssetStreamer::workerLoop, this);
+}
+
+inline void AssetStreamer::attachContext(GLFWwindow* window)
+{
+	// window creation is main-thread only; the worker makes it current on its side.
+	// The window hints used for the render window are still set, so versions match.
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	GLFWwindow* shared = glfwCreateWindow(1, 1, "loader", NULL, window);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+	if (!shared)
+		std::cout << "WARNING::STREAMER:: no shared context, uploading on the render thread" << std::endl;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		loaderWindow = shared;
+		contextState = shared ? CONTEXT_SHARED : CONTEXT_NONE;
+	}
+	contextAttached.notify_all();
+}
+
+inline void AssetStreamer::shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	jobQueued.notify_all();
+	contextAttached.notify_all();
+	if (worker.joinable())
+		worker.join();
+	if (loaderWindow) {
+		glfwDestroyWindow(loaderWindow);
+		loaderWindow = NULL;
+	}
+}
+
+void AssetStreamer::submit(const std::string& name, std::function<bool()> load, std::function<void()> upload,
+	std::function<void()> publish, std::function<void()> discard)
+{
+	Job job;
+	job.name = name;
+	job.load = load;
+	job.upload = upload;
+	job.publish = publish;
+	job.discard = discard;
+	job.loaded = false;
+	job.uploaded = false;
+	job.fence = 0;
+	job.loadMs = 0.0;
+	job.uploadMs = 0.0;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queued.push_back(job);
+		pendingCount++;
+		residentLogged = false;
+	}
+	jobQueued.notify_one();
+}
+
+void AssetStreamer::pump(double budgetMs)
+{
+	double startMs = elapsedMs();
+	std::deque<Job> jobs;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.swap(finished);
+	}
+
+	std::deque<Job> waiting;
+	unsigned int published = 0;
+	while (!jobs.empty()) {
+		Job job = jobs.front();
+		jobs.pop_front();
+
+		if (job.uploaded) {
+			// never block the frame on the loader: retry next frame instead
+			GLenum status = glClientWaitSync(job.fence, 0, 0);
+			if (status == GL_TIMEOUT_EXPIRED) {
+				waiting.push_back(job);
+				continue;
+			}
+			if (status == GL_WAIT_FAILED)
+				std::cout << "ERROR::STREAMER:: fence wait failed for " << job.name << std::endl;
+			glDeleteSync(job.fence);
+		}
+		else if (job.loaded) {
+			double uploadStart = elapsedMs();
+			job.upload();
+			job.uploadMs = elapsedMs() - uploadStart;
+		}
+
+		char event[256];
+		if (job.loaded) {
+			if (job.publish)
+				job.publish();
+			SNPRINTF(event, sizeof(event), "%s visible (load %.1f ms, upload %.1f ms%s)", job.name.c_str(),
+				job.loadMs, job.uploadMs, job.uploaded ? " on loader context" : "");
+		}
+		else {
+			if (job.discard)
+				job.discard();
+			SNPRINTF(event, sizeof(event), "%s FAILED to load, keeping proxy", job.name.c_str());
+		}
+		logEvent(event);
+		published++;
+
+		// always make progress, but leave the rest of the frame to rendering
+		if (elapsedMs() - startMs > budgetMs)
+			break;
+	}
+
+	// upload and publish steps bind buffers, textures and VAOs with raw GL calls
+	if (published > 0)
+		GLState::get().invalidate();
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		pendingCount -= published;
+		// keep submission order for whatever is left
+		waiting.insert(waiting.end(), jobs.begin(), jobs.end());
+		finished.insert(finished.begin(), waiting.begin(), waiting.end());
+	}
+
+	if (!residentLogged && isIdle()) {
+		residentLogged = true;
+		logEvent("all assets resident");
+		saveBoundsCache();
+	}
+}
+
+void AssetStreamer::flush()
+{
+	while (!isIdle()) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			jobFinished.wait(lock, [this] { return !finished.empty(); });
+		}
+		pump(1e9);
+		// fences still pending: give the GPU a moment instead of spinning
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
+
+bool AssetStreamer::isIdle()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return pendingCount == 0;
+}
+
+double AssetStreamer::elapsedMs() const
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - bootTime).count();
+}
+
+void AssetStreamer::logEvent(const std::string& what)
+{
+	printf("[boot] %9.1f ms  %s\n", elapsedMs(), what.c_str());
+}
+
+bool AssetStreamer::cachedBounds(const std::string& name, glm::vec3& min, glm::vec3& max) const
+{
+	auto it = bounds.find(name);
+	if (it == bounds.end())
+		return false;
+	min = it->second.first;
+	max = it->second.second;
+	return true;
+}
+
+void AssetStreamer::storeBounds(const std::string& name, const glm::vec3& min, const glm::vec3& max)
+{
+	bounds[name] = std::make_pair(min, max);
+}
+
+void AssetStreamer::workerLoop()
+{
+	while (true) {
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			jobQueued.wait(lock, [this] { return stopping || !queued.empty(); });
+			if (stopping)
+				break;
+			job = queued.front();
+			queued.pop_front();
+		}
+
+		double loadStart = elapsedMs();
+		job.loaded = job.load();
+		job.loadMs = elapsedMs() - loadStart;
+
+		if (job.loaded && waitForContext()) {
+			double uploadStart = elapsedMs();
+			job.upload();
+			// publish only once the GPU has consumed the uploads
+			job.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			glFlush();
+			job.uploaded = true;
+			job.uploadMs = elapsedMs() - uploadStart;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			finished.push_back(job);
+		}
+		jobFinished.notify_all();
+	}
+
+	bool shared;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		shared = contextState == CONTEXT_SHARED;
+	}
+	if (shared)
+		glfwMakeContextCurrent(NULL);
+}
+
+// worker thread: block until main() has decided about the loader context, and make it
+// current the first time. Returns false when uploads have to happen on the render thread.
+bool AssetStreamer::waitForContext()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	if (contextState == CONTEXT_PENDING) {
+		contextAttached.wait(lock, [this] { return stopping || contextState != CONTEXT_PENDING; });
+		if (contextState == CONTEXT_SHARED)
+			glfwMakeContextCurrent(loaderWindow);
+	}
+	return contextState == CONTEXT_SHARED;
+}
+
+// one line per model: name minX minY minZ maxX maxY maxZ
+void AssetStreamer::loadBoundsCache()
+{
+	std::ifstream file(BOOT_BOUNDS_CACHE);
+	std::string name;
+	glm::vec3 min, max;
+	while (file >> name >> min.x >> min.y >> min.z >> max.x >> max.y >> max.z) {
+		bounds[name] = std::make_pair(min, max);
+	}
+}
+
+void AssetStreamer::saveBoundsCache()
+{
+	std::ofstream file(BOOT_BOUNDS_CACHE);
+	for (auto& b : bounds) {
+		const glm::vec3& min = b.second.first;
+		const glm::vec3& max = b.second.second;
+		file << b.first << ' ' << min.x << ' ' << min.y << ' ' << min.z << ' '
+			<< max.x << ' ' << max.y << ' ' << max.z << '\n';
+	}
+}
+
+#endif // !ASSET_STREAMER__H
@@ -0,0 +1,467 @@
+#ifndef BVH__H
+#define BVH__H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <vector>
+
+#include "frustum.h"
+#include "ogldev_util.h"
+
+#define BVH_NULL_NODE -1
+// leaves are stored enlarged by this fraction of their size (plus BVH_FAT_MIN world
+// units), so small movements do not need a reinsert
+#define BVH_FAT_FRACTION 0.1f
+#define BVH_FAT_MIN 0.5f
+
+// Dynamic AABB tree over world space boxes, after Box2D's b2DynamicTree: leaves are
+// inserted next to the sibling that grows the tree's surface area the least, and
+// every ancestor is rebalanced with AVL-like rotations on the way up. Each leaf keeps
+// a fat box around the object's box; move() only reinserts once the object leaves it,
+// the usual per-frame refit is a box comparison.
+// T is what the queries hand back, typically an index or a pointer.
+template <typename T>
+class BVH
+{
+DISALLOW_COPY_AND_ASSIGN(BVH)
+public:
+	BVH();
+
+	// returns the proxy id used by move() and remove()
+	int insert(const glm::vec3& boxMin, const glm::vec3& boxMax, const T& data);
+	void remove(int proxy);
+	// new bounds for proxy; true when the leaf had to be reinserted
+	bool move(int proxy, const glm::vec3& boxMin, const glm::vec3& boxMax);
+	void clear();
+
+	const T& getData(int proxy) const { return nodes[proxy].data; }
+	unsigned int size() const { return leafCount; }
+	int getHeight() const { return root == BVH_NULL_NODE ? 0 : nodes[root].height; }
+
+	// leaves whose fat box is at least partly inside frustum
+	void queryFrustum(const Frustum& frustum, std::vector<T>& results) const;
+	// leaves whose fat box overlaps the sphere
+	void querySphere(const glm::vec3& center, float radius, std::vector<T>& results) const;
+	// closest leaf box along the ray within maxDistance; direction need not be normalised,
+	// distance is measured in multiples of it
+	bool raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, T& hit, float& distance) const;
+	// leaf whose box is closest to point (0 when point is inside it)
+	bool nearest(const glm::vec3& point, T& result, float& distance) const;
+
+private:
+	struct Node
+	{
+		glm::vec3 boxMin;
+		glm::vec3 boxMax;
+		// parent, or next free node while on the free list
+		int parent;
+		int child1;
+		int child2;
+		// leaves are 0, free nodes -1
+		int height;
+		T data;
+
+		bool isLeaf() const { return child1 == BVH_NULL_NODE; }
+	};
+
+	int allocateNode();
+	void freeNode(int node);
+	void insertLeaf(int leaf);
+	void removeLeaf(int leaf);
+	int balance(int node);
+	void refit(int node);
+
+	static float area(const glm::vec3& boxMin, const glm::vec3& boxMax);
+	static float unionArea(const Node& a, const Node& b);
+	static bool overlapsSphere(const Node& node, const glm::vec3& center, float radius2);
+	static float distance2(const Node& node, const glm::vec3& point);
+	static bool rayEntry(const Node& node, const glm::vec3& origin, const glm::vec3& inverse, float maxDistance, float& entry);
+
+	std::vector<Node> nodes;
+	int root;
+	int freeList;
+	unsigned int leafCount;
+	// traversal stack shared by the queries
+	mutable std::vector<int> stack;
+};
+
+template <typename T>
+BVH<T>::BVH()
+{
+	clear();
+}
+
+template <typename T>
+void BVH<T>::clear()
+{
+	nodes.clear();
+	root = BVH_NULL_NODE;
+	freeList = BVH_NULL_NODE;
+	leafCount = 0;
+}
+
+template <typename T>
+int BVH<T>::allocateNode()
+{
+	if (freeList == BVH_NULL_NODE) {
+		nodes.push_back(Node());
+		nodes.back().parent = freeList;
+		nodes.back().height = -1;
+		freeList = nodes.size() - 1;
+	}
+	int node = freeList;
+	freeList = nodes[node].parent;
+	nodes[node].parent = BVH_NULL_NODE;
+	nodes[node].child1 = BVH_NULL_NODE;
+	nodes[node].child2 = BVH_NULL_NODE;
+	nodes[node].height = 0;
+	return node;
+}
+
+template <typename T>
+void BVH<T>::freeNode(int node)
+{
+	nodes[node].parent = freeList;
+	nodes[node].height = -1;
+	freeList = node;
+}
+
+template <typename T>
+int BVH<T>::insert(const glm::vec3& boxMin, const glm::vec3& boxMax, const T& data)
+{
+	int proxy = allocateNode();
+	glm::vec3 margin = (boxMax - boxMin) * BVH_FAT_FRACTION + glm::vec3(BVH_FAT_MIN);
+	nodes[proxy].boxMin = boxMin - margin;
+	nodes[proxy].boxMax = boxMax + margin;
+	nodes[proxy].data = data;
+	insertLeaf(proxy);
+	leafCount++;
+	return proxy;
+}
+
+template <typename T>
+void BVH<T>::remove(int proxy)
+{
+	removeLeaf(proxy);
+	freeNode(proxy);
+	leafCount--;
+}
+
+template <typename T>
+bool BVH<T>::move(int proxy, const glm::vec3& boxMin, const glm::vec3& boxMax)
+{
+	Node& leaf = nodes[proxy];
+	if (glm::all(glm::greaterThanEqual(boxMin, leaf.boxMin)) && glm::all(glm::lessThanEqual(boxMax, leaf.boxMax)))
+		return false;
+	removeLeaf(proxy);
+	glm::vec3 margin = (boxMax - boxMin) * BVH_FAT_FRACTION + glm::vec3(BVH_FAT_MIN);
+	nodes[proxy].boxMin = boxMin - margin;
+	nodes[proxy].boxMax = boxMax + margin;
+	insertLeaf(proxy);
+	return true;
+}
+
+template <typename T>
+void BVH<T>::insertLeaf(int leaf)
+{
+	if (root == BVH_NULL_NODE) {
+		root = leaf;
+		nodes[root].parent = BVH_NULL_NODE;
+		return;
+	}
+
+	// descend towards the sibling with the lowest cost: the area of the new parent
+	// plus the growth it causes in every ancestor
+	int index = root;
+	while (!nodes[index].isLeaf()) {
+		const Node& node = nodes[index];
+		float nodeArea = area(node.boxMin, node.boxMax);
+		float combinedArea = unionArea(node, nodes[leaf]);
+		float cost = 2.0f * combinedArea;
+		float inheritance = 2.0f * (combinedArea - nodeArea);
+
+		float childCost[2];
+		int children[2] = { node.child1, node.child2 };
+		for (unsigned int i = 0; i < 2; i++) {
+			const Node& child = nodes[children[i]];
+			childCost[i] = unionArea(child, nodes[leaf]) + inheritance;
+			if (!child.isLeaf())
+				childCost[i] -= area(child.boxMin, child.boxMax);
+		}
+		if (cost < childCost[0] && cost < childCost[1])
+			break;
+		index = childCost[0] < childCost[1] ? children[0] : children[1];
+	}
+	int sibling = index;
+
+	int oldParent = nodes[sibling].parent;
+	int newParent = allocateNode();
+	nodes[newParent].parent = oldParent;
+	nodes[newParent].child1 = sibling;
+	nodes[newParent].child2 = leaf;
+	nodes[sibling].parent = newParent;
+	nodes[leaf].parent = newParent;
+	if (oldParent == BVH_NULL_NODE) {
+		root = newParent;
+	}
+	else if (nodes[oldParent].child1 == sibling) {
+		nodes[oldParent].child1 = newParent;
+	}
+	else {
+		nodes[oldParent].child2 = newParent;
+	}
+
+	for (index = newParent; index != BVH_NULL_NODE; index = nodes[index].parent) {
+		index = balance(index);
+		refit(index);
+	}
+}
+
+template <typename T>
+void BVH<T>::removeLeaf(int leaf)
+{
+	if (leaf == root) {
+		root = BVH_NULL_NODE;
+		return;
+	}
+	int parent = nodes[leaf].parent;
+	int grandParent = nodes[parent].parent;
+	int sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+
+	if (grandParent == BVH_NULL_NODE) {
+		root = sibling;
+		nodes[sibling].parent = BVH_NULL_NODE;
+		freeNode(parent);
+		return;
+	}
+	if (nodes[grandParent].child1 == parent)
+		nodes[grandParent].child1 = sibling;
+	else
+		nodes[grandParent].child2 = sibling;
+	nodes[sibling].parent = grandParent;
+	freeNode(parent);
+
+	for (int index = grandParent; index != BVH_NULL_NODE; index = nodes[index].parent) {
+		index = balance(index);
+		refit(index);
+	}
+}
+
+// rotate the taller grandchild up when the two subtrees of a differ in height by more
+// than one; returns the node now at a's place
+template <typename T>
+int BVH<T>::balance(int a)
+{
+	Node& A = nodes[a];
+	if (A.isLeaf() || A.height < 2)
+		return a;
+
+	int b = A.child1;
+	int c = A.child2;
+	int heightDifference = nodes[c].height - nodes[b].height;
+	if (heightDifference > 1) {
+		std::swap(b, c);
+	}
+	else if (heightDifference >= -1) {
+		return a;
+	}
+
+	// b is the taller child; promote it
+	Node& B = nodes[b];
+	int f = B.child1;
+	int g = B.child2;
+	B.child1 = a;
+	B.parent = A.parent;
+	A.parent = b;
+	if (B.parent == BVH_NULL_NODE) {
+		root = b;
+	}
+	else if (nodes[B.parent].child1 == a) {
+		nodes[B.parent].child1 = b;
+	}
+	else {
+		nodes[B.parent].child2 = b;
+	}
+
+	// the taller grandchild stays under b, the other one takes b's place under a
+	if (nodes[f].height < nodes[g].height)
+		std::swap(f, g);
+	B.child2 = f;
+	if (A.child1 == b)
+		A.child1 = g;
+	else
+		A.child2 = g;
+	nodes[g].parent = a;
+
+	refit(a);
+	refit(b);
+	return b;
+}
+
+template <typename T>
+void BVH<T>::refit(int index)
+{
+	Node& node = nodes[index];
+	const Node& child1 = nodes[node.child1];
+	const Node& child2 = nodes[node.child2];
+	node.boxMin = glm::min(child1.boxMin, child2.boxMin);
+	node.boxMax = glm::max(child1.boxMax, child2.boxMax);
+	node.height = 1 + std::max(child1.height, child2.height);
+}
+
+template <typename T>
+void BVH<T>::queryFrustum(const Frustum& frustum, std::vector<T>& results) const
+{
+	if (root == BVH_NULL_NODE)
+		return;
+	stack.clear();
+	stack.push_back(root);
+	while (!stack.empty()) {
+		const Node& node = nodes[stack.back()];
+		stack.pop_back();
+		if (!frustum.testAABB(node.boxMin, node.boxMax))
+			continue;
+		if (node.isLeaf()) {
+			results.push_back(node.data);
+		}
+		else {
+			stack.push_back(node.child1);
+			stack.push_back(node.child2);
+		}
+	}
+}
+
+template <typename T>
+void BVH<T>::querySphere(const glm::vec3& center, float radius, std::vector<T>& results) const
+{
+	if (root == BVH_NULL_NODE)
+		return;
+	float radius2 = radius * radius;
+	stack.clear();
+	stack.push_back(root);
+	while (!stack.empty()) {
+		const Node& node = nodes[stack.back()];
+		stack.pop_back();
+		if (!overlapsSphere(node, center, radius2))
+			continue;
+		if (node.isLeaf()) {
+			results.push_back(node.data);
+		}
+		else {
+			stack.push_back(node.child1);
+			stack.push_back(node.child2);
+		}
+	}
+}
+
+template <typename T>
+bool BVH<T>::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, T& hit, float& distance) const
+{
+	if (root == BVH_NULL_NODE)
+		return false;
+	glm::vec3 inverse;
+	for (unsigned int axis = 0; axis < 3; axis++) {
+		inverse[axis] = direction[axis] != 0.0f ? 1.0f / direction[axis] : FLT_MAX;
+	}
+	bool found = false;
+	float best = maxDistance;
+	stack.clear();
+	stack.push_back(root);
+	while (!stack.empty()) {
+		const Node& node = nodes[stack.back()];
+		stack.pop_back();
+		float entry;
+		// anything entered beyond the closest hit so far cannot win
+		if (!rayEntry(node, origin, inverse, best, entry))
+			continue;
+		if (node.isLeaf()) {
+			best = entry;
+			hit = node.data;
+			found = true;
+		}
+		else {
+			stack.push_back(node.child1);
+			stack.push_back(node.child2);
+		}
+	}
+	distance = best;
+	return found;
+}
+
+template <typename T>
+bool BVH<T>::nearest(const glm::vec3& point, T& result, float& distance) const
+{
+	if (root == BVH_NULL_NODE)
+		return false;
+	float best = FLT_MAX;
+	stack.clear();
+	stack.push_back(root);
+	while (!stack.empty()) {
+		const Node& node = nodes[stack.back()];
+		stack.pop_back();
+		float d2 = distance2(node, point);
+		if (d2 >= best)
+			continue;
+		if (node.isLeaf()) {
+			best = d2;
+			result = node.data;
+		}
+		else {
+			// visit the closer child first so the bound tightens early
+			int first = node.child1;
+			int second = node.child2;
+			if (distance2(nodes[first], point) < distance2(nodes[second], point))
+				std::swap(first, second);
+			stack.push_back(first);
+			stack.push_back(second);
+		}
+	}
+	distance = sqrtf(best);
+	return true;
+}
+
+template <typename T>
+float BVH<T>::area(const glm::vec3& boxMin, const glm::vec3& boxMax)
+{
+	glm::vec3 size = boxMax - boxMin;
+	return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+template <typename T>
+float BVH<T>::unionArea(const Node& a, const Node& b)
+{
+	return area(glm::min(a.boxMin, b.boxMin), glm::max(a.boxMax, b.boxMax));
+}
+
+template <typename T>
+bool BVH<T>::overlapsSphere(const Node& node, const glm::vec3& center, float radius2)
+{
+	return distance2(node, center) <= radius2;
+}
+
+template <typename T>
+float BVH<T>::distance2(const Node& node, const glm::vec3& point)
+{
+	glm::vec3 offset = point - glm::clamp(point, node.boxMin, node.boxMax);
+	return glm::dot(offset, offset);
+}
+
+// slab test; entry is 0 when the ray starts inside the box
+template <typename T>
+bool BVH<T>::rayEntry(const Node& node, const glm::vec3& origin, const glm::vec3& inverse, float maxDistance, float& entry)
+{
+	glm::vec3 t1 = (node.boxMin - origin) * inverse;
+	glm::vec3 t2 = (node.boxMax - origin) * inverse;
+	glm::vec3 tNear = glm::min(t1, t2);
+	glm::vec3 tFar = glm::max(t1, t2);
+	float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+	float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxDistance));
+	if (enter > exit)
+		return false;
+	entry = enter;
+	return true;
+}
+
+#endif // !BVH__H
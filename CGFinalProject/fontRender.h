@@ -11,7 +11,10 @@
 #include <utility>
 
 #include <learnopengl/shader_m.h>
+#include <learnopengl/gl_state.h>
+#include <learnopengl/stream_buffer.h>
 #include "ogldev_util.h"
+#include "assetStreamer.h"
 
 #include FT_FREETYPE_H
 
@@ -27,62 +30,29 @@ public:
 		GLuint     Advance;    // ԭһԭľ
 	};
 	void RenderCharacter(const char c, const GLfloat x, const GLfloat y, const GLfloat scale, const glm::vec3 color) {
-		shader.use();
-		glm::mat4 projection = glm::ortho(0.0f, static_cast<float>(SCR_WIDTH), 0.0f, static_cast<float>(SCR_HEIGHT)); //ҪΪȫֱ
-		shader.setMat4("projection", projection);
-		shader.setVec3("textColor", color);
-		glActiveTexture(GL_TEXTURE0);
-		glBindVertexArray(VAO);
-
-		Character ch = Characters[c];
-
-		GLfloat xpos = x + ch.Bearing.x * scale;
-		GLfloat ypos = y - (ch.Size.y - ch.Bearing.y) * scale;
-
-		GLfloat w = ch.Size.x * scale;
-		GLfloat h = ch.Size.y * scale;
-		// ÿַVBO
-		GLfloat vertices[6][4] = {
-			{ xpos,     ypos + h,   0.0, 0.0 },
-			{ xpos,     ypos,       0.0, 1.0 },
-			{ xpos + w, ypos,       1.0, 1.0 },
-
-			{ xpos,     ypos + h,   0.0, 0.0 },
-			{ xpos + w, ypos,       1.0, 1.0 },
-			{ xpos + w, ypos + h,   1.0, 0.0 }
-		};
-		glBindTexture(GL_TEXTURE_2D, ch.TextureID);
-		// VBOڴ
-		glBindBuffer(GL_ARRAY_BUFFER, VBO);
-		glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-		// ı
-		glDrawArrays(GL_TRIANGLES, 0, 6);
-		glBindVertexArray(0);
-		glBindTexture(GL_TEXTURE_2D, 0);
+		RenderText(std::string(1, c), x, y, scale, color);
 	}
 	void RenderText(std::string text, GLfloat x, GLfloat y, GLfloat scale, glm::vec3 color) {
-		// ӦȾ״̬
-		shader.use();
-		glm::mat4 projection = glm::ortho(0.0f, static_cast<float>(SCR_WIDTH), 0.0f, static_cast<float>(SCR_HEIGHT)); //ҪΪȫֱ
-		shader.setMat4("projection", projection);
-		shader.setVec3("textColor", color);
-		glActiveTexture(GL_TEXTURE0);
-		glBindVertexArray(VAO);
-
-		// ıеַ
+		if (!glyphsReady || text.empty())
+			return;
+		// ııһдʽ
+		StreamBuffer& stream = StreamBuffers::get().vertex;
+		GLintptr offset;
+		GLfloat (*vertices)[4] = (GLfloat (*)[4])stream.map(text.size() * 6 * 4 * sizeof(GLfloat), offset);
+		if (!vertices)
+			return;
 		std::string::const_iterator c;
 		for (c = text.begin(); c != text.end(); c++)
 		{
-			Character ch = Characters[*c];
+			const Character& ch = Characters[*c];
 
 			GLfloat xpos = x + ch.Bearing.x * scale;
 			GLfloat ypos = y - (ch.Size.y - ch.Bearing.y) * scale;
 
 			GLfloat w = ch.Size.x * scale;
 			GLfloat h = ch.Size.y * scale;
-			// ÿַVBO
-			GLfloat vertices[6][4] = {
+			// ÿַ6
+			GLfloat quad[6][4] = {
 				{ xpos,     ypos + h,   0.0, 0.0 },
 				{ xpos,     ypos,       0.0, 1.0 },
 				{ xpos + w, ypos,       1.0, 1.0 },
@@ -91,26 +61,37 @@ public:
 				{ xpos + w, ypos,       1.0, 1.0 },
 				{ xpos + w, ypos + h,   1.0, 0.0 }
 			};
-			// ıϻ
-			glBindTexture(GL_TEXTURE_2D, ch.TextureID);
-			// VBOڴ
-			glBindBuffer(GL_ARRAY_BUFFER, VBO);
-			glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
-			glBindBuffer(GL_ARRAY_BUFFER, 0);
-			// ı
-			glDrawArrays(GL_TRIANGLES, 0, 6);
+			memcpy(vertices, quad, sizeof(quad));
+			vertices += 6;
 			// λõһεԭ㣬עⵥλ1/64
 			x += (ch.Advance >> 6) * scale; // λƫ6λȡλΪصֵ (2^6 = 64)
 		}
-		glBindVertexArray(0);
-		glBindTexture(GL_TEXTURE_2D, 0);
+		stream.unmap();
+
+		// ӦȾ״̬
+		shader.use();
+		shader.setVec3("textColor", color);
+		GLState::get().bindVertexArray(VAO);
+		// Դ0ʼָʽ壬firstı
+		GLint first = (GLint)(offset / (4 * sizeof(GLfloat)));
+		for (c = text.begin(); c != text.end(); c++, first += 6)
+		{
+			// ıϻ
+			GLState::get().bindTexture(0, GL_TEXTURE_2D, Characters[*c].TextureID);
+			glDrawArrays(GL_TRIANGLES, first, 6);
+		}
 	}
 
 	FontRender() 
 		:shader("fontRender.vs", "fontRender.fs")
 	{
-		initFreeTypeAndLoad();
+		glyphsReady = false;
 		initBuffer();
+		// ιդϴ̨̣߳ϴɺȾ߳
+		AssetStreamer::getInstance()->submit("glyphs",
+			[this]() { return rasterizeGlyphs(); },
+			[this]() { uploadGlyphs(); },
+			[this]() { glyphsReady = true; });
 	}
 	~FontRender() {
 		delete instance;
@@ -126,24 +107,28 @@ public:
 private:
 	void initBuffer() {
 		glGenVertexArrays(1, &VAO);
-		glGenBuffers(1, &VBO);
-		glBindVertexArray(VAO);
-		glBindBuffer(GL_ARRAY_BUFFER, VBO);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * 6 * 4, NULL, GL_DYNAMIC_DRAW);
+		GLState::get().bindVertexArray(VAO);
+		// ζÿ֡д빲ʽ
+		glBindBuffer(GL_ARRAY_BUFFER, StreamBuffers::get().vertex.getBuffer());
 		glEnableVertexAttribArray(0);
 		glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), 0);
 		glBindBuffer(GL_ARRAY_BUFFER, 0);
-		glBindVertexArray(0);
+		GLState::get().bindVertexArray(0);
 	}
-	void initFreeTypeAndLoad() {
+	// ں̨߳УֻFreeTypeGL
+	bool rasterizeGlyphs() {
 		FT_Library ft;
-		if (FT_Init_FreeType(&ft))
+		if (FT_Init_FreeType(&ft)) {
 			std::cout << "ERROR::FREETYPE: Could not init FreeType Library" << std::endl;
+			return false;
+		}
 
 		FT_Face face;
-		if (FT_New_Face(ft, "resources/fonts/arial.ttf", 0, &face))
+		if (FT_New_Face(ft, "resources/fonts/arial.ttf", 0, &face)) {
 			std::cout << "ERROR::FREETYPE: Failed to load font" << std::endl;
-		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+			FT_Done_FreeType(ft);
+			return false;
+		}
 		FT_Set_Pixel_Sizes(face, 0, 48);
 		for (GLubyte c = 0; c < 128; c++)
 		{
@@ -153,6 +138,24 @@ private:
 				std::cout << "ERROR::FREETYTPE: Failed to load Glyph" << std::endl;
 				continue;
 			}
+			// λͼȴϴ
+			GlyphBitmap glyph;
+			glyph.c = c;
+			glyph.size = glm::ivec2(face->glyph->bitmap.width, face->glyph->bitmap.rows);
+			glyph.bearing = glm::ivec2(face->glyph->bitmap_left, face->glyph->bitmap_top);
+			glyph.advance = (GLuint)face->glyph->advance.x;
+			glyph.pixels.assign(face->glyph->bitmap.buffer, face->glyph->bitmap.buffer + glyph.size.x * glyph.size.y);
+			pendingGlyphs.push_back(glyph);
+		}
+		FT_Done_Face(face);
+		FT_Done_FreeType(ft);
+		return true;
+	}
+
+	void uploadGlyphs() {
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		for (auto& glyph : pendingGlyphs)
+		{
 			// 
 			GLuint texture;
 			glGenTextures(1, &texture);
@@ -161,12 +164,12 @@ private:
 				GL_TEXTURE_2D,
 				0,
 				GL_RED,
-				face->glyph->bitmap.width,
-				face->glyph->bitmap.rows,
+				glyph.size.x,
+				glyph.size.y,
 				0,
 				GL_RED,
 				GL_UNSIGNED_BYTE,
-				face->glyph->bitmap.buffer
+				glyph.pixels.empty() ? NULL : &glyph.pixels[0]
 			);
 			// ѡ
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -176,20 +179,30 @@ private:
 			// ַ֮ʹ
 			Character character = {
 				texture,
-				glm::ivec2(face->glyph->bitmap.width, face->glyph->bitmap.rows),
-				glm::ivec2(face->glyph->bitmap_left, face->glyph->bitmap_top),
-				face->glyph->advance.x
+				glyph.size,
+				glyph.bearing,
+				glyph.advance
 			};
-			Characters.insert(std::pair<GLchar, Character>(c, character));
+			Characters.insert(std::pair<GLchar, Character>(glyph.c, character));
 		}
-		FT_Done_Face(face);
-		FT_Done_FreeType(ft);
+		pendingGlyphs.clear();
 	}
 
+	// դδϴ
+	struct GlyphBitmap
+	{
+		GLubyte c;
+		glm::ivec2 size;
+		glm::ivec2 bearing;
+		GLuint advance;
+		std::vector<unsigned char> pixels;
+	};
+
 	static FontRender* instance;
+	std::vector<GlyphBitmap> pendingGlyphs;
+	bool glyphsReady;
 	std::map<char, Character> Characters;
 	unsigned int VAO;
-	unsigned int VBO;
 	Shader shader;
 };
 FontRender* FontRender::instance = nullptr;
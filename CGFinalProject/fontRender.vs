@@ -2,10 +2,15 @@
 layout (location = 0) in vec4 vertex; // <vec2 pos, vec2 tex>
 out vec2 TexCoords;
 
-uniform mat4 projection;
+layout (std140) uniform FrameData {
+    float time;
+    float deltaTime;
+    vec2 resolution;
+};
 
 void main()
 {
-    gl_Position = projection * vec4(vertex.xy, 0.0, 1.0);
+    // screen pixels to NDC, same as ortho(0, width, 0, height)
+    gl_Position = vec4(vertex.xy / resolution * 2.0 - 1.0, 0.0, 1.0);
     TexCoords = vertex.zw;
 }
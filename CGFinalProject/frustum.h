@@ -0,0 +1,137 @@
+#ifndef FRUSTUM__H
+#define FRUSTUM__H
+
+#include <glm/glm.hpp>
+
+#include <math.h>
+
+// SSE is baseline on x64 and on x86 builds with /arch:SSE or above (the default since
+// VS2012); anything else takes the scalar path
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1) || defined(__SSE__)
+#define FRUSTUM_SSE
+#include <xmmintrin.h>
+#endif
+
+// Six planes of a view-projection matrix (Gribb/Hartmann), normalised and stored as
+// structure of arrays so that SSE can test four spheres against a plane, or one box
+// against four planes, per instruction. Works for the camera's perspective as well
+// as the light's orthographic matrix.
+class Frustum
+{
+public:
+	enum { PLANES = 6, PADDED_PLANES = 8 };
+
+	Frustum() {}
+	explicit Frustum(const glm::mat4& viewProjection) { set(viewProjection); }
+
+	void set(const glm::mat4& viewProjection);
+	// visible[i] = 0 for every sphere completely outside, 1 otherwise; returns how many were culled
+	unsigned int cullSpheres(const float* x, const float* y, const float* z, const float* radius,
+		unsigned int count, unsigned char* visible) const;
+	// false when the box is completely outside one of the planes
+	bool testAABB(const glm::vec3& boxMin, const glm::vec3& boxMax) const;
+
+private:
+	// planes 6 and 7 repeat 0 and 1 so the box test can always load four
+	float nx[PADDED_PLANES];
+	float ny[PADDED_PLANES];
+	float nz[PADDED_PLANES];
+	float d[PADDED_PLANES];
+};
+
+void Frustum::set(const glm::mat4& m)
+{
+	// glm is column-major, m[col][row]
+	for (unsigned int i = 0; i < PLANES; i++) {
+		unsigned int row = i / 2;
+		float sign = (i % 2 == 0) ? 1.0f : -1.0f;
+		float a = m[0][3] + sign * m[0][row];
+		float b = m[1][3] + sign * m[1][row];
+		float c = m[2][3] + sign * m[2][row];
+		float e = m[3][3] + sign * m[3][row];
+		float length = sqrtf(a * a + b * b + c * c);
+		nx[i] = a / length;
+		ny[i] = b / length;
+		nz[i] = c / length;
+		d[i] = e / length;
+	}
+	for (unsigned int i = PLANES; i < PADDED_PLANES; i++) {
+		nx[i] = nx[i - PLANES];
+		ny[i] = ny[i - PLANES];
+		nz[i] = nz[i - PLANES];
+		d[i] = d[i - PLANES];
+	}
+}
+
+unsigned int Frustum::cullSpheres(const float* x, const float* y, const float* z, const float* radius,
+	unsigned int count, unsigned char* visible) const
+{
+	unsigned int culled = 0;
+	unsigned int i = 0;
+#ifdef FRUSTUM_SSE
+	for (; i + 4 <= count; i += 4) {
+		__m128 cx = _mm_loadu_ps(x + i);
+		__m128 cy = _mm_loadu_ps(y + i);
+		__m128 cz = _mm_loadu_ps(z + i);
+		__m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(radius + i));
+		__m128 outside = _mm_setzero_ps();
+		for (unsigned int p = 0; p < PLANES; p++) {
+			__m128 dist = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(_mm_set1_ps(nx[p]), cx), _mm_mul_ps(_mm_set1_ps(ny[p]), cy)),
+				_mm_add_ps(_mm_mul_ps(_mm_set1_ps(nz[p]), cz), _mm_set1_ps(d[p])));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(dist, negRadius));
+		}
+		int mask = _mm_movemask_ps(outside);
+		for (unsigned int k = 0; k < 4; k++) {
+			visible[i + k] = (mask >> k) & 1 ? 0 : 1;
+			culled += (mask >> k) & 1;
+		}
+	}
+#endif
+	for (; i < count; i++) {
+		visible[i] = 1;
+		for (unsigned int p = 0; p < PLANES; p++) {
+			if (nx[p] * x[i] + ny[p] * y[i] + nz[p] * z[i] + d[p] < -radius[i]) {
+				visible[i] = 0;
+				culled++;
+				break;
+			}
+		}
+	}
+	return culled;
+}
+
+bool Frustum::testAABB(const glm::vec3& boxMin, const glm::vec3& boxMax) const
+{
+#ifdef FRUSTUM_SSE
+	__m128 zero = _mm_setzero_ps();
+	for (unsigned int p = 0; p < PADDED_PLANES; p += 4) {
+		__m128 px = _mm_loadu_ps(nx + p);
+		__m128 py = _mm_loadu_ps(ny + p);
+		__m128 pz = _mm_loadu_ps(nz + p);
+		// corner furthest along each plane normal
+		__m128 gx = _mm_cmpgt_ps(px, zero);
+		__m128 gy = _mm_cmpgt_ps(py, zero);
+		__m128 gz = _mm_cmpgt_ps(pz, zero);
+		__m128 vx = _mm_or_ps(_mm_and_ps(gx, _mm_set1_ps(boxMax.x)), _mm_andnot_ps(gx, _mm_set1_ps(boxMin.x)));
+		__m128 vy = _mm_or_ps(_mm_and_ps(gy, _mm_set1_ps(boxMax.y)), _mm_andnot_ps(gy, _mm_set1_ps(boxMin.y)));
+		__m128 vz = _mm_or_ps(_mm_and_ps(gz, _mm_set1_ps(boxMax.z)), _mm_andnot_ps(gz, _mm_set1_ps(boxMin.z)));
+		__m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, vx), _mm_mul_ps(py, vy)),
+			_mm_add_ps(_mm_mul_ps(pz, vz), _mm_loadu_ps(d + p)));
+		if (_mm_movemask_ps(_mm_cmplt_ps(dist, zero)))
+			return false;
+	}
+	return true;
+#else
+	for (unsigned int p = 0; p < PLANES; p++) {
+		float vx = nx[p] > 0.0f ? boxMax.x : boxMin.x;
+		float vy = ny[p] > 0.0f ? boxMax.y : boxMin.y;
+		float vz = nz[p] > 0.0f ? boxMax.z : boxMin.z;
+		if (nx[p] * vx + ny[p] * vy + nz[p] * vz + d[p] < 0.0f)
+			return false;
+	}
+	return true;
+#endif
+}
+
+#endif // !FRUSTUM__H
@@ -0,0 +1,173 @@
+#ifndef GEOMETRY_ARENA__H
+#define GEOMETRY_ARENA__H
+
+#include <glad/glad.h>
+
+#include <iostream>
+#include <map>
+#include <mutex>
+
+#include "ogldev_util.h"
+
+// capacity of the shared buffers; meshes that do not fit keep their own buffers
+#define ARENA_VERTEX_CAPACITY (1024 * 1024)
+#define ARENA_INDEX_CAPACITY (4 * 1024 * 1024)
+
+// One vertex buffer and one index buffer shared by every mesh of the same vertex format.
+// Meshes take a range of vertices and a range of indices out of each; a free list of
+// (offset, size) blocks, merged with its neighbours on release, keeps the space reusable.
+// All arena meshes then share one VAO and are drawn with glDrawElementsBaseVertex, so
+// consecutive draws need no vertex array switch and can be merged into
+// glMultiDrawElementsBaseVertex calls (see RenderQueue::execute).
+// create() runs on the render thread before the asset streamer uploads anything;
+// allocation and the uploads themselves may then happen on the loader thread.
+class GeometryArena
+{
+DISALLOW_COPY_AND_ASSIGN(GeometryArena)
+public:
+	struct Stats
+	{
+		unsigned int meshes;
+		unsigned int fallbacks;    // meshes that did not fit
+		unsigned int vertices;     // in use
+		unsigned int indices;
+	};
+
+	static GeometryArena* getInstance() {
+		static GeometryArena arena;
+		return &arena;
+	}
+
+	void create(unsigned int vertexStride);
+	// ranges for one mesh; false when either buffer is out of space
+	bool allocate(unsigned int vertexCount, unsigned int indexCount, unsigned int& baseVertex, unsigned int& firstIndex);
+	void release(unsigned int baseVertex, unsigned int vertexCount, unsigned int firstIndex, unsigned int indexCount);
+
+	GLuint getVertexBuffer() const { return vertexBuffer; }
+	GLuint getIndexBuffer() const { return indexBuffer; }
+	unsigned int getVertexStride() const { return vertexStride; }
+	// the shared VAO is made by the first mesh that needs it, on the render thread
+	GLuint getVertexArray() const { return vertexArray; }
+	void setVertexArray(GLuint vao) { vertexArray = vao; }
+
+	Stats getStats();
+
+private:
+	// first fit over free blocks keyed by offset
+	class FreeList
+	{
+	public:
+		void reset(unsigned int capacity) {
+			blocks.clear();
+			blocks[0] = capacity;
+		}
+		bool take(unsigned int count, unsigned int& offset) {
+			for (auto it = blocks.begin(); it != blocks.end(); ++it) {
+				if (it->second < count)
+					continue;
+				offset = it->first;
+				unsigned int left = it->second - count;
+				blocks.erase(it);
+				if (left > 0)
+					blocks[offset + count] = left;
+				return true;
+			}
+			return false;
+		}
+		void give(unsigned int offset, unsigned int count) {
+			std::map<unsigned int, unsigned int>::iterator next = blocks.lower_bound(offset);
+			if (next != blocks.end() && offset + count == next->first) {
+				count += next->second;
+				next = blocks.erase(next);
+			}
+			if (next != blocks.begin()) {
+				std::map<unsigned int, unsigned int>::iterator previous = next;
+				--previous;
+				if (previous->first + previous->second == offset) {
+					previous->second += count;
+					return;
+				}
+			}
+			blocks[offset] = count;
+		}
+	private:
+		std::map<unsigned int, unsigned int> blocks;
+	};
+
+	GeometryArena();
+
+	std::mutex lock;
+	GLuint vertexBuffer;
+	GLuint indexBuffer;
+	GLuint vertexArray;
+	unsigned int vertexStride;
+	FreeList freeVertices;
+	FreeList freeIndices;
+	Stats stats;
+};
+
+GeometryArena::GeometryArena()
+{
+	vertexBuffer = 0;
+	indexBuffer = 0;
+	vertexArray = 0;
+	vertexStride = 0;
+	stats.meshes = 0;
+	stats.fallbacks = 0;
+	stats.vertices = 0;
+	stats.indices = 0;
+}
+
+void GeometryArena::create(unsigned int stride)
+{
+	vertexStride = stride;
+	glGenBuffers(1, &vertexBuffer);
+	glGenBuffers(1, &indexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)ARENA_VERTEX_CAPACITY * stride, NULL, GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	// no VAO is bound here, so size the index buffer through the copy target
+	glBindBuffer(GL_COPY_WRITE_BUFFER, indexBuffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)ARENA_INDEX_CAPACITY * sizeof(unsigned int), NULL, GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	freeVertices.reset(ARENA_VERTEX_CAPACITY);
+	freeIndices.reset(ARENA_INDEX_CAPACITY);
+	// the loader context writes into these; make sure their storage exists first
+	glFlush();
+}
+
+bool GeometryArena::allocate(unsigned int vertexCount, unsigned int indexCount, unsigned int& baseVertex, unsigned int& firstIndex)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	if (vertexBuffer == 0 || !freeVertices.take(vertexCount, baseVertex)) {
+		stats.fallbacks++;
+		return false;
+	}
+	if (!freeIndices.take(indexCount, firstIndex)) {
+		freeVertices.give(baseVertex, vertexCount);
+		stats.fallbacks++;
+		return false;
+	}
+	stats.meshes++;
+	stats.vertices += vertexCount;
+	stats.indices += indexCount;
+	return true;
+}
+
+void GeometryArena::release(unsigned int baseVertex, unsigned int vertexCount, unsigned int firstIndex, unsigned int indexCount)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	freeVertices.give(baseVertex, vertexCount);
+	freeIndices.give(firstIndex, indexCount);
+	stats.meshes--;
+	stats.vertices -= vertexCount;
+	stats.indices -= indexCount;
+}
+
+GeometryArena::Stats GeometryArena::getStats()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return stats;
+}
+
+#endif // !GEOMETRY_ARENA__H
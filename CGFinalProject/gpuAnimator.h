@@ -0,0 +1,349 @@
+#ifndef GPU_ANIMATOR__H
+#define GPU_ANIMATOR__H
+
+#include <glad/glad.h>
+
+#include <learnopengl/shader.h>
+#include <learnopengl/gl_state.h>
+#include <learnopengl/stream_buffer.h>
+
+#include <cmath>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "AnimatedModel.h"
+
+// texture units of the animation tables, after the VAT textures
+#define GPU_ANIM_NODE_UNIT 4
+#define GPU_ANIM_KEY_UNIT 5
+#define GPU_ANIM_TIME_UNIT 6
+#define GPU_ANIM_GLOBAL_UNIT 7
+
+// Bone palettes of many copies of one AnimatedModel, evaluated on the GPU. The node
+// hierarchy is flattened breadth first, so each level is one contiguous run whose
+// parents all come before it, and the first clip's keys, decompressed, go into a buffer
+// texture:
+//   node table   5 texels per node: (parent, channel, 0, 0), rows of the bind transform
+//                then 5 per bone:   (node, 0, 0, 0), rows of the bone offset
+//   keyframes    2 header texels per channel: (position first, count, rotation first,
+//                count), (scaling first, count, 0, 0); then the keys, one texel
+//                (x, y, z, tick) per position or scaling key, two per rotation key:
+//                (x, y, z, w), (tick, 0, 0, 0)
+// evaluate() streams one clip time per copy and runs animEvaluate.vs once per level as
+// points with transform feedback, one vertex per (node, copy): it samples the node's
+// channel like AnimationClip::sample, with nlerp or slerp as the clip asks at the time,
+// and multiplies by the parent's global transform from the previous levels. A last
+// pass, animPalette.vs, turns the globals of the bone nodes into palettes, written
+// straight into the texel StreamBuffer where the skinning shaders read them. The CPU
+// only writes one float per copy.
+// The palettes live in this frame's texel region, reserved whole before the passes write
+// into it; when they do not fit, evaluate() fails and the caller poses on the CPU.
+// Render context only.
+class GpuAnimator
+{
+DISALLOW_COPY_AND_ASSIGN(GpuAnimator)
+public:
+	// model must be loaded and animated
+	GpuAnimator(AnimatedModel& model);
+	~GpuAnimator();
+
+	// palettes of count copies at times (seconds); bases receives the first palette texel
+	// of each, for RenderQueue::addStreamedPalette(). false when they did not fit the stream.
+	bool evaluate(const float* times, unsigned int count, vector<GLint>& bases);
+
+	unsigned int getBoneCount() const { return boneCount; }
+	unsigned int getNodeCount() const { return nodeCount; }
+	unsigned int getLevelCount() const { return levelFirst.size(); }
+
+private:
+	struct Level
+	{
+		unsigned int first;
+		unsigned int count;
+	};
+
+	void build(AnimatedModel& model);
+	// buffer texture over buffer on unit
+	static GLuint createBufferTexture(GLuint buffer, unsigned int unit);
+	static void appendRows(vector<float>& texels, const Matrix4f& matrix);
+	// make globals and scratch hold batch copies
+	void reserve(unsigned int batch);
+	// TF pass over count points into buffer range
+	void capture(GLuint buffer, GLintptr offset, unsigned int count);
+
+	// animEvaluate.vs and animPalette.vs, shared by all animators
+	static Shader& evaluateProgram();
+	static Shader& paletteProgram();
+	static Shader* linkCapture(const char* vertexPath);
+
+	unsigned int nodeCount;
+	unsigned int boneCount;
+	vector<unsigned int> levelFirst;
+	vector<unsigned int> levelCount;
+	unsigned int widestLevel;
+	Matrix4f globalInverse;
+	float ticksPerSecond;
+	float durationTicks;
+	// read at evaluate() time, so setSlerp() reaches this path too
+	const AnimationClip* clip;
+	// copies one batch can evaluate within GL_MAX_TEXTURE_BUFFER_SIZE
+	unsigned int batchLimit;
+	unsigned int reserved;
+
+	GLuint nodeBuffer, nodeTexture;
+	GLuint keyBuffer, keyTexture;
+	GLuint globalBuffer, globalTexture;
+	GLuint scratchBuffer;
+	GLuint timeTexture;
+	GLuint emptyArray;
+	vector<float> ticks;
+};
+
+GpuAnimator::GpuAnimator(AnimatedModel& model)
+{
+	nodeBuffer = nodeTexture = 0;
+	keyBuffer = keyTexture = 0;
+	globalBuffer = globalTexture = 0;
+	scratchBuffer = 0;
+	reserved = 0;
+	widestLevel = 0;
+	build(model);
+
+	GLint maxTexels = 65536;
+	glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+	batchLimit = std::max(1u, (unsigned int)maxTexels / (nodeCount * 4));
+
+	glGenBuffers(1, &globalBuffer);
+	glGenBuffers(1, &scratchBuffer);
+	globalTexture = createBufferTexture(globalBuffer, GPU_ANIM_GLOBAL_UNIT);
+	timeTexture = createBufferTexture(StreamBuffers::get().texel.getBuffer(), GPU_ANIM_TIME_UNIT);
+	glGenVertexArrays(1, &emptyArray);
+}
+
+GpuAnimator::~GpuAnimator()
+{
+	GLuint textures[4] = { nodeTexture, keyTexture, globalTexture, timeTexture };
+	glDeleteTextures(4, textures);
+	GLuint buffers[4] = { nodeBuffer, keyBuffer, globalBuffer, scratchBuffer };
+	glDeleteBuffers(4, buffers);
+	glDeleteVertexArrays(1, &emptyArray);
+}
+
+void GpuAnimator::build(AnimatedModel& model)
+{
+	clip = &model.getClip();
+	ticksPerSecond = clip->getTicksPerSecond();
+	durationTicks = clip->getDuration();
+	globalInverse = model.globalInverseTransform;
+
+	// the model's table is depth first; regroup it breadth first: level after level,
+	// parents before children
+	const vector<AnimNode>& source = model.getNodes();
+	vector<unsigned int> depth(source.size(), 0);
+	unsigned int levels = 0;
+	for (unsigned int i = 0; i < source.size(); i++) {
+		depth[i] = source[i].parent >= 0 ? depth[source[i].parent] + 1 : 0;
+		levels = std::max(levels, depth[i] + 1);
+	}
+	vector<unsigned int> order;
+	vector<int> index(source.size(), -1);
+	for (unsigned int level = 0; level < levels; level++) {
+		levelFirst.push_back(order.size());
+		for (unsigned int i = 0; i < source.size(); i++) {
+			if (depth[i] == level) {
+				index[i] = order.size();
+				order.push_back(i);
+			}
+		}
+		levelCount.push_back(order.size() - levelFirst.back());
+		widestLevel = std::max(widestLevel, levelCount.back());
+	}
+	nodeCount = order.size();
+	boneCount = model.numBones;
+
+	vector<float> nodeTexels;
+	vector<int> boneNodes(boneCount, -1);
+	for (unsigned int i = 0; i < nodeCount; i++) {
+		const AnimNode& node = source[order[i]];
+		float info[4] = { node.parent >= 0 ? (float)index[node.parent] : -1.0f, (float)node.channel, 0.0f, 0.0f };
+		nodeTexels.insert(nodeTexels.end(), info, info + 4);
+		appendRows(nodeTexels, node.transform);
+		if (node.bone >= 0)
+			boneNodes[node.bone] = i;
+	}
+	for (unsigned int b = 0; b < boneCount; b++) {
+		float info[4] = { (float)boneNodes[b], 0.0f, 0.0f, 0.0f };
+		nodeTexels.insert(nodeTexels.end(), info, info + 4);
+		appendRows(nodeTexels, model.allBones[b].boneOffset);
+	}
+
+	// header texel pairs hold (first, count) of position, rotation and scaling in turn
+	vector<float> keyTexels(clip->channelCount() * 2 * 4, 0.0f);
+	for (unsigned int c = 0; c < clip->channelCount(); c++) {
+		for (unsigned int kind = 0; kind < CLIP_TRACKS; kind++) {
+			unsigned int keys = clip->keyCount((ClipTrack)kind, c);
+			float* header = &keyTexels[c * 8];
+			header[kind * 2] = (float)(keyTexels.size() / 4);
+			header[kind * 2 + 1] = (float)keys;
+			for (unsigned int k = 0; k < keys; k++) {
+				float tick, value[4];
+				clip->key((ClipTrack)kind, c, k, tick, value);
+				if (kind == CLIP_ROTATION) {
+					float texels[8] = { value[0], value[1], value[2], value[3], tick, 0.0f, 0.0f, 0.0f };
+					keyTexels.insert(keyTexels.end(), texels, texels + 8);
+				}
+				else {
+					float texel[4] = { value[0], value[1], value[2], tick };
+					keyTexels.insert(keyTexels.end(), texel, texel + 4);
+				}
+			}
+		}
+	}
+	if (keyTexels.empty())
+		keyTexels.assign(4, 0.0f);
+
+	glGenBuffers(1, &nodeBuffer);
+	glBindBuffer(GL_TEXTURE_BUFFER, nodeBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, nodeTexels.size() * sizeof(float), &nodeTexels[0], GL_STATIC_DRAW);
+	glGenBuffers(1, &keyBuffer);
+	glBindBuffer(GL_TEXTURE_BUFFER, keyBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, keyTexels.size() * sizeof(float), &keyTexels[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	nodeTexture = createBufferTexture(nodeBuffer, GPU_ANIM_NODE_UNIT);
+	keyTexture = createBufferTexture(keyBuffer, GPU_ANIM_KEY_UNIT);
+}
+
+bool GpuAnimator::evaluate(const float* times, unsigned int count, vector<GLint>& bases)
+{
+	if (count == 0 || boneCount == 0)
+		return false;
+	// clip times in ticks, padded to whole texels, then room for every palette
+	unsigned int timeFloats = (count + 3) / 4 * 4;
+	GLsizeiptr paletteBytes = (GLsizeiptr)count * boneCount * sizeof(Matrix4f);
+	GLintptr offset;
+	float* data = (float*)StreamBuffers::get().texel.map(timeFloats * sizeof(float) + paletteBytes, offset);
+	if (!data)
+		return false;
+	for (unsigned int i = 0; i < count; i++) {
+		// a clip without duration holds its first keys rather than turning into NaN
+		float tick = durationTicks > 0.0f ? fmodf(times[i] * ticksPerSecond, durationTicks) : 0.0f;
+		data[i] = tick < 0.0f ? tick + durationTicks : tick;
+	}
+	StreamBuffers::get().texel.unmap();
+	GLint timeBase = (GLint)(offset / (4 * sizeof(float)));
+	GLintptr paletteOffset = offset + timeFloats * sizeof(float);
+	GLint paletteTexel = (GLint)(paletteOffset / (4 * sizeof(float)));
+	bases.resize(count);
+	for (unsigned int i = 0; i < count; i++)
+		bases[i] = paletteTexel + i * boneCount * 4;
+
+	GLState& glState = GLState::get();
+	glState.enable(GL_RASTERIZER_DISCARD);
+	glState.bindVertexArray(emptyArray);
+	glState.bindTexture(GPU_ANIM_NODE_UNIT, GL_TEXTURE_BUFFER, nodeTexture);
+	glState.bindTexture(GPU_ANIM_KEY_UNIT, GL_TEXTURE_BUFFER, keyTexture);
+	glState.bindTexture(GPU_ANIM_GLOBAL_UNIT, GL_TEXTURE_BUFFER, globalTexture);
+	for (unsigned int first = 0; first < count; first += batchLimit) {
+		unsigned int batch = std::min(batchLimit, count - first);
+		reserve(batch);
+
+		Shader& evaluateShader = evaluateProgram();
+		evaluateShader.use();
+		evaluateShader.setInt("nodeTable", GPU_ANIM_NODE_UNIT);
+		evaluateShader.setInt("keyframes", GPU_ANIM_KEY_UNIT);
+		evaluateShader.setInt("instanceTimes", GPU_ANIM_TIME_UNIT);
+		evaluateShader.setInt("globals", GPU_ANIM_GLOBAL_UNIT);
+		evaluateShader.setInt("instanceCount", batch);
+		evaluateShader.setInt("timeBase", timeBase * 4 + first);
+		evaluateShader.setBool("useSlerp", clip->usesSlerp());
+		glState.bindTexture(GPU_ANIM_TIME_UNIT, GL_TEXTURE_BUFFER, timeTexture);
+		for (unsigned int level = 0; level < levelFirst.size(); level++) {
+			// each level reads its parents from globals, so it is captured aside and copied in
+			evaluateShader.setInt("levelFirst", levelFirst[level]);
+			GLsizeiptr bytes = (GLsizeiptr)levelCount[level] * batch * sizeof(Matrix4f);
+			capture(scratchBuffer, 0, levelCount[level] * batch);
+			glBindBuffer(GL_COPY_READ_BUFFER, scratchBuffer);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, globalBuffer);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0,
+				(GLintptr)levelFirst[level] * batch * sizeof(Matrix4f), bytes);
+			glBindBuffer(GL_COPY_READ_BUFFER, 0);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		}
+
+		// the palettes go into the ring the times were read from; stop sampling it first
+		glState.bindTexture(GPU_ANIM_TIME_UNIT, GL_TEXTURE_BUFFER, 0);
+		Shader& paletteShader = paletteProgram();
+		paletteShader.use();
+		paletteShader.setInt("nodeTable", GPU_ANIM_NODE_UNIT);
+		paletteShader.setInt("globals", GPU_ANIM_GLOBAL_UNIT);
+		paletteShader.setInt("boneTable", nodeCount * 5);
+		paletteShader.setInt("boneCount", boneCount);
+		paletteShader.setInt("instanceCount", batch);
+		paletteShader.setMat4Array("globalInverse", &globalInverse.m[0][0], 1, true);
+		capture(StreamBuffers::get().texel.getBuffer(), paletteOffset + (GLintptr)first * boneCount * sizeof(Matrix4f),
+			batch * boneCount);
+	}
+	glState.disable(GL_RASTERIZER_DISCARD);
+	return true;
+}
+
+void GpuAnimator::capture(GLuint buffer, GLintptr offset, unsigned int count)
+{
+	glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 0, buffer, offset, (GLsizeiptr)count * sizeof(Matrix4f));
+	glBeginTransformFeedback(GL_POINTS);
+	glDrawArrays(GL_POINTS, 0, count);
+	glEndTransformFeedback();
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+}
+
+void GpuAnimator::reserve(unsigned int batch)
+{
+	if (batch <= reserved)
+		return;
+	glBindBuffer(GL_TEXTURE_BUFFER, globalBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, (GLsizeiptr)nodeCount * batch * sizeof(Matrix4f), NULL, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_TEXTURE_BUFFER, scratchBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, (GLsizeiptr)widestLevel * batch * sizeof(Matrix4f), NULL, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	reserved = batch;
+}
+
+GLuint GpuAnimator::createBufferTexture(GLuint buffer, unsigned int unit)
+{
+	GLuint texture;
+	glGenTextures(1, &texture);
+	GLState::get().bindTexture(unit, GL_TEXTURE_BUFFER, texture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer);
+	return texture;
+}
+
+// Matrix4f is row-major: its 16 floats are its four rows, one texel each
+void GpuAnimator::appendRows(vector<float>& texels, const Matrix4f& matrix)
+{
+	texels.insert(texels.end(), &matrix.m[0][0], &matrix.m[0][0] + 16);
+}
+
+Shader& GpuAnimator::evaluateProgram()
+{
+	static Shader* program = linkCapture("animEvaluate.vs");
+	return *program;
+}
+
+Shader& GpuAnimator::paletteProgram()
+{
+	static Shader* program = linkCapture("animPalette.vs");
+	return *program;
+}
+
+// both passes output a matrix as four rows, captured interleaved
+Shader* GpuAnimator::linkCapture(const char* vertexPath)
+{
+	// the fragment shader never runs, any one that links will do
+	Shader* program = new Shader(vertexPath, "shadow_mapping_depth.fs");
+	const char* varyings[] = { "row0", "row1", "row2", "row3" };
+	program->captureVaryings(varyings, 4);
+	return program;
+}
+
+#endif // !GPU_ANIMATOR__H
@@ -0,0 +1,23 @@
+#version 330 core
+out float maxDepth;
+
+uniform sampler2D depthMap;
+// full resolution texels covered by one texel of the reduced map
+uniform ivec2 footprint;
+
+// farthest depth under this texel: an object behind it is hidden by everything here
+void main()
+{
+    ivec2 size = textureSize(depthMap, 0);
+    ivec2 origin = ivec2(gl_FragCoord.xy) * footprint;
+    float result = 0.0;
+    for(int y = 0; y < footprint.y; ++y)
+    {
+        for(int x = 0; x < footprint.x; ++x)
+        {
+            ivec2 texel = min(origin + ivec2(x, y), size - 1);
+            result = max(result, texelFetch(depthMap, texel, 0).r);
+        }
+    }
+    maxDepth = result;
+}
\ No newline at end of file
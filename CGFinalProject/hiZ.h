@@ -0,0 +1,298 @@
+#ifndef HI_Z__H
+#define HI_Z__H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <vector>
+
+#include <learnopengl/shader.h>
+#include <learnopengl/gl_state.h>
+#include "ogldev_util.h"
+
+// width of the reduced depth map that is read back; the height follows the aspect ratio
+#define HIZ_WIDTH 256
+// read back buffers in flight; results arrive one or two frames late
+#define HIZ_READBACKS 2
+// once the eye has moved this far from where the depth was taken, nothing is culled
+#define HIZ_MAX_TRAVEL 50.0f
+
+// Occlusion culling against an earlier frame's depth buffer (hierarchical Z).
+// capture() runs after the main pass: the multisampled depth is resolved into a
+// texture, reduced on the GPU to a HIZ_WIDTH wide map that keeps the farthest depth of
+// each footprint, and read back asynchronously through a pixel buffer plus fence. When
+// a read back completes the CPU builds the rest of the max pyramid from it.
+// isOccluded() projects a world box with the view-projection the depth was taken
+// with, picks the level where the box covers at most 2x2 texels and compares the box's
+// nearest depth against the farthest depth there. It stays conservative: boxes that
+// cross the near plane or leave the old screen count as visible, boxes are grown by
+// the distance the eye travelled since, and culling switches off after HIZ_MAX_TRAVEL.
+class HiZ
+{
+DISALLOW_COPY_AND_ASSIGN(HiZ)
+public:
+	HiZ();
+
+	// grab this frame's depth; viewProjection and eye are the camera it was drawn with
+	void capture(const glm::mat4& viewProjection, const glm::vec3& eye);
+	// pick up a finished read back; call once per frame before testing, with the current eye
+	void update(const glm::vec3& eye);
+	// true when the whole box is behind the captured depth
+	bool isOccluded(const glm::vec3& boxMin, const glm::vec3& boxMax) const;
+	bool isUsable() const { return usable; }
+
+private:
+	struct Readback
+	{
+		GLuint buffer;
+		GLsync fence;
+		glm::mat4 viewProjection;
+		glm::vec3 eye;
+		glm::ivec2 screen;
+		glm::ivec2 footprint;
+		glm::ivec2 size;
+	};
+
+	void resize(unsigned int width, unsigned int height);
+	void buildPyramid();
+	float maxDepth(unsigned int level, int x0, int y0, int x1, int y1) const;
+
+	Shader reduceShader;
+	GLint footprintLocation;
+	GLuint emptyVAO;
+	GLuint resolveFBO, resolveDepth;
+	GLuint reduceFBO, reduceTexture;
+	glm::ivec2 screen;
+	glm::ivec2 footprint;
+	glm::ivec2 reducedSize;
+
+	Readback readbacks[HIZ_READBACKS];
+	unsigned int nextReadback;
+
+	// CPU pyramid of the newest completed read back, level 0 first
+	std::vector<std::vector<float> > levels;
+	std::vector<glm::ivec2> levelSizes;
+	glm::mat4 viewProjection;
+	glm::ivec2 levelScreen;
+	glm::ivec2 levelFootprint;
+	glm::vec3 captureEye;
+	float travel;
+	bool usable;
+};
+
+HiZ::HiZ()
+	: reduceShader("hiZ.vs", "hiZ.fs")
+{
+	footprintLocation = glGetUniformLocation(reduceShader.ID, "footprint");
+	glGenVertexArrays(1, &emptyVAO);
+	glGenFramebuffers(1, &resolveFBO);
+	glGenFramebuffers(1, &reduceFBO);
+	glGenTextures(1, &resolveDepth);
+	glGenTextures(1, &reduceTexture);
+	for (unsigned int i = 0; i < HIZ_READBACKS; i++) {
+		glGenBuffers(1, &readbacks[i].buffer);
+		readbacks[i].fence = 0;
+	}
+	nextReadback = 0;
+	screen = glm::ivec2(0);
+	travel = 0.0f;
+	usable = false;
+}
+
+void HiZ::resize(unsigned int width, unsigned int height)
+{
+	screen = glm::ivec2(width, height);
+	// must match the default framebuffer's depth format for the blit
+	GLState::get().bindTexture(0, GL_TEXTURE_2D, resolveDepth);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, width, height, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, resolveFBO);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, resolveDepth, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+
+	int reducedHeight = std::max(1, (int)(HIZ_WIDTH * height / std::max(width, 1u)));
+	footprint = glm::ivec2((width + HIZ_WIDTH - 1) / HIZ_WIDTH, (height + reducedHeight - 1) / reducedHeight);
+	reducedSize = glm::ivec2(HIZ_WIDTH, reducedHeight);
+	GLState::get().bindTexture(0, GL_TEXTURE_2D, reduceTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, reducedSize.x, reducedSize.y, 0, GL_RED, GL_FLOAT, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, reduceFBO);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, reduceTexture, 0);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		std::cout << "ERROR::HIZ:: reduction framebuffer incomplete" << std::endl;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	// read backs still in flight have the old size
+	for (unsigned int i = 0; i < HIZ_READBACKS; i++) {
+		if (readbacks[i].fence) {
+			glDeleteSync(readbacks[i].fence);
+			readbacks[i].fence = 0;
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, readbacks[i].buffer);
+		glBufferData(GL_PIXEL_PACK_BUFFER, reducedSize.x * reducedSize.y * sizeof(float), NULL, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void HiZ::capture(const glm::mat4& viewProjection, const glm::vec3& eye)
+{
+	Readback& readback = readbacks[nextReadback];
+	if (readback.fence) {
+		// the slot is still in flight; skip this frame rather than stall
+		return;
+	}
+	if (screen.x != (int)SCR_WIDTH || screen.y != (int)SCR_HEIGHT)
+		resize(SCR_WIDTH, SCR_HEIGHT);
+
+	// resolve the multisampled depth
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, resolveFBO);
+	glBlitFramebuffer(0, 0, screen.x, screen.y, 0, 0, screen.x, screen.y, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+	// reduce to the farthest depth per footprint
+	GLState& state = GLState::get();
+	glBindFramebuffer(GL_FRAMEBUFFER, reduceFBO);
+	glViewport(0, 0, reducedSize.x, reducedSize.y);
+	// the caller's enables are put back after the pass
+	bool depthTest = state.isEnabled(GL_DEPTH_TEST);
+	bool blend = state.isEnabled(GL_BLEND);
+	state.disable(GL_DEPTH_TEST);
+	state.disable(GL_BLEND);
+	reduceShader.use();
+	reduceShader.setInt("depthMap", 0);
+	// Shader has no integer vector setter; the uniform cache never sees this one
+	glUniform2i(footprintLocation, footprint.x, footprint.y);
+	state.bindTexture(0, GL_TEXTURE_2D, resolveDepth);
+	state.bindVertexArray(emptyVAO);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	state.setEnabled(GL_BLEND, blend);
+	state.setEnabled(GL_DEPTH_TEST, depthTest);
+
+	// start the asynchronous read back
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+	glReadPixels(0, 0, reducedSize.x, reducedSize.y, GL_RED, GL_FLOAT, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	readback.viewProjection = viewProjection;
+	readback.eye = eye;
+	readback.screen = screen;
+	readback.footprint = footprint;
+	readback.size = reducedSize;
+	nextReadback = (nextReadback + 1) % HIZ_READBACKS;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+}
+
+void HiZ::update(const glm::vec3& eye)
+{
+	// newest finished read back wins; oldest slot first
+	for (unsigned int i = 0; i < HIZ_READBACKS; i++) {
+		Readback& readback = readbacks[(nextReadback + i) % HIZ_READBACKS];
+		if (!readback.fence)
+			continue;
+		if (glClientWaitSync(readback.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+			continue;
+		glDeleteSync(readback.fence);
+		readback.fence = 0;
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+		const float* data = (const float*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+			readback.size.x * readback.size.y * sizeof(float), GL_MAP_READ_BIT);
+		if (data) {
+			levels.resize(1);
+			levelSizes.resize(1);
+			levels[0].assign(data, data + readback.size.x * readback.size.y);
+			levelSizes[0] = readback.size;
+			viewProjection = readback.viewProjection;
+			captureEye = readback.eye;
+			levelScreen = readback.screen;
+			levelFootprint = readback.footprint;
+			buildPyramid();
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+	travel = levels.empty() ? 0.0f : glm::length(eye - captureEye);
+	usable = !levels.empty() && travel < HIZ_MAX_TRAVEL;
+}
+
+void HiZ::buildPyramid()
+{
+	while (levelSizes.back().x > 1 || levelSizes.back().y > 1) {
+		glm::ivec2 below = levelSizes.back();
+		glm::ivec2 size((below.x + 1) / 2, (below.y + 1) / 2);
+		std::vector<float> level(size.x * size.y);
+		const std::vector<float>& source = levels.back();
+		for (int y = 0; y < size.y; y++) {
+			int y0 = y * 2, y1 = std::min(y * 2 + 1, below.y - 1);
+			for (int x = 0; x < size.x; x++) {
+				int x0 = x * 2, x1 = std::min(x * 2 + 1, below.x - 1);
+				level[y * size.x + x] = std::max(std::max(source[y0 * below.x + x0], source[y0 * below.x + x1]),
+					std::max(source[y1 * below.x + x0], source[y1 * below.x + x1]));
+			}
+		}
+		levels.push_back(level);
+		levelSizes.push_back(size);
+	}
+}
+
+float HiZ::maxDepth(unsigned int level, int x0, int y0, int x1, int y1) const
+{
+	const std::vector<float>& data = levels[level];
+	glm::ivec2 size = levelSizes[level];
+	float result = 0.0f;
+	for (int y = y0; y <= y1; y++) {
+		for (int x = x0; x <= x1; x++) {
+			result = std::max(result, data[std::min(y, size.y - 1) * size.x + std::min(x, size.x - 1)]);
+		}
+	}
+	return result;
+}
+
+bool HiZ::isOccluded(const glm::vec3& boxMin, const glm::vec3& boxMax) const
+{
+	if (!usable)
+		return false;
+	// what the eye could have uncovered since the capture
+	glm::vec3 grownMin = boxMin - glm::vec3(travel);
+	glm::vec3 grownMax = boxMax + glm::vec3(travel);
+
+	glm::vec2 ndcMin(FLT_MAX), ndcMax(-FLT_MAX);
+	float nearestDepth = FLT_MAX;
+	for (unsigned int corner = 0; corner < 8; corner++) {
+		glm::vec4 point((corner & 1) ? grownMax.x : grownMin.x, (corner & 2) ? grownMax.y : grownMin.y,
+			(corner & 4) ? grownMax.z : grownMin.z, 1.0f);
+		glm::vec4 clip = viewProjection * point;
+		if (clip.w <= 1e-4f)
+			return false;
+		glm::vec3 ndc = glm::vec3(clip) / clip.w;
+		ndcMin = glm::min(ndcMin, glm::vec2(ndc));
+		ndcMax = glm::max(ndcMax, glm::vec2(ndc));
+		nearestDepth = std::min(nearestDepth, ndc.z * 0.5f + 0.5f);
+	}
+	// the old depth knows nothing outside its screen
+	if (ndcMin.x < -1.0f || ndcMin.y < -1.0f || ndcMax.x > 1.0f || ndcMax.y > 1.0f)
+		return false;
+
+	// screen pixels, then texels of the reduced map, grown by one texel
+	glm::vec2 screenSize(levelScreen);
+	glm::vec2 texelMin = (ndcMin * 0.5f + 0.5f) * screenSize / glm::vec2(levelFootprint);
+	glm::vec2 texelMax = (ndcMax * 0.5f + 0.5f) * screenSize / glm::vec2(levelFootprint);
+	int x0 = std::max(0, (int)texelMin.x - 1), y0 = std::max(0, (int)texelMin.y - 1);
+	int x1 = (int)texelMax.x + 1, y1 = (int)texelMax.y + 1;
+
+	// coarsest level needed to cover the rectangle with at most 2x2 texels
+	unsigned int level = 0;
+	while (level + 1 < levels.size() && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1))
+		level++;
+	return nearestDepth > maxDepth(level, x0 >> level, y0 >> level, x1 >> level, y1 >> level);
+}
+
+#endif // !HI_Z__H
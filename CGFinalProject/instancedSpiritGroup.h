@@ -0,0 +1,195 @@
+#ifndef INSTANCED_SPIRIT_GROUP__H
+#define INSTANCED_SPIRIT_GROUP__H
+
+#include <glm/glm.hpp>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "spirit.h"
+#include "gpuAnimator.h"
+
+// Many copies of one model (a crowd, a row of cars, a flock), each with its own transform
+// and animation time offset. The model is loaded once and every mesh is queued once per
+// frame with all visible copies, so a pass draws each mesh with a single instanced call
+// instead of one draw sequence per copy. Copies of an animated model each read their
+// own bone palette by palette base, evaluated once per distinct time offset, so a whole
+// crowd in independent phases is still one instanced call per mesh. Copies are culled
+// one by one against the passes' frusta here, by the bind-pose box of a static model or
+// the box of their pose (AnimatedModel::posedBounds()), before the queue culls the
+// remaining group as a whole.
+// With GPU animation on, every copy of an animated model gets its own palette evaluated
+// by a GpuAnimator instead, so copies need not share time offsets and the CPU cost no
+// longer grows with the number of distinct poses. Those poses stay on the GPU, so such
+// copies are not culled.
+class InstancedSpiritGroup
+{
+DISALLOW_COPY_AND_ASSIGN(InstancedSpiritGroup)
+public:
+	// streamed like any Spirit; nothing is drawn until the model is in
+	InstancedSpiritGroup(std::string Path);
+	~InstancedSpiritGroup();
+
+	// returns the index of the new copy
+	unsigned int addInstance(const glm::mat4& transform, float timeOffset = 0.0f);
+	unsigned int addInstance(glm::vec3 position, glm::vec3 scale = glm::vec3(1.0f, 1.0f, 1.0f),
+		glm::vec3 angles = glm::vec3(0.0f, 0.0f, 0.0f), float timeOffset = 0.0f);
+	void setTransform(unsigned int instance, const glm::mat4& transform) { transforms[instance] = transform; }
+	const glm::mat4& getTransform(unsigned int instance) const { return transforms[instance]; }
+	unsigned int size() const { return transforms.size(); }
+
+	bool isReady() const { return groupModel.isReady(); }
+	// evaluate the copies' palettes on the GPU; animated models only, takes effect once loaded
+	void setGpuAnimation(bool enabled) { gpuAnimation = enabled; }
+	void collect(RenderQueue& queue, float time, const Frustum frusta[PASS_COUNT]);
+
+private:
+	void stream();
+	// whether any pass sees the world box
+	static bool inView(const Frustum frusta[PASS_COUNT], const glm::vec3& boxMin, const glm::vec3& boxMax);
+	// one palette per copy from the GpuAnimator; false when it could not run
+	bool collectGpuPoses(RenderQueue& queue, float time);
+
+	AnimatedModel groupModel;
+	std::string name;
+	vector<glm::mat4> transforms;
+	vector<float> timeOffsets;
+	// per frame scratch: visible copies, and the palette of each time offset for animated models
+	vector<glm::mat4> visibleTransforms;
+	vector<unsigned int> palettes;
+	struct Pose
+	{
+		unsigned int palette;
+		glm::vec3 bounds[2];    // model space box
+	};
+	std::map<float, Pose> poses;
+	bool gpuAnimation;
+	GpuAnimator* animator;
+	vector<float> times;
+	vector<GLint> paletteTexels;
+};
+
+InstancedSpiritGroup::InstancedSpiritGroup(std::string Path)
+	: groupModel(("resources/" + Path).data(), true)
+{
+	name = Path;
+	gpuAnimation = false;
+	animator = NULL;
+	stream();
+}
+
+InstancedSpiritGroup::~InstancedSpiritGroup()
+{
+	delete animator;
+}
+
+unsigned int InstancedSpiritGroup::addInstance(const glm::mat4& transform, float timeOffset)
+{
+	transforms.push_back(transform);
+	timeOffsets.push_back(timeOffset);
+	return transforms.size() - 1;
+}
+
+unsigned int InstancedSpiritGroup::addInstance(glm::vec3 position, glm::vec3 scale, glm::vec3 angles, float timeOffset)
+{
+	return addInstance(Spirit::modelMatrix(position, scale, angles), timeOffset);
+}
+
+void InstancedSpiritGroup::collect(RenderQueue& queue, float time, const Frustum frusta[PASS_COUNT])
+{
+	if (!groupModel.isReady() || transforms.empty()) {
+		return;
+	}
+
+	if (groupModel.isAnimated()) {
+		// GPU poses never come back to the CPU, so there is no box to cull them by: those
+		// copies are all queued, and the queue cannot cull or occlusion test the group
+		if (gpuAnimation && collectGpuPoses(queue, time)) {
+			groupModel.collectInstanced(queue, &transforms[0], &palettes[0], transforms.size());
+			return;
+		}
+		// each copy culled by the box of its pose, the queue culls the rest by their union
+		poses.clear();
+		visibleTransforms.clear();
+		palettes.clear();
+		glm::vec3 worldBounds[2] = { glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX) };
+		for (unsigned int i = 0; i < transforms.size(); i++) {
+			std::map<float, Pose>::iterator pose = poses.find(timeOffsets[i]);
+			if (pose == poses.end()) {
+				Pose posed;
+				posed.palette = groupModel.addPose(queue, time + timeOffsets[i], posed.bounds);
+				pose = poses.insert(std::make_pair(timeOffsets[i], posed)).first;
+			}
+			glm::vec3 boxMin, boxMax;
+			RenderQueue::worldBox(pose->second.bounds[0], pose->second.bounds[1], transforms[i], boxMin, boxMax);
+			if (!inView(frusta, boxMin, boxMax)) {
+				continue;
+			}
+			visibleTransforms.push_back(transforms[i]);
+			palettes.push_back(pose->second.palette);
+			worldBounds[0] = glm::min(worldBounds[0], boxMin);
+			worldBounds[1] = glm::max(worldBounds[1], boxMax);
+		}
+		if (!visibleTransforms.empty()) {
+			groupModel.collectInstanced(queue, &visibleTransforms[0], &palettes[0], visibleTransforms.size(),
+				PASS_ALL, worldBounds);
+		}
+		return;
+	}
+
+	visibleTransforms.clear();
+	for (unsigned int i = 0; i < transforms.size(); i++) {
+		bool visible = true;
+		if (groupModel.hasBounds()) {
+			glm::vec3 boxMin, boxMax;
+			RenderQueue::worldBox(groupModel.aabbMin, groupModel.aabbMax, transforms[i], boxMin, boxMax);
+			visible = inView(frusta, boxMin, boxMax);
+		}
+		if (visible) {
+			visibleTransforms.push_back(transforms[i]);
+		}
+	}
+	if (!visibleTransforms.empty()) {
+		groupModel.collectInstanced(queue, &visibleTransforms[0], NULL, visibleTransforms.size());
+	}
+}
+
+bool InstancedSpiritGroup::inView(const Frustum frusta[PASS_COUNT], const glm::vec3& boxMin, const glm::vec3& boxMax)
+{
+	for (unsigned int pass = 0; pass < PASS_COUNT; pass++) {
+		if (frusta[pass].testAABB(boxMin, boxMax)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool InstancedSpiritGroup::collectGpuPoses(RenderQueue& queue, float time)
+{
+	if (!animator) {
+		animator = new GpuAnimator(groupModel);
+	}
+	times.resize(transforms.size());
+	for (unsigned int i = 0; i < transforms.size(); i++) {
+		times[i] = time + timeOffsets[i];
+	}
+	if (!animator->evaluate(&times[0], times.size(), paletteTexels)) {
+		return false;
+	}
+	palettes.resize(transforms.size());
+	for (unsigned int i = 0; i < transforms.size(); i++) {
+		palettes[i] = queue.addStreamedPalette(paletteTexels[i]);
+	}
+	return true;
+}
+
+void InstancedSpiritGroup::stream()
+{
+	AssetStreamer::getInstance()->submit(name,
+		[this]() { return groupModel.parse(); },
+		[this]() { groupModel.uploadBuffers(); },
+		[this]() { groupModel.publish(); });
+}
+
+#endif // !INSTANCED_SPIRIT_GROUP__H
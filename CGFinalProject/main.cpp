@@ -11,6 +11,7 @@
 
 #include <learnopengl/shader_m.h>
 #include <learnopengl/camera.h>
+#include <learnopengl/uniform_blocks.h>
 
 #include <iostream>
 
@@ -19,8 +20,15 @@
 #include "skyBox.h"
 
 #include "ogldev_util.h"
+#include "assetStreamer.h"
 
 //#define IMGUI_TEST
+// 渐进式启动：先画代理包围盒和天空盒颜色，模型、纹理、字形在后台加载完成后再替换
+#define PROGRESSIVE_BOOT
+// 每帧留给GPU上传的时间 (ms)
+const double STREAM_UPLOAD_BUDGET = 4.0;
+// VRAM the TextureStreamer may fill with mip levels, 0 uploads every texture in full
+const size_t TEXTURE_STREAM_BUDGET = 128 * 1024 * 1024;
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
@@ -30,8 +38,9 @@ void processInput(GLFWwindow *window);
 void changePlanePos();
 void changePlaneInitAng(float xoffset, float yoffset, bool reset = false);
 void showGui();
-void getDepthMap(Shader &depthShader, float &currentFrame, glm::mat4 &lightSpaceMatrix);
-void showScence(Shader &shader, float &currentFrame, glm::mat4 &lightSpaceMatrix);
+void updateUniformBlocks(float currentFrame, const glm::mat4 &lightSpaceMatrix);
+void getDepthMap(Shader &depthShader);
+void showScence(Shader &shader);
 void showParticle(Shader &shader);
 void showDepthMap(Shader &debugDepthQuad);
 void renderQuad();
@@ -61,6 +70,11 @@ glm::vec3 viewPlaneInitAng(defaultViewPlaneInitAng[0], defaultViewPlaneInitAng[1
 bool gammaEnabled = false;
 bool gammaKeyPressed = false;
 
+// skin animated meshes once per frame for both passes, see SkinningCache
+bool preSkinning = true;
+// update distant and unseen animations less often, see AnimationScheduler
+bool animationLod = true;
+
 // depth test
 bool isDepthTest = false;
 bool depthTestKeyPressed = false;
@@ -69,9 +83,24 @@ bool depthTestKeyPressed = false;
 ParticleGenerator   *Particles;
 
 SceneController sceneController;
+RenderQueue renderQueue;
+
+// uniform uploads and state changes of the previous frame, see UniformCache and GLState
+UniformCache::Stats uniformStats;
+GLState::Stats glStateStats;
 
-int main()
+int main(int argc, char** argv)
 {
+	// offline bake: --bake-vat <model> <out.vat> [frames], no window
+	if (argc >= 4 && std::string(argv[1]) == "--bake-vat") {
+		unsigned int frames = argc >= 5 ? (unsigned int)atoi(argv[4]) : VAT_DEFAULT_FRAMES;
+		return VATBaker::bakeFile(argv[2], argv[3], frames) ? 0 : 1;
+	}
+
+	AssetStreamer* streamer = AssetStreamer::getInstance();
+	streamer->start();
+	TextureStreamer::get().setBudget(TEXTURE_STREAM_BUDGET);
+
 	// glfw: initialize and configure
 	// ------------------------------
 	glfwInit();
@@ -105,15 +134,22 @@ int main()
 		std::cout << "Failed to initialize GLAD" << std::endl;
 		return -1;
 	}
+	// shared vertex/index buffers, before the loader context starts filling them
+	GeometryArena::getInstance()->create(sizeof(Vertex));
+	// 后台加载线程使用共享上下文上传缓冲和纹理
+	streamer->attachContext(window);
 
 	// configure global opengl state
 	// -----------------------------
-	glEnable(GL_DEPTH_TEST);
-	glEnable(GL_MULTISAMPLE);
-	glEnable(GL_CULL_FACE);
+	GLState &glState = GLState::get();
+	glState.enable(GL_DEPTH_TEST);
+	glState.enable(GL_MULTISAMPLE);
+	glState.enable(GL_CULL_FACE);
+	glState.cullFace(GL_BACK);
+	glState.depthFunc(GL_LESS);
 	// 文字开启混合
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glState.enable(GL_BLEND);
+	glState.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
   
 	// build and compile our shader zprogram
 	// ------------------------------------
@@ -121,13 +157,29 @@ int main()
 	Shader depthShader("shadow_mapping_depth.vs", "shadow_mapping_depth.fs");
 	Shader debugDepthQuad("debug_shadow_mapping.vs", "debug_shadow_mapping.fs");
 	Shader particleShader("particle.vs", "particle.fs");
+	HiZ hiZ;
 
 	//粒子发射器
 	Particles = new ParticleGenerator(
 		particleShader,
-		loadTexture("resources/particle.png"),
+		0,
 		500
 	);
+	TextureData *particleTexture = new TextureData();
+	unsigned int *particleTextureID = new unsigned int(0);
+	streamer->submit("particle.png",
+		[particleTexture]() { return decodeTexture("resources/particle.png", *particleTexture); },
+		[particleTexture, particleTextureID]() { *particleTextureID = uploadTexture(*particleTexture); },
+		[particleTexture, particleTextureID]() {
+			Particles->setTexture(*particleTextureID);
+			delete particleTexture;
+			delete particleTextureID;
+		},
+		[particleTexture, particleTextureID]() {
+			releaseTexture(*particleTexture);
+			delete particleTexture;
+			delete particleTextureID;
+		});
 
 	
 	// Setup Dear ImGui context
@@ -152,11 +204,33 @@ int main()
 	sceneController.init();
 	SkyBox skyBox(&camera);
 	skyBox.init();
+	streamer->logEvent("boot submitted");
+
+#ifndef PROGRESSIVE_BOOT
+	streamer->flush();
+#endif // !PROGRESSIVE_BOOT
+
+	UniformBlocks::get().create();
+	bool firstFrame = true;
+	bool assetReportSaved = false;
 
 	// render loop
 	// -----------
 	while (!glfwWindowShouldClose(window))
 	{
+		uniformStats = UniformCache::stats();
+		UniformCache::resetStats();
+		glStateStats = GLState::get().frameStats();
+		// this frame's glyphs, particles, uniform blocks and bone palettes go into the streams
+		StreamBuffers::get().beginFrame();
+		streamer->pump(STREAM_UPLOAD_BUDGET);
+		TextureStreamer::get().update();
+		MaterialLibrary::getInstance()->upload();
+		if (!assetReportSaved && streamer->isIdle()) {
+			AssetReport::getInstance()->save();
+			assetReportSaved = true;
+		}
+
 		glfwGetWindowSize(window, (int*)&SCR_WIDTH, (int*)&SCR_HEIGHT);
 		// per-frame time logic
 		// --------------------
@@ -176,7 +250,8 @@ int main()
 
 		// render
 		// ------
-		glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+		glm::vec3 clearColor = skyBox.isReady() ? glm::vec3(0.1f) : SkyBox::fallbackColor();
+		glClearColor(clearColor.r, clearColor.g, clearColor.b, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 		//get lightSpaceMatrix
@@ -186,32 +261,63 @@ int main()
 		lightView = glm::lookAt(glm::vec3(lightPos[0], lightPos[1], lightPos[2]),
 								glm::vec3(0.0f), glm::vec3(0.0, 1.0, 0.0));
 		lightSpaceMatrix = lightProjection * lightView;
+		updateUniformBlocks(currentFrame, lightSpaceMatrix);
+
+		// one scene traversal feeds both passes
+		const ViewData &viewData = UniformBlocks::get().getView();
+		Frustum frusta[PASS_COUNT];
+		frusta[PASS_SHADOW].set(lightSpaceMatrix);
+		frusta[PASS_MAIN].set(viewData.projection * viewData.view);
+		renderQueue.clear();
+		renderQueue.setPreSkinning(preSkinning);
+		AnimationScheduler::getInstance()->setEnabled(animationLod);
+		AnimationScheduler::getInstance()->beginFrame(camera.Position, frusta);
+		sceneController.collect(renderQueue, currentFrame, frusta);
+		renderQueue.cull(PASS_SHADOW, frusta[PASS_SHADOW]);
+		renderQueue.cull(PASS_MAIN, frusta[PASS_MAIN]);
+		hiZ.update(camera.Position);
+		renderQueue.occlude(hiZ);
 
 		// 1. render depth of scene to texture (from light's perspective)
 		// --------------------------------------------------------------
-		getDepthMap(depthShader, currentFrame, lightSpaceMatrix);
+		getDepthMap(depthShader);
 		
 		skyBox.Draw();
 		// 2. render scene as normal using the generated depth/shadow map  
 		// --------------------------------------------------------------
-		showScence(shader, currentFrame, lightSpaceMatrix);
+		showScence(shader);
+		// depth of the opaque scene, tested against by the next frames
+		hiZ.capture(viewData.projection * viewData.view, camera.Position);
 
 		showParticle(particleShader);
 
 		skyBox.Draw();
 
+		sceneController.drawOverlay();
+
 		if (isDepthTest) showDepthMap(debugDepthQuad);
     
  #ifdef IMGUI_TEST
 		showGui();
  #endif // IMGUI_TEST
+		StreamBuffers::get().endFrame();
 
 		// glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
 		// -------------------------------------------------------------------------------
 		glfwSwapBuffers(window);
 		glfwPollEvents();
+
+		if (firstFrame) {
+			streamer->logEvent("first frame presented");
+			firstFrame = false;
+		}
 	}
   
+	streamer->shutdown();
+	delete Particles;
+	UniformBlocks::get().destroy();
+	TextureRegistry::get().printStats();
+
 	// glfw: terminate, clearing all previously allocated GLFW resources.
 	// ------------------------------------------------------------------
 	glfwTerminate();
@@ -270,12 +376,12 @@ void processInput(GLFWwindow *window)
 
 	if (glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS)
 	{
-		glEnable(GL_MULTISAMPLE);
+		GLState::get().enable(GL_MULTISAMPLE);
 	}
 	
 	if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS)
 	{
-		glDisable(GL_MULTISAMPLE);
+		GLState::get().disable(GL_MULTISAMPLE);
 	}
 
 
@@ -343,6 +449,39 @@ void showGui() {
 	//ImGui::SliderFloat3("planePos", (float*)&(sceneController.viewPlane->position), -10, 10);
 	ImGui::SliderFloat3("planeRota", (float*)&(sceneController.viewPlane->angles), 0, 360);
 	ImGui::SliderFloat3("planeRota", (float*)&(viewPlaneInitAng), 0, 360);
+	TextureRegistry::Stats textures = TextureRegistry::get().getStats();
+	ImGui::Text("textures: %u shared hits / %u loads, %u KB saved", textures.hits, textures.lookups,
+		(unsigned int)(textures.bytesSaved / 1024));
+	ImGui::Text("materials: %u unique for %u meshes", MaterialLibrary::getInstance()->size(),
+		MaterialLibrary::getInstance()->requests());
+	ImGui::Text("uniforms: %u uploaded, %u skipped as unchanged", uniformStats.uploads, uniformStats.skipped);
+	const RenderQueue::Stats& queueStats = renderQueue.getStats();
+	ImGui::Text("render queue: %u items, %u packets, %u draw calls, %u instances, %u palette uploads", queueStats.items,
+		queueStats.packets, queueStats.drawCalls, queueStats.instances, queueStats.paletteUploads);
+	ImGui::Checkbox("pre-skinning", &preSkinning);
+	const SkinningCache::Stats& skinningStats = renderQueue.getSkinningStats();
+	ImGui::Text("skinning: %u meshes, %u vertices skinned once for all passes, %u did not fit",
+		skinningStats.meshes, skinningStats.vertices, skinningStats.overflows);
+	ImGui::Checkbox("animation LOD", &animationLod);
+	const AnimationScheduler::Stats& animationStats = AnimationScheduler::getInstance()->getStats();
+	ImGui::Text("animation: %u posed (%u caught up) in %.2f ms, %u reused, %u frozen, %u over budget",
+		animationStats.updated, animationStats.caughtUp, animationStats.poseMs, animationStats.reused,
+		animationStats.frozen, animationStats.deferred);
+	GeometryArena::Stats arena = GeometryArena::getInstance()->getStats();
+	ImGui::Text("geometry arena: %u meshes, %u KB vertices, %u KB indices, %u did not fit", arena.meshes,
+		(unsigned int)(arena.vertices * sizeof(Vertex) / 1024), (unsigned int)(arena.indices * sizeof(unsigned int) / 1024),
+		arena.fallbacks);
+	ImGui::Text("culling: shadow %u / %u, main %u / %u culled (%u occluded)", queueStats.culled[PASS_SHADOW],
+		queueStats.tested[PASS_SHADOW], queueStats.culled[PASS_MAIN], queueStats.tested[PASS_MAIN], queueStats.occluded);
+	ImGui::Text("gl state: %u calls issued, %u filtered", glStateStats.issued, glStateStats.filtered);
+	TextureStreamer::Stats mips = TextureStreamer::get().getStats();
+	ImGui::Text("mip streaming: %u KB / %u KB, %u levels in, %u out", (unsigned int)(mips.residentBytes / 1024),
+		(unsigned int)(mips.budget / 1024), mips.levelsIn, mips.levelsOut);
+	const StreamBuffer::Stats& vertexStream = StreamBuffers::get().vertex.getStats();
+	const StreamBuffer::Stats& uniformStream = StreamBuffers::get().uniform.getStats();
+	ImGui::Text("streams: %u KB vertices, %u KB uniforms, %u waits, %u overflows",
+		(vertexStream.bytes + 1023) / 1024, (uniformStream.bytes + 1023) / 1024,
+		vertexStream.waits + uniformStream.waits, vertexStream.overflows + uniformStream.overflows);
 	
 	/*ImGui::SliderFloat3("planeScale", (float*)&(sceneController.viewPlane->scale), 0, 10);
 	ImGui::SliderFloat3("blackPos", (float*)&(sceneController.forwardBlackHole->position), RANGE_START, RANGE_END);
@@ -352,6 +491,8 @@ void showGui() {
 	ImGui::End();
 	ImGui::Render();
 	ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+	// imgui sets program, VAO, textures and blend state on its own
+	GLState::get().invalidate();
 }
 
 void changePlanePos() {
@@ -391,14 +532,39 @@ void changePlaneInitAng(float xoffset, float yoffset, bool reset) {
 	}
 }
 
-void getDepthMap(Shader &depthShader, float &currentFrame, glm::mat4 &lightSpaceMatrix) {
+// frame, view and light data shared by every program, written once per frame
+void updateUniformBlocks(float currentFrame, const glm::mat4 &lightSpaceMatrix) {
+	UniformBlocks &blocks = UniformBlocks::get();
+
+	FrameData frame;
+	frame.time = currentFrame;
+	frame.deltaTime = deltaTime;
+	frame.resolution = glm::vec2((float)SCR_WIDTH, (float)SCR_HEIGHT);
+	blocks.setFrame(frame);
+
+	ViewData view;
+	view.view = camera.GetViewMatrix();
+	view.projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 10000.0f);
+	view.viewPos = glm::vec4(camera.Position, 1.0f);
+	blocks.setView(view);
+
+	LightData light;
+	light.spaceMatrix = lightSpaceMatrix;
+	light.direction = glm::vec4(-lightPos[0], -lightPos[1], -lightPos[2], 0.0f);
+	light.ambient = glm::vec4(0.5f, 0.5f, 0.5f, 0.0f);
+	light.diffuse = glm::vec4(1.0f, 1.0f, 1.0f, 0.0f);
+	light.specular = glm::vec4(1.0f, 1.0f, 1.0f, 0.0f);
+	blocks.setLight(light);
+}
+
+void getDepthMap(Shader &depthShader) {
 	depthShader.use();
-	depthShader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
 
 	glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
 	glBindFramebuffer(GL_FRAMEBUFFER, sceneController.depthMapFBO);
 	glClear(GL_DEPTH_BUFFER_BIT);
-	sceneController.Draw(depthShader, currentFrame);
+	renderQueue.execute(PASS_SHADOW, depthShader);
+	sceneController.drawCrowds(PASS_SHADOW);
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
 	// reset viewport
@@ -407,27 +573,14 @@ void getDepthMap(Shader &depthShader, float &currentFrame, glm::mat4 &lightSpace
 
 }
 
-void showScence(Shader &shader, float &currentFrame, glm::mat4 &lightSpaceMatrix) {
+void showScence(Shader &shader) {
 	shader.use();
 	shader.setInt("gamma", gammaEnabled);
 	shader.setInt("shadowMap", 0);
-	shader.setVec3("light.direction", -lightPos[0], -lightPos[1], -lightPos[2]);
-	shader.setVec3("viewPos", camera.Position);
-
-	shader.setVec3("light.ambient", 0.5f, 0.5f, 0.5f);
-	shader.setVec3("light.diffuse", 1.0f, 1.0f, 1.0f);
-	shader.setVec3("light.specular", 1.0f, 1.0f, 1.0f);
-
-	// view/projection transformations
-	glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 10000.0f);
-	glm::mat4 view = camera.GetViewMatrix();
-	shader.setMat4("projection", projection);
-	shader.setMat4("view", view);
-	shader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, sceneController.depthMap);
-	sceneController.Draw(shader, currentFrame);
+	GLState::get().bindTexture(0, GL_TEXTURE_2D, sceneController.depthMap);
+	renderQueue.execute(PASS_MAIN, shader);
+	sceneController.drawCrowds(PASS_MAIN, gammaEnabled);
 
 	//FontRender::getInstance()->RenderCharacter('W', 25.0f, 25.0f, 1.0f, glm::vec3(1.0f, 0.0f, 0.0f));
 }
@@ -437,8 +590,7 @@ void showDepthMap(Shader &debugDepthQuad) {
 	debugDepthQuad.setInt("depthMap", 0);
 	debugDepthQuad.setFloat("near_plane", 0.1f);
 	debugDepthQuad.setFloat("far_plane", lightPan);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, sceneController.depthMap);
+	GLState::get().bindTexture(0, GL_TEXTURE_2D, sceneController.depthMap);
 	renderQuad();
 }
 
@@ -460,7 +612,7 @@ void renderQuad()
 		// setup plane VAO
 		glGenVertexArrays(1, &quadVAO);
 		glGenBuffers(1, &quadVBO);
-		glBindVertexArray(quadVAO);
+		GLState::get().bindVertexArray(quadVAO);
 		glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
 		glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
 		glEnableVertexAttribArray(0);
@@ -468,23 +620,20 @@ void renderQuad()
 		glEnableVertexAttribArray(1);
 		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
 	}
-	glBindVertexArray(quadVAO);
+	GLState::get().bindVertexArray(quadVAO);
 	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-	glBindVertexArray(0);
 }
 
 void showParticle(Shader &shader) {
 	shader.use();
-	glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 10000.0f);
-	glm::mat4 view = camera.GetViewMatrix();
-	shader.setMat4("projection", projection);
-	shader.setMat4("view", view);
-	shader.setFloat("scale", 10.0f);
+	const float particleScale = 10.0f;
+	shader.setFloat("scale", particleScale);
 	if (sceneController.isForwardShow) {
 		Particles->Update(0.01, *(sceneController.forwardBlackHole), 5, glm::vec3(0.0f));
 	}
 	else if (sceneController.isBackwardShow) {
 		Particles->Update(0.01, *(sceneController.backwardBlackHole), 5, glm::vec3(0.0f));
 	}
+	Particles->reportTextureUsage(camera.Position, glm::radians(camera.Zoom), (float)SCR_HEIGHT, particleScale);
 	Particles->Draw();
 }
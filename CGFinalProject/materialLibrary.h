@@ -0,0 +1,130 @@
+#ifndef MATERIAL_LIBRARY__H
+#define MATERIAL_LIBRARY__H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <iostream>
+#include <mutex>
+#include <vector>
+#include <string.h>
+
+#include <learnopengl/uniform_blocks.h>
+#include "ogldev_util.h"
+
+// must match MAX_MATERIALS in animatedModel.fs; 256 * 48 bytes stays below the 16 KB
+// every GL 3.3 implementation allows for a uniform block
+#define MAX_MATERIALS 256
+
+struct Material {
+	//ɫ
+	glm::vec4 Ka;
+	//
+	glm::vec4 Kd;
+	//
+	glm::vec4 Ks;
+	//ָ
+	float Ni;
+};
+
+// Every distinct Material of every loaded model, packed into one uniform buffer bound
+// at MATERIAL_TABLE_BINDING. Meshes register their material when they are built (on
+// the asset streamer's worker thread) and keep only the index; a draw then sets a
+// single int instead of four material uniforms, and meshes with different materials
+// can share a batch. Identical materials share one slot.
+// std140 layout of one slot, see MaterialTable in animatedModel.fs:
+//   vec4 ambient; vec4 diffuse; vec4 specular;   specular.w holds the shininess
+class MaterialLibrary
+{
+DISALLOW_COPY_AND_ASSIGN(MaterialLibrary)
+public:
+	// meshes are built on the worker thread, so the first call may come from there
+	static MaterialLibrary* getInstance() {
+		static MaterialLibrary library;
+		return &library;
+	}
+
+	// index of mat in the table; loader threads
+	unsigned int add(const Material& mat);
+	// send slots added since the last call; render thread, once per frame
+	void upload();
+
+	unsigned int size();
+	unsigned int requests();
+
+private:
+	struct Slot
+	{
+		glm::vec4 ambient;
+		glm::vec4 diffuse;
+		glm::vec4 specular;
+	};
+
+	MaterialLibrary();
+
+	std::mutex lock;
+	vector<Slot> slots;
+	unsigned int uploaded;
+	unsigned int requested;
+	GLuint buffer;
+};
+
+MaterialLibrary::MaterialLibrary()
+{
+	uploaded = 0;
+	requested = 0;
+	buffer = 0;
+}
+
+unsigned int MaterialLibrary::add(const Material& mat)
+{
+	Slot slot;
+	slot.ambient = glm::vec4(glm::vec3(mat.Ka), 0.0f);
+	slot.diffuse = glm::vec4(glm::vec3(mat.Kd), 0.0f);
+	slot.specular = glm::vec4(glm::vec3(mat.Ks), mat.Ni);
+
+	std::lock_guard<std::mutex> guard(lock);
+	requested++;
+	// load time only and at most MAX_MATERIALS entries, a linear search is fine
+	for (unsigned int i = 0; i < slots.size(); i++) {
+		if (memcmp(&slots[i], &slot, sizeof(Slot)) == 0)
+			return i;
+	}
+	if (slots.size() >= MAX_MATERIALS) {
+		std::cout << "ERROR::MATERIAL_LIBRARY:: more than " << MAX_MATERIALS << " materials, using material 0" << std::endl;
+		return 0;
+	}
+	slots.push_back(slot);
+	return slots.size() - 1;
+}
+
+void MaterialLibrary::upload()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	if (uploaded == slots.size())
+		return;
+	if (buffer == 0) {
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+		glBufferData(GL_UNIFORM_BUFFER, MAX_MATERIALS * sizeof(Slot), NULL, GL_STATIC_DRAW);
+		glBindBufferBase(GL_UNIFORM_BUFFER, MATERIAL_TABLE_BINDING, buffer);
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, uploaded * sizeof(Slot), (slots.size() - uploaded) * sizeof(Slot), &slots[uploaded]);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	uploaded = slots.size();
+}
+
+unsigned int MaterialLibrary::size()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return slots.size();
+}
+
+unsigned int MaterialLibrary::requests()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return requested;
+}
+
+#endif // !MATERIAL_LIBRARY__H
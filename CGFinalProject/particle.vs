@@ -1,18 +1,21 @@
 #version 330 core
 layout (location = 0) in vec4 vertex; // <vec2 position, vec2 texCoords>
+layout (location = 1) in vec4 offset;  // per instance
+layout (location = 2) in vec4 color;   // per instance
 
 out vec2 TexCoords;
 out vec4 ParticleColor;
 
-uniform mat4 projection;
-uniform mat4 view;
-uniform vec3 offset;
-uniform vec4 color;
+layout (std140) uniform ViewData {
+    mat4 view;
+    mat4 projection;
+    vec4 viewPos;
+};
 uniform float scale;
 
 void main()
 {
     TexCoords = vertex.zw;
     ParticleColor = color;
-    gl_Position = projection * view * vec4(vec3(vertex.xy * scale, 0.0) + offset, 1.0);
+    gl_Position = projection * view * vec4(vec3(vertex.xy * scale, 0.0) + offset.xyz, 1.0);
 }
\ No newline at end of file
@@ -13,6 +13,8 @@
 #include "util.h"
 #include "spirit.h"
 #include <learnopengl/shader.h>
+#include <learnopengl/gl_state.h>
+#include <learnopengl/stream_buffer.h>
 
 // Represents a single particle and its state
 struct Particle {
@@ -23,6 +25,12 @@ struct Particle {
 	Particle() : Position(0.0f), Velocity(0.0f), Color(1.0f), Life(0.0f) { }
 };
 
+// Per-instance vertex data of a live particle, streamed every frame
+struct ParticleInstance {
+	glm::vec4 Position;    // w unused
+	glm::vec4 Color;
+};
+
 
 // ParticleGenerator acts as a container for rendering a large number of 
 // particles by repeatedly spawning and updating particles and killing 
@@ -32,10 +40,16 @@ class ParticleGenerator
 public:
 	// Constructor
 	ParticleGenerator(Shader shader, unsigned int texture, GLuint amount);
+	// Gives the sprite back to the TextureRegistry
+	~ParticleGenerator();
 	// Update all particles
 	void Update(GLfloat dt, Spirit &object, GLuint newParticles, glm::vec3 offset = glm::vec3(0.0f, 0.0f, 0.0f));
 	// Render all particles
 	void Draw();
+	// Supply the sprite once it has been streamed in; nothing is drawn before that
+	void setTexture(unsigned int texture) { this->texture = texture; }
+	// Report the on-screen size of the closest live particle to the TextureStreamer
+	void reportTextureUsage(glm::vec3 viewPos, float fovY, float viewportHeight, float scale);
 private:
 	// State
 	std::vector<Particle> particles;
@@ -58,6 +72,11 @@ ParticleGenerator::ParticleGenerator(Shader shader, unsigned int texture, GLuint
 	this->init();
 }
 
+ParticleGenerator::~ParticleGenerator()
+{
+	TextureRegistry::get().release(this->texture);
+}
+
 void ParticleGenerator::Update(GLfloat dt, Spirit &object, GLuint newParticles, glm::vec3 offset)
 {
 	// Add new particles 
@@ -82,25 +101,62 @@ void ParticleGenerator::Update(GLfloat dt, Spirit &object, GLuint newParticles,
 // Render all particles
 void ParticleGenerator::Draw()
 {
-	// Use additive blending to give it a 'glow' effect
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-	this->shader.use();
-	for (Particle particle : this->particles)
+	if (this->texture == 0)
+		return;
+	GLuint live = 0;
+	for (const Particle &particle : this->particles)
+		if (particle.Life > 0.0f)
+			live++;
+	if (live == 0)
+		return;
+	// Write the live particles into the vertex stream, then draw them all as instances
+	StreamBuffer &stream = StreamBuffers::get().vertex;
+	GLintptr offset;
+	ParticleInstance *instances = (ParticleInstance*)stream.map(live * sizeof(ParticleInstance), offset);
+	if (!instances)
+		return;
+	for (const Particle &particle : this->particles)
 	{
 		if (particle.Life > 0.0f)
 		{
-			this->shader.setVec3("offset", particle.Position);
-			this->shader.setVec4("color", particle.Color);
-			this->shader.setInt("sprite", 0);
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, this->texture);
-			glBindVertexArray(this->VAO);
-			glDrawArrays(GL_TRIANGLES, 0, 6);
-			glBindVertexArray(0);
+			instances->Position = glm::vec4(particle.Position, 1.0f);
+			instances->Color = particle.Color;
+			instances++;
 		}
 	}
+	stream.unmap();
+	// Use additive blending to give it a 'glow' effect
+	GLState &state = GLState::get();
+	state.blendFunc(GL_SRC_ALPHA, GL_ONE);
+	this->shader.use();
+	// Sprite and quad are the same for every particle
+	this->shader.setInt("sprite", 0);
+	state.bindTexture(0, GL_TEXTURE_2D, this->texture);
+	state.bindVertexArray(this->VAO);
+	// No base instance in GL 3.3, so the instance attributes are pointed at this frame's range
+	glBindBuffer(GL_ARRAY_BUFFER, stream.getBuffer());
+	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(ParticleInstance), (GLvoid*)offset);
+	glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(ParticleInstance), (GLvoid*)(offset + sizeof(glm::vec4)));
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glDrawArraysInstanced(GL_TRIANGLES, 0, 6, live);
 	// Don't forget to reset to default blending mode
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	state.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+void ParticleGenerator::reportTextureUsage(glm::vec3 viewPos, float fovY, float viewportHeight, float scale)
+{
+	float nearest = -1.0f;
+	for (GLuint i = 0; i < this->amount; ++i)
+	{
+		if (this->particles[i].Life > 0.0f)
+		{
+			float distance = glm::length(this->particles[i].Position - viewPos);
+			if (nearest < 0.0f || distance < nearest)
+				nearest = distance;
+		}
+	}
+	if (nearest >= 0.0f)
+		TextureStreamer::get().reportUsage(this->texture, TextureStreamer::projectedSize(scale, nearest, fovY, viewportHeight));
 }
 
 void ParticleGenerator::init()
@@ -118,14 +174,19 @@ void ParticleGenerator::init()
 	};
 	glGenVertexArrays(1, &this->VAO);
 	glGenBuffers(1, &VBO);
-	glBindVertexArray(this->VAO);
+	GLState::get().bindVertexArray(this->VAO);
 	// Fill mesh buffer
 	glBindBuffer(GL_ARRAY_BUFFER, VBO);
 	glBufferData(GL_ARRAY_BUFFER, sizeof(particle_quad), particle_quad, GL_STATIC_DRAW);
 	// Set mesh attributes
 	glEnableVertexAttribArray(0);
 	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (GLvoid*)0);
-	glBindVertexArray(0);
+	// Instance attributes: position and color, sourced from the vertex stream in Draw()
+	glEnableVertexAttribArray(1);
+	glVertexAttribDivisor(1, 1);
+	glEnableVertexAttribArray(2);
+	glVertexAttribDivisor(2, 1);
+	GLState::get().bindVertexArray(0);
 
 	// Create this->amount default particle instances
 	for (GLuint i = 0; i < this->amount; ++i)
@@ -0,0 +1,568 @@
+#ifndef RENDER_QUEUE__H
+#define RENDER_QUEUE__H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <vector>
+
+#include <learnopengl/shader.h>
+#include <learnopengl/gl_state.h>
+#include <learnopengl/stream_buffer.h>
+#include "AnimatedMesh.h"
+#include "frustum.h"
+#include "hiZ.h"
+#include "skinningCache.h"
+#include "math_3d.h"
+#include "ogldev_util.h"
+
+enum RenderPass
+{
+	PASS_SHADOW = 0,
+	PASS_MAIN = 1,
+	PASS_COUNT
+};
+
+#define PASS_BIT(pass) (1u << (pass))
+#define PASS_ALL ((1u << PASS_COUNT) - 1)
+#define NO_PALETTE 0xffffffffu
+// texture unit of the bone palette buffer texture
+#define BONE_PALETTE_UNIT 1
+
+// Draw list for one frame.
+// The scene is walked once (SceneController::collect) and every visible mesh becomes a
+// DrawItem: mesh, model matrix, bone palette and the passes it takes part in. Bone
+// palettes are evaluated once per pose per frame; before the first pass all of them are
+// streamed back to back into the texel StreamBuffer, which the shaders read through one
+// buffer texture, starting at a per-draw or per-instance palette base. Each pass
+// then sorts its own DrawPackets by a 64-bit key and replays them, so consecutive draws
+// share program, material and VAO as much as possible:
+//   63..62 pass | 61..48 program | 47..32 material | 31..16 vertex array | 15..0 group
+// A group is a run of submits with the same model matrix and palette, i.e. one model.
+// Packets with equal keys differ only in their mesh; as GeometryArena meshes share a
+// VAO, each such run goes out as one glMultiDrawElementsBaseVertex. The model matrix
+// (attributes 4-7) and palette base (attribute 8) are constants per run, or for
+// submitInstanced() items instanced arrays streamed once per frame, so a crowd of
+// skinned copies in different poses is still one glDrawElementsInstanced.
+// Before a pass runs, cull() drops the items outside that pass's frustum: the world
+// space bounding spheres of all items are tested four at a time, survivors are then
+// checked with their world space box. Skinned items (with a bone palette) are culled
+// only when submitted with the box of their pose (AnimatedMesh::posedBounds()), their
+// bind-pose bounds do not hold once the bones move. occlude() then drops
+// main pass items hidden behind the previous frame's depth, see HiZ.
+// With pre-skinning on, the skinned single draws that survived culling are skinned once
+// for all passes before the first one (see SkinningCache) and drawn as static geometry.
+class RenderQueue
+{
+DISALLOW_COPY_AND_ASSIGN(RenderQueue)
+public:
+	struct DrawItem
+	{
+		AnimatedMesh* mesh;
+		glm::mat4 model;
+		unsigned int palette;      // index of the frame's palette, or NO_PALETTE; for
+		                           // instanced items any one of theirs
+		unsigned int paletteSize;
+		unsigned int passMask;
+		unsigned int material;     // MaterialLibrary index
+		unsigned int group;        // same model matrix and palette
+		unsigned int instances;    // 0 for a single draw with model
+		unsigned int firstInstance;  // in the frame's instance matrices
+		GLuint vertexArray;        // the mesh's, or the SkinningCache's once pre-skinned
+		GLint skinnedVertex;       // first vertex in the SkinningCache, -1 if not pre-skinned
+		bool cullable;
+		glm::vec3 boundsMin;       // world space box, of all instances
+		glm::vec3 boundsMax;
+	};
+
+	struct DrawPacket
+	{
+		unsigned long long key;
+		unsigned int item;
+		bool operator<(const DrawPacket& other) const { return key < other.key; }
+	};
+
+	struct Stats
+	{
+		unsigned int items;
+		unsigned int packets;
+		unsigned int paletteUploads;  // palettes streamed
+		unsigned int drawCalls;
+		unsigned int instances;    // drawn by instanced calls, all passes
+		unsigned int tested[PASS_COUNT];
+		unsigned int culled[PASS_COUNT];
+		unsigned int occluded;     // part of culled[PASS_MAIN]
+	};
+
+	RenderQueue();
+
+	// start a new frame: drops last frame's items and palettes
+	void clear();
+	// copy a bone palette into the frame storage; returns its index for submit()
+	unsigned int addPalette(const vector<Matrix4f>& transforms);
+	// a palette already in this frame's texel StreamBuffer (see GpuAnimator), by its first texel
+	unsigned int addStreamedPalette(GLint texel);
+	// poseBounds, if given, is the model space box (min, max) of mesh in the pose of palette
+	void submit(AnimatedMesh* mesh, const glm::mat4& model, unsigned int palette, unsigned int paletteSize,
+		unsigned int passMask = PASS_ALL, const glm::vec3* poseBounds = NULL);
+	// count copies of mesh drawn by a single instanced call per pass; palettes holds one
+	// palette per copy, NULL for a static mesh. Skinned copies are culled only when
+	// worldBounds, the world space box (min, max) around all of them posed, is given.
+	void submitInstanced(AnimatedMesh* mesh, const glm::mat4* models, const unsigned int* palettes, unsigned int count,
+		unsigned int passMask = PASS_ALL, const glm::vec3* worldBounds = NULL);
+	// hide the items of pass that are outside frustum; without it everything is drawn
+	void cull(RenderPass pass, const Frustum& frustum);
+	// hide the main pass items that survived cull() but are occluded; shadows still need them
+	void occlude(const HiZ& hiZ);
+	// sort and draw everything submitted for pass with shader
+	void execute(RenderPass pass, Shader& shader);
+
+	const Stats& getStats() const { return stats; }
+	const SkinningCache::Stats& getSkinningStats() const { return skinning.getStats(); }
+	// skin each posed mesh once per frame instead of once per pass
+	void setPreSkinning(bool enabled) { preSkinning = enabled; }
+
+	// stream one palette outside the queue and point the following draws of shader at it
+	static void bindPalette(Shader& shader, const Matrix4f* transforms, unsigned int count);
+	// world space box around a model space box
+	static void worldBox(const glm::vec3& localMin, const glm::vec3& localMax, const glm::mat4& model,
+		glm::vec3& boxMin, glm::vec3& boxMax);
+
+private:
+	// write every palette and instance of the frame into the streams, once for all passes
+	void streamFrameData();
+	// run the visible skinned single draws through the SkinningCache
+	void preSkin();
+	// first texel of palette in the buffer texture, once streamed; -1 when it did not fit
+	GLint paletteBase(unsigned int palette) const;
+	// buffer texture over the texel StreamBuffer, bound to BONE_PALETTE_UNIT for shader
+	static void bindPaletteTexture(Shader& shader);
+
+	vector<DrawItem> items;
+	vector<DrawPacket> packets;
+	vector<Matrix4f> palettes;
+	vector<unsigned int> paletteFirst;  // first matrix of each palette in palettes, or
+	                                    // NO_PALETTE when it was streamed by someone else
+	vector<GLint> paletteTexels;        // first texel of those
+	unsigned int cpuPalettes;
+	GLintptr paletteOffset;    // of palettes in the texel StreamBuffer
+	vector<glm::mat4> instanceModels;
+	vector<unsigned int> instancePalettes;
+	vector<GLint> instanceBases;  // palette base per instance, for streaming
+	GLintptr instanceOffset;   // of instanceModels in the vertex StreamBuffer
+	GLintptr instanceBaseOffset;  // of instanceBases
+	bool frameDataStreamed;
+	unsigned int groups;
+	SkinningCache skinning;
+	bool preSkinning;
+	// per run scratch for glMultiDrawElementsBaseVertex
+	vector<GLsizei> runCounts;
+	vector<const GLvoid*> runOffsets;
+	vector<GLint> runBaseVertices;
+	// world space bounding spheres of the items, structure of arrays for Frustum::cullSpheres
+	vector<float> sphereX, sphereY, sphereZ, sphereRadius;
+	vector<unsigned char> visible[PASS_COUNT];
+	Stats stats;
+};
+
+RenderQueue::RenderQueue()
+{
+	preSkinning = true;
+	clear();
+}
+
+void RenderQueue::clear()
+{
+	items.clear();
+	palettes.clear();
+	paletteFirst.clear();
+	paletteTexels.clear();
+	cpuPalettes = 0;
+	paletteOffset = -1;
+	instanceModels.clear();
+	instancePalettes.clear();
+	instanceOffset = -1;
+	instanceBaseOffset = -1;
+	frameDataStreamed = false;
+	skinning.clear();
+	sphereX.clear();
+	sphereY.clear();
+	sphereZ.clear();
+	sphereRadius.clear();
+	stats.items = 0;
+	stats.packets = 0;
+	stats.paletteUploads = 0;
+	stats.drawCalls = 0;
+	stats.instances = 0;
+	groups = 0;
+	stats.occluded = 0;
+	for (unsigned int pass = 0; pass < PASS_COUNT; pass++) {
+		visible[pass].clear();
+		stats.tested[pass] = 0;
+		stats.culled[pass] = 0;
+	}
+}
+
+unsigned int RenderQueue::addPalette(const vector<Matrix4f>& transforms)
+{
+	if (transforms.empty())
+		return NO_PALETTE;
+	paletteFirst.push_back(palettes.size());
+	paletteTexels.push_back(-1);
+	palettes.insert(palettes.end(), transforms.begin(), transforms.end());
+	cpuPalettes++;
+	return paletteFirst.size() - 1;
+}
+
+unsigned int RenderQueue::addStreamedPalette(GLint texel)
+{
+	paletteFirst.push_back(NO_PALETTE);
+	paletteTexels.push_back(texel);
+	return paletteFirst.size() - 1;
+}
+
+void RenderQueue::streamFrameData()
+{
+	StreamBuffers& streams = StreamBuffers::get();
+	if (!palettes.empty()) {
+		paletteOffset = streams.texel.write(&palettes[0], palettes.size() * sizeof(Matrix4f));
+		stats.paletteUploads += cpuPalettes;
+	}
+	if (!instanceModels.empty()) {
+		instanceOffset = streams.vertex.write(&instanceModels[0], instanceModels.size() * sizeof(glm::mat4));
+		instanceBases.resize(instancePalettes.size());
+		for (unsigned int i = 0; i < instancePalettes.size(); i++)
+			instanceBases[i] = paletteBase(instancePalettes[i]);
+		instanceBaseOffset = streams.vertex.write(&instanceBases[0], instanceBases.size() * sizeof(GLint));
+	}
+	if (preSkinning && !paletteFirst.empty())
+		preSkin();
+	frameDataStreamed = true;
+}
+
+void RenderQueue::preSkin()
+{
+	Shader& program = skinning.getProgram();
+	program.use();
+	bindPaletteTexture(program);
+	for (unsigned int i = 0; i < items.size(); i++) {
+		DrawItem& item = items[i];
+		if (item.instances > 0 || item.palette == NO_PALETTE)
+			continue;
+		// skip what every pass it takes part in has culled
+		bool drawn = false;
+		for (unsigned int pass = 0; pass < PASS_COUNT && !drawn; pass++)
+			drawn = (item.passMask & PASS_BIT(pass)) && (visible[pass].empty() || visible[pass][i]);
+		if (!drawn)
+			continue;
+		GLint base = paletteBase(item.palette);
+		if (base < 0)
+			continue;
+		item.skinnedVertex = skinning.skin(item.mesh, item.model, base);
+		if (item.skinnedVertex >= 0)
+			item.vertexArray = skinning.vertexArray(item.mesh->getIndexBuffer());
+	}
+	skinning.finish();
+}
+
+GLint RenderQueue::paletteBase(unsigned int palette) const
+{
+	if (palette == NO_PALETTE)
+		return 0;
+	if (paletteFirst[palette] == NO_PALETTE)
+		return paletteTexels[palette];
+	if (paletteOffset < 0)
+		return -1;
+	// one texel is four floats, one Matrix4f four texels
+	return (GLint)(paletteOffset / (4 * sizeof(float)) + paletteFirst[palette] * 4);
+}
+
+void RenderQueue::bindPaletteTexture(Shader& shader)
+{
+	static GLuint texture = 0;
+	if (texture == 0) {
+		glGenTextures(1, &texture);
+		GLState::get().bindTexture(BONE_PALETTE_UNIT, GL_TEXTURE_BUFFER, texture);
+		// follows the ring when it grows, which keeps the buffer name
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, StreamBuffers::get().texel.getBuffer());
+	}
+	GLState::get().bindTexture(BONE_PALETTE_UNIT, GL_TEXTURE_BUFFER, texture);
+	shader.setInt("bonePalette", BONE_PALETTE_UNIT);
+}
+
+void RenderQueue::bindPalette(Shader& shader, const Matrix4f* transforms, unsigned int count)
+{
+	GLintptr offset = StreamBuffers::get().texel.write(transforms, count * sizeof(Matrix4f));
+	if (offset < 0)
+		return;
+	bindPaletteTexture(shader);
+	AnimatedMesh::setPaletteBase((GLint)(offset / (4 * sizeof(float))));
+}
+
+void RenderQueue::submit(AnimatedMesh* mesh, const glm::mat4& model, unsigned int palette, unsigned int paletteSize,
+	unsigned int passMask, const glm::vec3* poseBounds)
+{
+	DrawItem item;
+	item.mesh = mesh;
+	item.model = model;
+	item.palette = palette;
+	item.paletteSize = paletteSize;
+	item.passMask = passMask;
+	item.material = mesh->materialIndex;
+	if (!items.empty() && items.back().instances == 0 && items.back().palette == palette && items.back().model == model)
+		item.group = items.back().group;
+	else
+		item.group = groups++;
+	item.instances = 0;
+	item.firstInstance = 0;
+	item.vertexArray = mesh->VAO;
+	item.skinnedVertex = -1;
+	item.cullable = palette == NO_PALETTE || poseBounds != NULL;
+	if (poseBounds)
+		worldBox(poseBounds[0], poseBounds[1], model, item.boundsMin, item.boundsMax);
+	else
+		worldBox(mesh->aabbMin, mesh->aabbMax, model, item.boundsMin, item.boundsMax);
+	items.push_back(item);
+
+	// sphere: radius grows with the largest axis scale; a posed mesh gets the one around its box
+	glm::vec3 sphereCenter = glm::vec3(model * glm::vec4(mesh->sphereCenter, 1.0f));
+	float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])),
+		glm::length(glm::vec3(model[2]))));
+	float radius = mesh->sphereRadius * scale;
+	if (poseBounds) {
+		sphereCenter = (item.boundsMin + item.boundsMax) * 0.5f;
+		radius = glm::length(item.boundsMax - sphereCenter);
+	}
+	sphereX.push_back(sphereCenter.x);
+	sphereY.push_back(sphereCenter.y);
+	sphereZ.push_back(sphereCenter.z);
+	sphereRadius.push_back(item.cullable ? radius : FLT_MAX);
+	stats.items++;
+}
+
+void RenderQueue::submitInstanced(AnimatedMesh* mesh, const glm::mat4* models, const unsigned int* palettes,
+	unsigned int count, unsigned int passMask, const glm::vec3* worldBounds)
+{
+	if (count == 0)
+		return;
+	DrawItem item;
+	item.mesh = mesh;
+	item.model = models[0];
+	item.palette = palettes ? palettes[0] : NO_PALETTE;
+	item.paletteSize = 0;
+	item.passMask = passMask;
+	item.material = mesh->materialIndex;
+	// never merged into a multi-draw run
+	item.group = groups++;
+	item.instances = count;
+	item.firstInstance = instanceModels.size();
+	item.vertexArray = mesh->VAO;
+	item.skinnedVertex = -1;
+	item.cullable = palettes == NULL || worldBounds != NULL;
+	instanceModels.insert(instanceModels.end(), models, models + count);
+	if (palettes)
+		instancePalettes.insert(instancePalettes.end(), palettes, palettes + count);
+	else
+		instancePalettes.insert(instancePalettes.end(), count, NO_PALETTE);
+
+	// culled as a whole, by the box around all copies
+	item.boundsMin = glm::vec3(FLT_MAX);
+	item.boundsMax = glm::vec3(-FLT_MAX);
+	if (worldBounds) {
+		item.boundsMin = worldBounds[0];
+		item.boundsMax = worldBounds[1];
+	}
+	else {
+		for (unsigned int i = 0; i < count; i++) {
+			glm::vec3 boxMin, boxMax;
+			worldBox(mesh->aabbMin, mesh->aabbMax, models[i], boxMin, boxMax);
+			item.boundsMin = glm::min(item.boundsMin, boxMin);
+			item.boundsMax = glm::max(item.boundsMax, boxMax);
+		}
+	}
+	items.push_back(item);
+
+	glm::vec3 sphereCenter = (item.boundsMin + item.boundsMax) * 0.5f;
+	sphereX.push_back(sphereCenter.x);
+	sphereY.push_back(sphereCenter.y);
+	sphereZ.push_back(sphereCenter.z);
+	sphereRadius.push_back(item.cullable ? glm::length(item.boundsMax - sphereCenter) : FLT_MAX);
+	stats.items++;
+}
+
+// transformed centre plus the extent projected on the world axes
+void RenderQueue::worldBox(const glm::vec3& localMin, const glm::vec3& localMax, const glm::mat4& model,
+	glm::vec3& boxMin, glm::vec3& boxMax)
+{
+	glm::vec3 center = (localMin + localMax) * 0.5f;
+	glm::vec3 extent = (localMax - localMin) * 0.5f;
+	glm::vec3 worldCenter = glm::vec3(model * glm::vec4(center, 1.0f));
+	glm::vec3 worldExtent;
+	for (unsigned int axis = 0; axis < 3; axis++) {
+		worldExtent[axis] = fabsf(model[0][axis]) * extent.x + fabsf(model[1][axis]) * extent.y
+			+ fabsf(model[2][axis]) * extent.z;
+	}
+	boxMin = worldCenter - worldExtent;
+	boxMax = worldCenter + worldExtent;
+}
+
+void RenderQueue::cull(RenderPass pass, const Frustum& frustum)
+{
+	vector<unsigned char>& passVisible = visible[pass];
+	passVisible.resize(items.size());
+	if (items.empty())
+		return;
+	frustum.cullSpheres(&sphereX[0], &sphereY[0], &sphereZ[0], &sphereRadius[0], items.size(), &passVisible[0]);
+	for (unsigned int i = 0; i < items.size(); i++) {
+		const DrawItem& item = items[i];
+		if (!(item.passMask & PASS_BIT(pass)))
+			continue;
+		stats.tested[pass]++;
+		if (passVisible[i] && item.cullable && !frustum.testAABB(item.boundsMin, item.boundsMax))
+			passVisible[i] = 0;
+		if (!passVisible[i])
+			stats.culled[pass]++;
+	}
+}
+
+void RenderQueue::occlude(const HiZ& hiZ)
+{
+	vector<unsigned char>& passVisible = visible[PASS_MAIN];
+	if (!hiZ.isUsable() || passVisible.empty())
+		return;
+	for (unsigned int i = 0; i < items.size(); i++) {
+		const DrawItem& item = items[i];
+		if (!passVisible[i] || !item.cullable || !(item.passMask & PASS_BIT(PASS_MAIN)))
+			continue;
+		if (hiZ.isOccluded(item.boundsMin, item.boundsMax)) {
+			passVisible[i] = 0;
+			stats.culled[PASS_MAIN]++;
+			stats.occluded++;
+		}
+	}
+}
+
+void RenderQueue::execute(RenderPass pass, Shader& shader)
+{
+	// depth-only passes ignore materials, so they sort and batch by VAO and group alone
+	bool useMaterial = pass != PASS_SHADOW;
+	unsigned long long passBits = (unsigned long long)pass << 62;
+	unsigned long long programBits = (unsigned long long)(shader.ID & 0x3fff) << 48;
+
+	// pre-skinning decides the VAO of skinned items, which is part of the key
+	if (!frameDataStreamed)
+		streamFrameData();
+
+	const vector<unsigned char>& passVisible = visible[pass];
+	packets.clear();
+	for (unsigned int i = 0; i < items.size(); i++) {
+		const DrawItem& item = items[i];
+		if (!(item.passMask & PASS_BIT(pass)))
+			continue;
+		if (!passVisible.empty() && !passVisible[i])
+			continue;
+		DrawPacket packet;
+		packet.key = passBits | programBits
+			| (useMaterial ? (unsigned long long)(item.material & 0xffff) << 32 : 0)
+			| (unsigned long long)(item.vertexArray & 0xffff) << 16
+			| (item.group & 0xffff);
+		packet.item = i;
+		packets.push_back(packet);
+	}
+	std::sort(packets.begin(), packets.end());
+	stats.packets += packets.size();
+
+	shader.use();
+	bindPaletteTexture(shader);
+	unsigned int currentPalette = NO_PALETTE;
+	// whether the constant bone ID and weight attributes hold setStaticBones()' values
+	bool staticBones = false;
+	for (unsigned int first = 0; first < packets.size(); ) {
+		const DrawItem& item = items[packets[first].item];
+		// the run of packets that only differ in their mesh
+		unsigned int end = first + 1;
+		while (end < packets.size() && packets[end].key == packets[first].key && items[packets[end].item].group == item.group)
+			end++;
+
+		bool skinned = item.skinnedVertex >= 0;
+		if (item.instances == 0 && !skinned && item.palette != NO_PALETTE && item.palette != currentPalette) {
+			GLint base = paletteBase(item.palette);
+			// the palettes did not fit the texel stream this frame
+			if (base < 0) {
+				first = end;
+				continue;
+			}
+			AnimatedMesh::setPaletteBase(base);
+			currentPalette = item.palette;
+		}
+		if (useMaterial)
+			item.mesh->setMaterial(shader);
+		stats.drawCalls++;
+		if (item.instances > 0) {
+			bool palettesStreamed = item.palette == NO_PALETTE
+				|| (instanceBaseOffset >= 0 && paletteBase(instancePalettes[item.firstInstance]) >= 0);
+			if (instanceOffset >= 0 && palettesStreamed) {
+				GLintptr baseOffset = item.palette != NO_PALETTE && instanceBaseOffset >= 0
+					? instanceBaseOffset + item.firstInstance * sizeof(GLint) : -1;
+				// per instance models have no normal matrix uniform
+				shader.setBool("instanced", true);
+				item.mesh->drawInstanced(StreamBuffers::get().vertex.getBuffer(),
+					instanceOffset + item.firstInstance * sizeof(glm::mat4), baseOffset, item.instances);
+				shader.setBool("instanced", false);
+				stats.instances += item.instances;
+				// the copies' palette bases came from the array; later draws must set theirs again
+				currentPalette = NO_PALETTE;
+			}
+			else {
+				// the instance attributes did not fit the vertex stream, or the palettes
+				// the texel stream: one draw per copy
+				for (unsigned int k = item.firstInstance; k < item.firstInstance + item.instances; k++) {
+					if (item.palette != NO_PALETTE) {
+						GLint base = paletteBase(instancePalettes[k]);
+						if (base < 0)
+							continue;
+						AnimatedMesh::setPaletteBase(base);
+					}
+					AnimatedMesh::setModel(shader, instanceModels[k]);
+					item.mesh->drawElements();
+				}
+				currentPalette = NO_PALETTE;
+			}
+		}
+		else if (end - first == 1 && !skinned) {
+			AnimatedMesh::setModel(shader, item.model);
+			item.mesh->drawElements();
+		}
+		else {
+			runCounts.clear();
+			runOffsets.clear();
+			runBaseVertices.clear();
+			for (unsigned int i = first; i < end; i++) {
+				const DrawItem& runItem = items[packets[i].item];
+				runCounts.push_back(runItem.mesh->indices.size());
+				runOffsets.push_back(runItem.mesh->indexOffset());
+				runBaseVertices.push_back(skinned ? runItem.skinnedVertex : runItem.mesh->baseVertex);
+			}
+			// pre-skinned vertices are in world space already
+			if (skinned) {
+				if (!staticBones)
+					SkinningCache::setStaticBones();
+				staticBones = true;
+				AnimatedMesh::setModel(shader, glm::mat4(1.0f), glm::mat3(1.0f));
+			}
+			else
+				AnimatedMesh::setModel(shader, item.model);
+			GLState::get().bindVertexArray(item.vertexArray);
+			glMultiDrawElementsBaseVertex(GL_TRIANGLES, &runCounts[0], GL_UNSIGNED_INT, &runOffsets[0],
+				end - first, &runBaseVertices[0]);
+		}
+		// draws through a mesh VAO leave the constant bone attributes undefined
+		if (!skinned)
+			staticBones = false;
+		first = end;
+	}
+}
+
+#endif // !RENDER_QUEUE__H
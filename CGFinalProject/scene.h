@@ -2,34 +2,145 @@
 #define SCENE__H
 
 #include "spirit.h"
+#include "instancedSpiritGroup.h"
+#include "vatCrowd.h"
+#include "bvh.h"
 #include <vector>
 
+// Characters are kept in a BVH over their world bounds. update() refits it from the
+// current transforms (a reinsert only happens once a character leaves its fat box),
+// collect() then queues only the characters inside each pass's frustum. Animated
+// characters and those whose bounds are still unknown stay out of the tree and are
+// always queued; the queue culls animated ones by the box of their pose. Repeated
+// models live in InstancedSpiritGroups, which cull their own copies, and background
+// crowds in VATCrowds, which bypass the queue and are drawn by drawCrowds() after it.
 class Scene
 {
 public:
 	~Scene();
-	void Draw(Shader shader, float time);
+	// refit the tree to this frame's transforms and streaming state
+	void update();
+	void collect(RenderQueue& queue, float time, const Frustum frusta[PASS_COUNT]);
 	void addCharacter(std::string Path, glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3 scale = glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3 angles = glm::vec3(0.0f, 0.0f, 0.0f));
+	// one model drawn many times; fill it with addInstance()
+	InstancedSpiritGroup* addGroup(std::string Path);
+	// baked crowd of one animated model; fill it with addInstance()
+	VATCrowd* addCrowd(std::string Path, unsigned int frames = VAT_DEFAULT_FRAMES);
+	// the crowds culled by collect() that pass sees
+	void drawCrowds(RenderPass pass, bool gamma);
+	// first character in the tree whose box the ray enters, or NULL
+	Spirit* pick(const glm::vec3& origin, const glm::vec3& direction, float maxDistance = FLT_MAX) const;
+	// character in the tree whose box is closest to point, or NULL
+	Spirit* nearest(const glm::vec3& point) const;
 private:
 	vector<Spirit*> allCharacters;
+	vector<InstancedSpiritGroup*> allGroups;
+	vector<VATCrowd*> allCrowds;
+	// tree proxy of each character, BVH_NULL_NODE when it is not in the tree
+	vector<int> proxies;
+	BVH<unsigned int> tree;
+	// per frame scratch
+	vector<unsigned int> passMasks;
+	vector<unsigned int> hits;
 };
 
-void Scene::Draw(Shader shader, float time)
+void Scene::update()
 {
-	for (auto & ch : allCharacters) {
-		ch->Draw(shader, time);
+	for (unsigned int i = 0; i < allCharacters.size(); i++) {
+		glm::vec3 boxMin, boxMax;
+		bool bounded = !allCharacters[i]->isAnimated() && allCharacters[i]->worldBounds(boxMin, boxMax);
+		if (!bounded) {
+			if (proxies[i] != BVH_NULL_NODE) {
+				tree.remove(proxies[i]);
+				proxies[i] = BVH_NULL_NODE;
+			}
+		}
+		else if (proxies[i] == BVH_NULL_NODE) {
+			proxies[i] = tree.insert(boxMin, boxMax, i);
+		}
+		else {
+			tree.move(proxies[i], boxMin, boxMax);
+		}
+	}
+}
+
+void Scene::collect(RenderQueue& queue, float time, const Frustum frusta[PASS_COUNT])
+{
+	passMasks.assign(allCharacters.size(), 0);
+	for (unsigned int pass = 0; pass < PASS_COUNT; pass++) {
+		hits.clear();
+		tree.queryFrustum(frusta[pass], hits);
+		for (auto index : hits) {
+			passMasks[index] |= PASS_BIT(pass);
+		}
+	}
+	for (unsigned int i = 0; i < allCharacters.size(); i++) {
+		unsigned int passMask = proxies[i] == BVH_NULL_NODE ? PASS_ALL : passMasks[i];
+		if (passMask) {
+			allCharacters[i]->collect(queue, time, passMask);
+		}
+	}
+	for (auto group : allGroups) {
+		group->collect(queue, time, frusta);
+	}
+	for (auto crowd : allCrowds) {
+		crowd->cull(frusta);
 	}
 }
 
 void Scene::addCharacter(std::string Path, glm::vec3 position, glm::vec3 scale, glm::vec3 angles)
 {
-	allCharacters.push_back(new Spirit(Path, position, scale, angles));
+	allCharacters.push_back(new Spirit(Path, position, scale, angles, true));
+	proxies.push_back(BVH_NULL_NODE);
+}
+
+InstancedSpiritGroup* Scene::addGroup(std::string Path)
+{
+	allGroups.push_back(new InstancedSpiritGroup(Path));
+	return allGroups.back();
+}
+
+VATCrowd* Scene::addCrowd(std::string Path, unsigned int frames)
+{
+	allCrowds.push_back(new VATCrowd(Path, frames));
+	return allCrowds.back();
+}
+
+void Scene::drawCrowds(RenderPass pass, bool gamma)
+{
+	for (auto crowd : allCrowds) {
+		crowd->draw(pass, gamma);
+	}
+}
+
+Spirit* Scene::pick(const glm::vec3& origin, const glm::vec3& direction, float maxDistance) const
+{
+	unsigned int index;
+	float distance;
+	if (!tree.raycast(origin, direction, maxDistance, index, distance))
+		return NULL;
+	return allCharacters[index];
+}
+
+Spirit* Scene::nearest(const glm::vec3& point) const
+{
+	unsigned int index;
+	float distance;
+	if (!tree.nearest(point, index, distance))
+		return NULL;
+	return allCharacters[index];
 }
 
 Scene::~Scene() {
 	for (auto &ch : allCharacters) {
 		delete ch;
 	}
+	for (auto &group : allGroups) {
+		delete group;
+	}
+	for (auto &crowd : allCrowds) {
+		delete crowd;
+	}
 }
 
 
@@ -12,7 +12,12 @@ DISALLOW_COPY_AND_ASSIGN(SceneController)
 public:
 	SceneController();
 	~SceneController();
-	void Draw(Shader shader, float time);
+	// walk the active scene once and queue its draws for every pass; frusta are indexed by RenderPass
+	void collect(RenderQueue& queue, float time, const Frustum frusta[PASS_COUNT]);
+	// the active scene's baked crowds, after the queue has drawn pass
+	void drawCrowds(RenderPass pass, bool gamma = false);
+	// key press overlay, drawn after the 3D passes
+	void drawOverlay();
 	void init();
 	float blackHoleSensitivity;
 	Spirit* forwardBlackHole;
@@ -31,7 +36,11 @@ private:
 	void initSceneNow();
 	vector<Scene*> allScenes;
 	int sceneIndex;
-	bool blackHoleDistancePreEstimate(const glm::vec3& holePos) const;
+	// black holes that switch scenes when the plane flies into them
+	BVH<Spirit*> triggers;
+	int forwardTrigger;
+	int backwardTrigger;
+	vector<Spirit*> triggerHits;
 
 	// 用于当前按钮显示
 	FontRender* fontRender;
@@ -44,9 +53,12 @@ inline void SceneController::init()
 {
 	isPressedThisFrame = false;
 	fontRender = FontRender::getInstance();
-	forwardBlackHole = new Spirit("BlackHole.fbx", glm::vec3(-50.0f,250.0f, -50.0f), glm::vec3(10.0f, 10.0f, 0.0f), glm::vec3(0.0f, 180.0f, 50.0f));
-	backwardBlackHole = new Spirit("BlackHole.fbx", glm::vec3(50.0f, 250.0f, 50.0f), glm::vec3(10.0f, 10.0f, 0.0f), glm::vec3(0.0f, 180.0f, 50.0f));
-	viewPlane = new Spirit("Eagle.fbx", glm::vec3(0.0f, 50.0f, 0.0f), glm::vec3(0.002f, 0.002f, 0.002f), glm::vec3(253.0f, 180.0f, 0.0f));
+	// 所有模型交给AssetStreamer后台加载，提交顺序即加载顺序：先近处的飞机和当前场景
+	viewPlane = new Spirit("Eagle.fbx", glm::vec3(0.0f, 50.0f, 0.0f), glm::vec3(0.002f, 0.002f, 0.002f), glm::vec3(253.0f, 180.0f, 0.0f), true);
+	forwardBlackHole = new Spirit("BlackHole.fbx", glm::vec3(-50.0f,250.0f, -50.0f), glm::vec3(10.0f, 10.0f, 0.0f), glm::vec3(0.0f, 180.0f, 50.0f), true);
+	backwardBlackHole = new Spirit("BlackHole.fbx", glm::vec3(50.0f, 250.0f, 50.0f), glm::vec3(10.0f, 10.0f, 0.0f), glm::vec3(0.0f, 180.0f, 50.0f), true);
+	forwardTrigger = triggers.insert(forwardBlackHole->position, forwardBlackHole->position, forwardBlackHole);
+	backwardTrigger = triggers.insert(backwardBlackHole->position, backwardBlackHole->position, backwardBlackHole);
 
 	sceneIndex = 0;
 	isForwardShow = false;
@@ -57,7 +69,7 @@ inline void SceneController::init()
 	initSceneNow();
 }
 
-void SceneController::Draw(Shader shader, float time)
+void SceneController::collect(RenderQueue& queue, float time, const Frustum frusta[PASS_COUNT])
 {
 
 	if (sceneIndex != 0)
@@ -70,17 +82,26 @@ void SceneController::Draw(Shader shader, float time)
 		isForwardShow = false;
 
 	if(isForwardShow)
-		forwardBlackHole->Draw(shader, time);
+		forwardBlackHole->collect(queue, time);
 	if(isBackwardShow)
-		backwardBlackHole->Draw(shader, time);
+		backwardBlackHole->collect(queue, time);
 
-	allScenes[sceneIndex]->Draw(shader, time);
-	viewPlane->Draw(shader, time);
+	allScenes[sceneIndex]->update();
+	allScenes[sceneIndex]->collect(queue, time, frusta);
+	viewPlane->collect(queue, time);
+}
 
+void SceneController::drawCrowds(RenderPass pass, bool gamma)
+{
+	allScenes[sceneIndex]->drawCrowds(pass, gamma);
+}
+
+void SceneController::drawOverlay()
+{
 	if (isPressedThisFrame) {
 		pressedCount++;
 		fontRender->RenderCharacter(thisFramePressed, 25.0f, 25.0f, 1.0f, glm::vec3(1.0f, 1.0f, 0.5f));
-		if (pressedCount > 20) {
+		if (pressedCount > 10) {
 			isPressedThisFrame = false;
 			pressedCount = 0;
 		}
@@ -113,18 +134,21 @@ void SceneController::setThisFramePressed(const char pressed) {
 void SceneController::sceneChangeDetector()
 {
 	float dis;
-	// 计算消耗大，先粗略判断
-	if (isForwardShow && blackHoleDistancePreEstimate(forwardBlackHole->position)) {
-		dis = distanceOfPositions(viewPlane->position, forwardBlackHole->position);
-		//printf("forwardHole dis: %f\n\n", dis);
-		if (dis < blackHoleSensitivity) {
+	// the holes may have been moved from the settings window
+	triggers.move(forwardTrigger, forwardBlackHole->position, forwardBlackHole->position);
+	triggers.move(backwardTrigger, backwardBlackHole->position, backwardBlackHole->position);
+	// 计算消耗大，先用BVH粗略判断
+	triggerHits.clear();
+	triggers.querySphere(viewPlane->position, blackHoleSensitivity, triggerHits);
+	for (auto hole : triggerHits) {
+		dis = distanceOfPositions(viewPlane->position, hole->position);
+		//printf("hole dis: %f\n\n", dis);
+		if (dis >= blackHoleSensitivity)
+			continue;
+		if (hole == forwardBlackHole && isForwardShow) {
 			sceneIndex++;
 		}
-	}
-	if (isBackwardShow && blackHoleDistancePreEstimate(backwardBlackHole->position)) {
-		dis = distanceOfPositions(viewPlane->position, backwardBlackHole->position);
-		//printf("backwardHole dis: %f\n\n", dis);
-		if (dis < blackHoleSensitivity) {
+		else if (hole == backwardBlackHole && isBackwardShow) {
 			sceneIndex--;
 		}
 	}
@@ -141,8 +165,13 @@ inline void SceneController::initScenePast()
 inline void SceneController::initSceneNow()
 {
 	allScenes.push_back(new Scene());
-	allScenes.back()->addCharacter("nowSence/now_walking_people.fbx", glm::vec3(0.0f, 2.0f, 0.0f), glm::vec3(0.005f, 0.005f, 0.005f), glm::vec3(0.0f, 0.0f, 0.0f));
-	allScenes.back()->addCharacter("nowSence/now_stay_people.fbx", glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.5f, 0.5f, 0.5f), glm::vec3(0.0f, 0.0f, 0.0f));
+	// the walkers go through the instanced path; another copy only costs a transform
+	InstancedSpiritGroup* walkers = allScenes.back()->addGroup("nowSence/now_walking_people.fbx");
+	walkers->addInstance(glm::vec3(0.0f, 2.0f, 0.0f), glm::vec3(0.005f, 0.005f, 0.005f), glm::vec3(0.0f, 0.0f, 0.0f));
+	walkers->setGpuAnimation(true);
+	// the standing people never react: a baked crowd, no skeleton
+	VATCrowd* standing = allScenes.back()->addCrowd("nowSence/now_stay_people.fbx");
+	standing->addInstance(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.5f, 0.5f, 0.5f), glm::vec3(0.0f, 0.0f, 0.0f));
 	allScenes.back()->addCharacter("nowSence/now_map_v1.fbx", glm::vec3(0.0f, 2.0f, -1.0f), glm::vec3(20.0f, 20.0f, 20.0f), glm::vec3(0.0f, 0.0f, 0.0f));
 	allScenes.back()->addCharacter("nowSence/now_cars_upper.fbx", glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(1.59f, 1.59f, 1.59f), glm::vec3(90.0f, 270.0f, 180.0f));
 	allScenes.back()->addCharacter("nowSence/now_cars_lower.fbx", glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(2.096f, 2.096f, 2.096f), glm::vec3(-90.0f, 0.0f, 0.0f));
@@ -150,20 +179,11 @@ inline void SceneController::initSceneNow()
 	allScenes.back()->addCharacter("nowSence/now_lower_half_v1.fbx", glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(4.0f, 4.0f, 4.0f), glm::vec3(0.0f, 90.0f, 0.0f));
 }
 
-bool SceneController::blackHoleDistancePreEstimate(const glm::vec3& holePos) const {
-	if (fabsf(holePos.x - viewPlane->position.x) > blackHoleSensitivity ||
-		fabsf(holePos.y - viewPlane->position.y) > blackHoleSensitivity ||
-		fabsf(holePos.z - viewPlane->position.z > blackHoleSensitivity)) {
-		return false;
-	}
-	return true;
-}
-
 void SceneController::initDepthMapFBO() {
 	glGenFramebuffers(1, &depthMapFBO);
 	// create depth texture
 	glGenTextures(1, &depthMap);
-	glBindTexture(GL_TEXTURE_2D, depthMap);
+	GLState::get().bindTexture(0, GL_TEXTURE_2D, depthMap);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
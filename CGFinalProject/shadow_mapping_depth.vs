@@ -3,24 +3,39 @@ layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in ivec4 BoneIDs;
 layout (location = 3) in vec4 Weights;
+// per instance for instanced draws, a constant attribute set per draw otherwise
+layout (location = 4) in mat4 model;
+// first texel of this draw's or instance's bone palette, likewise
+layout (location = 8) in int paletteBase;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-uniform mat4 lightSpaceMatrix;
+layout (std140) uniform LightData {
+    mat4 spaceMatrix;
+    vec3 direction;
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+} light;
 
-const int MAX_BONES = 100;
-uniform mat4 gBones[MAX_BONES];
+// every bone palette of the frame, four RGBA32F texels (the rows of a Matrix4f) per bone
+uniform samplerBuffer bonePalette;
+
+mat4 bone(int id)
+{
+    int texel = paletteBase + id * 4;
+    // rows in, GLSL builds from columns
+    return transpose(mat4(texelFetch(bonePalette, texel), texelFetch(bonePalette, texel + 1),
+                          texelFetch(bonePalette, texel + 2), texelFetch(bonePalette, texel + 3)));
+}
 
 void main()
 {
 	mat4 BoneTransform = mat4(1.0);
 	if(BoneIDs[0] != -1) {
-		BoneTransform = gBones[BoneIDs[0]] * Weights[0];
-		BoneTransform     += gBones[BoneIDs[1]] * Weights[1];
-		BoneTransform     += gBones[BoneIDs[2]] * Weights[2];
-		BoneTransform     += gBones[BoneIDs[3]] * Weights[3];
+		BoneTransform = bone(BoneIDs[0]) * Weights[0];
+		BoneTransform     += bone(BoneIDs[1]) * Weights[1];
+		BoneTransform     += bone(BoneIDs[2]) * Weights[2];
+		BoneTransform     += bone(BoneIDs[3]) * Weights[3];
 	}
     vec3 FragPos = vec3(model * BoneTransform * vec4(aPos, 1.0));
-    gl_Position = lightSpaceMatrix * vec4(FragPos, 1.0);
+    gl_Position = light.spaceMatrix * vec4(FragPos, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,40 @@
+#version 330 core
+// the vertex format of animatedModel.vs; model and palette come from uniforms here
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in ivec4 BoneIDs;
+layout (location = 3) in vec4 Weights;
+
+// captured by transform feedback, interleaved (see skinningCache.h)
+out vec3 skinnedPosition;
+out vec3 skinnedNormal;
+
+uniform mat4 model;
+uniform mat3 normalMatrix;
+// first texel of the mesh's bone palette
+uniform int paletteBase;
+
+// every bone palette of the frame, four RGBA32F texels (the rows of a Matrix4f) per bone
+uniform samplerBuffer bonePalette;
+
+mat4 bone(int id)
+{
+    int texel = paletteBase + id * 4;
+    // rows in, GLSL builds from columns
+    return transpose(mat4(texelFetch(bonePalette, texel), texelFetch(bonePalette, texel + 1),
+                          texelFetch(bonePalette, texel + 2), texelFetch(bonePalette, texel + 3)));
+}
+
+void main()
+{
+	mat4 BoneTransform = mat4(1.0);
+	if(BoneIDs[0] != -1) {
+		BoneTransform = bone(BoneIDs[0]) * Weights[0];
+		BoneTransform     += bone(BoneIDs[1]) * Weights[1];
+		BoneTransform     += bone(BoneIDs[2]) * Weights[2];
+		BoneTransform     += bone(BoneIDs[3]) * Weights[3];
+	}
+    // world space, so the passes draw it with the identity model matrix
+    skinnedPosition = vec3(model * BoneTransform * vec4(aPos, 1.0));
+    skinnedNormal = normalMatrix * vec3(BoneTransform * vec4(aNormal, 0.0));
+}
\ No newline at end of file
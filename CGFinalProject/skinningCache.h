@@ -0,0 +1,185 @@
+#ifndef SKINNING_CACHE__H
+#define SKINNING_CACHE__H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/shader.h>
+#include <learnopengl/gl_state.h>
+
+#include <map>
+
+#include "AnimatedMesh.h"
+#include "ogldev_util.h"
+
+// skinned vertices one frame may hold; meshes beyond it are skinned by each pass as before
+#define SKINNING_CACHE_VERTICES (256 * 1024)
+
+// Output of the frame's skinning stage. Each skinned mesh is run once through skinning.vs
+// as points with rasterization off; transform feedback writes its world space positions
+// and normals back to back into one buffer. Every pass then draws those vertices as
+// static geometry through the mesh's own indices (baseVertex moved to the output), with
+// the identity model matrix, identity normal matrix and bone ID -1, so animatedModel.vs
+// and shadow_mapping_depth.vs do not blend bones for them.
+// GL 3.3 has no compute shaders, transform feedback is the only way to capture vertices.
+// The buffer is refilled every frame; the GPU orders the capture before the draws that
+// read it, so no fence is needed. Render context only; nothing is created before it is
+// first used.
+class SkinningCache
+{
+DISALLOW_COPY_AND_ASSIGN(SkinningCache)
+public:
+	struct Stats
+	{
+		unsigned int meshes;
+		unsigned int vertices;
+		unsigned int overflows;    // meshes left to the passes
+	};
+
+	SkinningCache();
+	~SkinningCache();
+
+	// start a new frame: the buffer is empty again
+	void clear();
+	// skin mesh posed by the palette at paletteBase and placed by model; returns the first
+	// output vertex, the baseVertex for drawing it, or -1 when the buffer is full
+	GLint skin(AnimatedMesh* mesh, const glm::mat4& model, GLint paletteBase);
+	// call after the last skin() of the frame
+	void finish();
+
+	// the capture program, whose bonePalette sampler the caller points at the palettes
+	Shader& getProgram();
+	// VAO reading the output vertices with the indices in indexBuffer
+	GLuint vertexArray(GLuint indexBuffer);
+	// constant attributes of the draws reading the output: no bones
+	static void setStaticBones();
+
+	const Stats& getStats() const { return stats; }
+
+private:
+	void create();
+
+	struct SkinnedVertex
+	{
+		glm::vec3 position;
+		glm::vec3 normal;
+	};
+
+	Shader* program;
+	GLuint buffer;
+	std::map<GLuint, GLuint> vertexArrays;
+	unsigned int used;
+	bool capturing;
+	Stats stats;
+};
+
+SkinningCache::SkinningCache()
+{
+	program = NULL;
+	buffer = 0;
+	used = 0;
+	capturing = false;
+	stats.meshes = 0;
+	stats.vertices = 0;
+	stats.overflows = 0;
+}
+
+SkinningCache::~SkinningCache()
+{
+	for (auto& entry : vertexArrays)
+		glDeleteVertexArrays(1, &entry.second);
+	glDeleteBuffers(1, &buffer);
+	delete program;
+}
+
+void SkinningCache::clear()
+{
+	used = 0;
+	stats.meshes = 0;
+	stats.vertices = 0;
+	stats.overflows = 0;
+}
+
+GLint SkinningCache::skin(AnimatedMesh* mesh, const glm::mat4& model, GLint paletteBase)
+{
+	unsigned int count = mesh->vertices.size();
+	if (used + count > SKINNING_CACHE_VERTICES) {
+		stats.overflows++;
+		return -1;
+	}
+	if (!capturing) {
+		getProgram().use();
+		GLState::get().enable(GL_RASTERIZER_DISCARD);
+		capturing = true;
+	}
+	program->setMat4("model", model);
+	program->setMat3("normalMatrix", glm::mat3(glm::transpose(glm::inverse(model))));
+	program->setInt("paletteBase", paletteBase);
+
+	GLint first = used;
+	glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 0, buffer, first * sizeof(SkinnedVertex), count * sizeof(SkinnedVertex));
+	GLState::get().bindVertexArray(mesh->VAO);
+	glBeginTransformFeedback(GL_POINTS);
+	glDrawArrays(GL_POINTS, mesh->baseVertex, count);
+	glEndTransformFeedback();
+	used += count;
+	stats.meshes++;
+	stats.vertices += count;
+	return first;
+}
+
+void SkinningCache::finish()
+{
+	if (!capturing)
+		return;
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+	GLState::get().disable(GL_RASTERIZER_DISCARD);
+	capturing = false;
+}
+
+Shader& SkinningCache::getProgram()
+{
+	if (!program)
+		create();
+	return *program;
+}
+
+GLuint SkinningCache::vertexArray(GLuint indexBuffer)
+{
+	std::map<GLuint, GLuint>::iterator found = vertexArrays.find(indexBuffer);
+	if (found != vertexArrays.end())
+		return found->second;
+	GLuint vao;
+	glGenVertexArrays(1, &vao);
+	GLState::get().bindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(SkinnedVertex), (void*)offsetof(SkinnedVertex, position));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(SkinnedVertex), (void*)offsetof(SkinnedVertex, normal));
+	// bone IDs and weights stay disabled, see setStaticBones()
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	vertexArrays[indexBuffer] = vao;
+	return vao;
+}
+
+void SkinningCache::setStaticBones()
+{
+	glVertexAttribI4i(2, -1, 0, 0, 0);
+	glVertexAttrib4f(3, 0.0f, 0.0f, 0.0f, 0.0f);
+}
+
+void SkinningCache::create()
+{
+	// the fragment shader never runs, any one that links will do
+	program = new Shader("skinning.vs", "shadow_mapping_depth.fs");
+	const char* varyings[] = { "skinnedPosition", "skinnedNormal" };
+	program->captureVaryings(varyings, 2);
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, buffer);
+	glBufferData(GL_TRANSFORM_FEEDBACK_BUFFER, SKINNING_CACHE_VERTICES * sizeof(SkinnedVertex), NULL, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, 0);
+}
+
+#endif // !SKINNING_CACHE__H
@@ -4,10 +4,12 @@
 #include "AnimatedModel.h"
 #include <learnopengl/camera.h>
 #include <learnopengl/shader.h>
+#include <learnopengl/gl_state.h>
 #include <string>
 #include "stb_image.h"
 #include <iostream>
 #include "ogldev_util.h"
+#include "assetStreamer.h"
 
 using std::string;
 
@@ -23,16 +25,71 @@ public:
 		const string& PosZFilename = "resources/skyBox/hourglass_ft.png",
 		const string& NegZFilename = "resources/skyBox/hourglass_bk.png"
 	)
-		:skyModel("resources/skyBox/sphere.obj"),
+		:skyModel("resources/skyBox/sphere.obj", true),
 		skyBoxShader("skyBox.vs", "skyBox.fs"),
 		camera(camera),
 		texutreFileName{ PosXFilename , NegXFilename, PosYFilename, NegYFilename, PosZFilename, NegZFilename }
 	{
+		ready = false;
+		for (unsigned int i = 0; i < 6; i++) {
+			faceData[i] = NULL;
+		}
 	}
 	~SkyBox() {
-
+		for (unsigned int i = 0; i < 6; i++) {
+			stbi_image_free(faceData[i]);
+		}
 	}
+	// the faces are decoded by the AssetStreamer; until they are uploaded the
+	// caller clears with fallbackColor() instead of drawing the box
 	void init() {
+		AssetStreamer::getInstance()->submit("skyBox",
+			[this]() { return loadFaces(); },
+			[this]() { uploadFaces(); },
+			[this]() { skyModel.publish(); ready = true; });
+	}
+	bool isReady() const {
+		return ready;
+	}
+	// average colour of the hourglass faces
+	static glm::vec3 fallbackColor() {
+		return glm::vec3(0.37f, 0.365f, 0.355f);
+	}
+	void Draw() {
+		if (!ready)
+			return;
+		skyBoxShader.use();
+		// the sphere is seen from inside; no glGet of the old modes, the scene always uses BACK/LESS
+		GLState &state = GLState::get();
+		state.cullFace(GL_FRONT);
+		state.depthFunc(GL_LEQUAL);
+		glm::mat4 model = glm::mat4(1.0f);
+		model = glm::translate(model, camera->Position);
+		model = glm::scale(model, glm::vec3(20.0f, 20.0f, 20.0f));
+		// view and projection come from the ViewData block
+		skyBoxShader.setMat4("model", model);
+
+		state.bindTexture(0, GL_TEXTURE_CUBE_MAP, textureID);
+		skyModel.Draw(skyBoxShader, 0.0f); // ޶ʱ䲻Ҫ
+
+		state.cullFace(GL_BACK);
+		state.depthFunc(GL_LESS);
+	}
+private:
+	// worker thread half: decode the six faces and parse the sphere
+	bool loadFaces() {
+		for (unsigned int i = 0; i < 6; i++) {
+			int nrChannels;
+			faceData[i] = stbi_load(texutreFileName[i].c_str(), &faceWidth[i], &faceHeight[i], &nrChannels, 3);
+			if (!faceData[i])
+			{
+				std::cout << "Failed to load texture" << std::endl;
+			}
+		}
+		return skyModel.parse();
+	}
+	// loader context half: the cube map and the sphere's buffers
+	void uploadFaces() {
 		const unsigned int types[6] = { GL_TEXTURE_CUBE_MAP_POSITIVE_X,
 									    GL_TEXTURE_CUBE_MAP_NEGATIVE_X,
 										GL_TEXTURE_CUBE_MAP_POSITIVE_Y,
@@ -42,55 +99,31 @@ public:
 		glGenTextures(1, &textureID);
 		glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
 		for (unsigned int i = 0; i < ARRAY_SIZE_IN_ELEMENTS(types); i++) {
-			int width, height, nrChannels;
-			unsigned char *data = stbi_load(texutreFileName[i].c_str(), &width, &height, &nrChannels, 0);
-			if (data)
+			if (faceData[i])
 			{
-				glTexImage2D(types[i], 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-			}
-			else
-			{
-				std::cout << "Failed to load texture" << std::endl;
+				glTexImage2D(types[i], 0, GL_RGB, faceWidth[i], faceHeight[i], 0, GL_RGB, GL_UNSIGNED_BYTE, faceData[i]);
 			}
 
-			stbi_image_free(data);
+			stbi_image_free(faceData[i]);
+			faceData[i] = NULL;
 		}
 		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		skyModel.uploadBuffers();
 	}
-	void Draw() {
-		skyBoxShader.use();
-		GLint OldCullFaceMode;
-		glGetIntegerv(GL_CULL_FACE_MODE, &OldCullFaceMode);
-		GLint OldDepthFuncMode;
-		glGetIntegerv(GL_DEPTH_FUNC, &OldDepthFuncMode);
-		glCullFace(GL_FRONT);
-		glDepthFunc(GL_LEQUAL);
-		glm::mat4 model = glm::mat4(1.0f);
-		model = glm::translate(model, camera->Position);
-		model = glm::scale(model, glm::vec3(20.0f, 20.0f, 20.0f));
-		glm::mat4 projection = glm::perspective(glm::radians(camera->Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 10000.0f);
-		glm::mat4 view = camera->GetViewMatrix();
-		skyBoxShader.setMat4("model", model);
-		skyBoxShader.setMat4("projection", projection);
-		skyBoxShader.setMat4("view", view);
 
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-		skyModel.Draw(skyBoxShader, 0.0f); // ޶ʱ䲻Ҫ
-
-		glCullFace(OldCullFaceMode);
-		glDepthFunc(OldDepthFuncMode);
-	}
-private:
 	AnimatedModel skyModel;
 	Camera* camera;
 	Shader skyBoxShader;
 	unsigned int textureID;
 	const string texutreFileName[6];
+	bool ready;
+	unsigned char* faceData[6];
+	int faceWidth[6];
+	int faceHeight[6];
 };
 
 
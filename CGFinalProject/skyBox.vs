@@ -1,8 +1,11 @@
 #version 330
 layout (location = 0) in vec3 Position;
+layout (std140) uniform ViewData {
+    mat4 view;
+    mat4 projection;
+    vec4 viewPos;
+};
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
 
 out vec3 TexCoord0;
 void main()
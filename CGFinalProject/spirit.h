@@ -10,27 +10,99 @@
 //#include <learnopengl/model.h>
 
 #include "AnimatedModel.h"
+#include "animationScheduler.h"
+#include "assetStreamer.h"
+#include "renderQueue.h"
 
 class Spirit
 {
 public:
-	Spirit(std::string Path, glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3 scale = glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3 angles = glm::vec3(0.0f, 0.0f, 0.0f))
-	: spiritModel(("resources/" + Path).data()) {
+	// streamed spirits start empty and are filled in by the AssetStreamer, see stream()
+	Spirit(std::string Path, glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3 scale = glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3 angles = glm::vec3(0.0f, 0.0f, 0.0f), bool streamed = false)
+	: spiritModel(("resources/" + Path).data(), streamed) {
 		this->position = position;
 		this->angles = angles;
 		this->scale = scale;
+		hasProxy = AssetStreamer::getInstance()->cachedBounds(Path, proxyMin, proxyMax);
+		name = Path;
+		if (streamed) {
+			stream();
+		}
 	}
-	void Draw(Shader shader, float time) {
-		shader.use();
+	// queue this frame's draws; all passes share the transform and bone palette
+	void collect(RenderQueue& queue, float time, unsigned int passMask = PASS_ALL) {
+		glm::mat4 model = modelMatrix();
+
+		if (!spiritModel.isReady()) {
+			// still streaming: stand in with the bounding box remembered from the last run
+			if (hasProxy) {
+				model = glm::translate(model, proxyMin);
+				model = glm::scale(model, proxyMax - proxyMin);
+				queue.submit(&proxyMesh(), model, NO_PALETTE, 0, passMask);
+			}
+			return;
+		}
+
+		if (spiritModel.isAnimated()) {
+			// the AnimationScheduler decides whether the pose is taken again or the last one reused
+			// it is seen where its last pose is drawn; before the first pose it always updates
+			glm::vec3 boxMin(-FLT_MAX), boxMax(FLT_MAX);
+			if (!palette.empty()) {
+				glm::vec3 localMin, localMax;
+				spiritModel.posedBounds(palette, localMin, localMax);
+				RenderQueue::worldBox(localMin, localMax, model, boxMin, boxMax);
+			}
+			AnimationScheduler* scheduler = AnimationScheduler::getInstance();
+			if (scheduler->shouldUpdate(animationSlot, boxMin, boxMax)) {
+				scheduler->evaluate(spiritModel, time, palette);
+			}
+			spiritModel.collectPosed(queue, model, palette, passMask);
+			return;
+		}
+
+		spiritModel.collect(queue, model, time, passMask);
+	}
+
+	bool isReady() const {
+		return spiritModel.isReady();
+	}
+
+	// moving bones leave the bind-pose bounds, so these are not culled as a whole
+	bool isAnimated() const {
+		return spiritModel.isReady() && spiritModel.isAnimated();
+	}
+
+	glm::mat4 modelMatrix() const {
+		return modelMatrix(position, scale, angles);
+	}
+
+	// translate, rotate z-y-x by angles in degrees, then scale
+	static glm::mat4 modelMatrix(const glm::vec3& position, const glm::vec3& scale, const glm::vec3& angles) {
 		glm::mat4 model = glm::mat4(1.0f);
 		model = glm::translate(model, position);
 		model = glm::rotate(model, glm::radians(angles.z), glm::vec3(0.0f, 0.0f, 1.0f));
 		model = glm::rotate(model, glm::radians(angles.y), glm::vec3(0.0f, 1.0f, 0.0f));
 		model = glm::rotate(model, glm::radians(angles.x), glm::vec3(1.0f, 0.0f, 0.0f));
 		model = glm::scale(model, scale);
-		shader.setMat4("model", model);
+		return model;
+	}
 
-		spiritModel.Draw(shader, time);
+	// world space box of the model, or of the proxy while it streams; false when neither is known
+	bool worldBounds(glm::vec3& boxMin, glm::vec3& boxMax) const {
+		glm::vec3 localMin, localMax;
+		if (spiritModel.isReady() && spiritModel.hasBounds()) {
+			localMin = spiritModel.aabbMin;
+			localMax = spiritModel.aabbMax;
+		}
+		else if (!spiritModel.isReady() && hasProxy) {
+			localMin = proxyMin;
+			localMax = proxyMax;
+		}
+		else {
+			return false;
+		}
+		RenderQueue::worldBox(localMin, localMax, modelMatrix(), boxMin, boxMax);
+		return true;
 	}
 
 	glm::vec3 position;
@@ -38,8 +110,64 @@ public:
 	glm::vec3 angles;
 	glm::vec3 angles2;
 private:
+	void stream() {
+		AssetStreamer::getInstance()->submit(name,
+			[this]() { return spiritModel.parse(); },
+			[this]() { spiritModel.uploadBuffers(); },
+			[this]() {
+				spiritModel.publish();
+				if (spiritModel.hasBounds()) {
+					AssetStreamer::getInstance()->storeBounds(name, spiritModel.aabbMin, spiritModel.aabbMax);
+				}
+			});
+	}
+
+	// unit cube from (0,0,0) to (1,1,1), shared by every proxy
+	static AnimatedMesh& proxyMesh() {
+		static AnimatedMesh* cube = NULL;
+		if (!cube) {
+			const glm::vec3 normals[6] = { glm::vec3(1, 0, 0), glm::vec3(-1, 0, 0), glm::vec3(0, 1, 0),
+										   glm::vec3(0, -1, 0), glm::vec3(0, 0, 1), glm::vec3(0, 0, -1) };
+			vector<Vertex> vertices;
+			vector<unsigned int> indices;
+			for (unsigned int f = 0; f < 6; f++) {
+				glm::vec3 n = normals[f];
+				glm::vec3 u = glm::vec3(n.y != 0 ? 1 : 0, n.y != 0 ? 0 : 1, 0);
+				glm::vec3 v = glm::cross(n, u);
+				glm::vec3 center = glm::vec3(0.5f) + 0.5f * n;
+				unsigned int base = vertices.size();
+				for (unsigned int c = 0; c < 4; c++) {
+					Vertex vertex;
+					float su = (c == 1 || c == 2) ? 0.5f : -0.5f;
+					float sv = (c >= 2) ? 0.5f : -0.5f;
+					vertex.Position = center + su * u + sv * v;
+					vertex.Normal = n;
+					vertices.push_back(vertex);
+				}
+				unsigned int quad[6] = { 0, 1, 2, 0, 2, 3 };
+				for (unsigned int i = 0; i < 6; i++) {
+					indices.push_back(base + quad[i]);
+				}
+			}
+			Material mat;
+			mat.Ka = glm::vec4(0.35f, 0.35f, 0.38f, 1.0f);
+			mat.Kd = mat.Ka;
+			mat.Ks = glm::vec4(0.0f);
+			mat.Ni = 1.0f;
+			cube = new AnimatedMesh(vertices, indices, mat);
+			cube->setupMesh();
+		}
+		return *cube;
+	}
 
 	AnimatedModel spiritModel;
+	std::string name;
+	bool hasProxy;
+	glm::vec3 proxyMin;
+	glm::vec3 proxyMax;
+	// last pose taken for this spirit, drawn again while the scheduler skips it
+	AnimationScheduler::Slot animationSlot;
+	vector<Matrix4f> palette;
 };
 
 #endif // !SPIRIT_H
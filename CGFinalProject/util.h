@@ -4,32 +4,85 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <stb_image.h>
+#include <learnopengl/texture_registry.h>
+#include <learnopengl/texture_streamer.h>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
 #include <iostream>
+#include <string>
 
-unsigned int loadTexture(char const * path)
+// decoded pixels waiting for uploadTexture()
+struct TextureData
 {
+	std::string path;
+	unsigned char *data;
+	int width, height, nrComponents;
+	bool gamma;
+	// set by decodeTexture when the registry already holds this image
+	unsigned int sharedID;
+	// replaces data for images the TextureStreamer manages
+	MipChain *mips;
+};
+
+// CPU half of loadTexture: only stb_image, safe to call from a worker thread.
+// Images already in the TextureRegistry are not decoded again; large ones get their
+// mip chain built here when texture streaming is on.
+bool decodeTexture(char const * path, TextureData &texture, bool gamma = false)
+{
+	texture.path = path;
+	texture.gamma = gamma;
+	texture.data = NULL;
+	texture.mips = NULL;
+	texture.sharedID = TextureRegistry::get().acquire(path, gamma);
+	if (texture.sharedID)
+		return true;
+	texture.data = stbi_load(path, &texture.width, &texture.height, &texture.nrComponents, 0);
+	if (texture.data && TextureStreamer::get().isEnabled() && TextureStreamer::wantsStreaming(texture.width, texture.height))
+	{
+		texture.mips = MipChain::build(texture.data, texture.width, texture.height, texture.nrComponents, gamma);
+		stbi_image_free(texture.data);
+		texture.data = NULL;
+	}
+	return texture.data != NULL || texture.mips != NULL;
+}
+
+// GL half of loadTexture: uploads and frees the decoded pixels
+unsigned int uploadTexture(TextureData &texture)
+{
+	if (texture.sharedID)
+		return texture.sharedID;
+
 	unsigned int textureID;
 	glGenTextures(1, &textureID);
 
-	int width, height, nrComponents;
-	unsigned char *data = stbi_load(path, &width, &height, &nrComponents, 0);
-	if (data)
+	if (texture.mips)
+	{
+		// only the coarse levels go up now, see TextureStreamer
+		TextureStreamer::get().create(textureID, texture.mips);
+		texture.mips = NULL;
+		textureID = TextureRegistry::get().insert(texture.path, texture.gamma, textureID,
+			TextureRegistry::estimateBytes(texture.width, texture.height, texture.nrComponents));
+	}
+	else if (texture.data)
 	{
-		GLenum format;
-		if (nrComponents == 1)
+		GLenum format, internalFormat;
+		if (texture.nrComponents == 1)
 			format = GL_RED;
-		else if (nrComponents == 3)
+		else if (texture.nrComponents == 3)
 			format = GL_RGB;
-		else if (nrComponents == 4)
+		else if (texture.nrComponents == 4)
 			format = GL_RGBA;
+		internalFormat = format;
+		if (texture.gamma && format == GL_RGB)
+			internalFormat = GL_SRGB;
+		else if (texture.gamma && format == GL_RGBA)
+			internalFormat = GL_SRGB_ALPHA;
 
 		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, texture.width, texture.height, 0, format, GL_UNSIGNED_BYTE, texture.data);
 		glGenerateMipmap(GL_TEXTURE_2D);
 
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
@@ -37,15 +90,33 @@ unsigned int loadTexture(char const * path)
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-		stbi_image_free(data);
+		stbi_image_free(texture.data);
+		texture.data = NULL;
+		textureID = TextureRegistry::get().insert(texture.path, texture.gamma, textureID,
+			TextureRegistry::estimateBytes(texture.width, texture.height, texture.nrComponents));
 	}
 	else
 	{
-		std::cout << "Texture failed to load at path: " << path << std::endl;
-		stbi_image_free(data);
+		std::cout << "Texture failed to load at path: " << texture.path << std::endl;
 	}
 
 	return textureID;
 }
 
-#endif
\ No newline at end of file
+// frees what decodeTexture produced when it is not going to be uploaded
+void releaseTexture(TextureData &texture)
+{
+	stbi_image_free(texture.data);
+	texture.data = NULL;
+	delete texture.mips;
+	texture.mips = NULL;
+}
+
+unsigned int loadTexture(char const * path, bool gamma = false)
+{
+	TextureData texture;
+	decodeTexture(path, texture, gamma);
+	return uploadTexture(texture);
+}
+
+#endif
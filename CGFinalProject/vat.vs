@@ -0,0 +1,64 @@
+#version 330 core
+// per instance: model matrix, then playback (phase in seconds, rate)
+layout (location = 4) in mat4 model;
+layout (location = 8) in vec2 playback;
+
+out VS_OUT {
+    vec3 FragPos;
+    vec3 Normal;
+    vec4 FragPosLightSpace;
+} vs_out;
+
+// shared with every program, written once per frame (see uniform_blocks.h)
+layout (std140) uniform FrameData {
+    float time;
+    float deltaTime;
+    vec2 resolution;
+};
+layout (std140) uniform ViewData {
+    mat4 view;
+    mat4 projection;
+    vec4 viewPos;
+};
+layout (std140) uniform LightData {
+    mat4 spaceMatrix;
+    vec3 direction;
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+} light;
+
+// baked clip (see vatBaker.h): vertex v of frame f is texel f * vatVertexCount + v,
+// rows wrapped at the texture width. There is no vertex buffer, gl_VertexID is v.
+uniform sampler2D vatPositions;
+uniform sampler2D vatNormals;
+uniform int vatVertexCount;
+uniform int vatFrameCount;
+uniform float vatDuration;
+
+vec3 fetch(sampler2D map, int frame)
+{
+    int texel = frame * vatVertexCount + gl_VertexID;
+    int width = textureSize(map, 0).x;
+    return texelFetch(map, ivec2(texel % width, texel / width), 0).xyz;
+}
+
+void main()
+{
+    // the clip loops; blend the two baked frames around this instance's time
+    float frame = fract((time * playback.y + playback.x) / vatDuration) * float(vatFrameCount);
+    int frame0 = min(int(frame), vatFrameCount - 1);
+    int frame1 = (frame0 + 1) % vatFrameCount;
+    float blend = frame - float(frame0);
+    vec3 position = mix(fetch(vatPositions, frame0), fetch(vatPositions, frame1), blend);
+    vec3 normal = mix(fetch(vatNormals, frame0), fetch(vatNormals, frame1), blend);
+
+    vs_out.FragPos = vec3(model * vec4(position, 1.0));
+    // cofactors of model: its inverse transpose scaled by the determinant
+    mat3 m = mat3(model);
+    mat3 normals = mat3(cross(m[1], m[2]), cross(m[2], m[0]), cross(m[0], m[1]));
+    normals *= sign(dot(m[0], normals[0]));
+    vs_out.Normal = normals * normal;
+    vs_out.FragPosLightSpace = light.spaceMatrix * vec4(vs_out.FragPos, 1.0);
+    gl_Position = projection * view * vec4(vs_out.FragPos, 1.0);
+}
\ No newline at end of file
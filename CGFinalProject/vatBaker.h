@@ -0,0 +1,271 @@
+#ifndef VAT_BAKER__H
+#define VAT_BAKER__H
+
+#include <glm/glm.hpp>
+
+#include <cfloat>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+
+#include "AnimatedModel.h"
+
+// frames sampled over one clip when the caller does not say
+#define VAT_DEFAULT_FRAMES 32
+// "VAT2", bumped whenever the file layout changes
+#define VAT_FILE_MAGIC 0x32544156u
+
+struct VATMesh
+{
+	unsigned int firstIndex;
+	unsigned int indexCount;
+	Material material;
+};
+
+// One animation clip of a model skinned on the CPU into per-frame vertex positions and
+// normals. Every mesh's vertices are numbered in one range and its indices rebased onto
+// it, so a single texel index (frame * vertexCount + vertex) finds a vertex in any frame.
+// The file holds the struct as it is, native byte order:
+//   magic, vertexCount, frameCount, meshCount, indexCount, sourceSize, sourceTime,
+//   duration, boundsMin, boundsMax, meshes, indices, positions, normals
+struct VATData
+{
+	// size and modification time of the model file it was baked from; a bake whose
+	// source changed since is stale
+	long long sourceSize;
+	long long sourceTime;
+	unsigned int vertexCount;
+	unsigned int frameCount;
+	// seconds of the clip; frame k is sampled at k * duration / frameCount
+	float duration;
+	// model space bounds over every frame
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+	vector<VATMesh> meshes;
+	vector<unsigned int> indices;
+	// xyz per vertex, frame after frame
+	vector<float> positions;
+	vector<float> normals;
+
+	VATData() {
+		sourceSize = sourceTime = 0;
+		vertexCount = 0;
+		frameCount = 0;
+		duration = 0.0f;
+		boundsMin = glm::vec3(0.0f);
+		boundsMax = glm::vec3(0.0f);
+	}
+
+	bool save(const std::string& path) const;
+	bool load(const std::string& path);
+	// record the model file at path as the source
+	void stampSource(const std::string& path);
+	// whether the model file at path is still the one this was baked from
+	bool matchesSource(const std::string& path) const;
+
+private:
+	static bool sourceStamp(const std::string& path, long long& size, long long& time);
+};
+
+// Bakes vertex animation textures: the skeleton is evaluated frames times over the first
+// clip and every vertex skinned with the same four-bone blend animatedModel.vs uses.
+// Runs anywhere, no GL calls; VATCrowd bakes on the asset streamer's worker thread when
+// no baked file exists, and main.cpp's --bake-vat does it ahead of time.
+class VATBaker
+{
+public:
+	// model must be parsed; false when it has no animation to bake
+	static bool bake(AnimatedModel& model, unsigned int frames, VATData& data);
+	// parse modelPath, bake it and write the result to outPath
+	static bool bakeFile(const std::string& modelPath, const std::string& outPath, unsigned int frames = VAT_DEFAULT_FRAMES);
+
+private:
+	static void skin(const Vertex& vertex, const vector<Matrix4f>& palette, glm::vec3& position, glm::vec3& normal);
+};
+
+bool VATData::save(const std::string& path) const
+{
+	std::ofstream file(path.c_str(), std::ios::binary);
+	if (!file) {
+		std::cout << "ERROR::VAT::CANNOT_WRITE " << path << std::endl;
+		return false;
+	}
+	unsigned int header[5] = { VAT_FILE_MAGIC, vertexCount, frameCount, (unsigned int)meshes.size(), (unsigned int)indices.size() };
+	file.write((const char*)header, sizeof(header));
+	file.write((const char*)&sourceSize, sizeof(sourceSize));
+	file.write((const char*)&sourceTime, sizeof(sourceTime));
+	file.write((const char*)&duration, sizeof(duration));
+	file.write((const char*)&boundsMin, sizeof(boundsMin));
+	file.write((const char*)&boundsMax, sizeof(boundsMax));
+	if (!meshes.empty())
+		file.write((const char*)&meshes[0], meshes.size() * sizeof(VATMesh));
+	if (!indices.empty())
+		file.write((const char*)&indices[0], indices.size() * sizeof(unsigned int));
+	if (!positions.empty()) {
+		file.write((const char*)&positions[0], positions.size() * sizeof(float));
+		file.write((const char*)&normals[0], normals.size() * sizeof(float));
+	}
+	return (bool)file;
+}
+
+bool VATData::load(const std::string& path)
+{
+	std::ifstream file(path.c_str(), std::ios::binary);
+	if (!file) {
+		return false;
+	}
+	unsigned int header[5];
+	file.read((char*)header, sizeof(header));
+	if (!file || header[0] != VAT_FILE_MAGIC) {
+		std::cout << "ERROR::VAT::BAD_FILE " << path << std::endl;
+		return false;
+	}
+	vertexCount = header[1];
+	frameCount = header[2];
+	meshes.resize(header[3]);
+	indices.resize(header[4]);
+	file.read((char*)&sourceSize, sizeof(sourceSize));
+	file.read((char*)&sourceTime, sizeof(sourceTime));
+	file.read((char*)&duration, sizeof(duration));
+	file.read((char*)&boundsMin, sizeof(boundsMin));
+	file.read((char*)&boundsMax, sizeof(boundsMax));
+	if (!meshes.empty())
+		file.read((char*)&meshes[0], meshes.size() * sizeof(VATMesh));
+	if (!indices.empty())
+		file.read((char*)&indices[0], indices.size() * sizeof(unsigned int));
+	positions.resize((size_t)vertexCount * frameCount * 3);
+	normals.resize(positions.size());
+	if (!positions.empty()) {
+		file.read((char*)&positions[0], positions.size() * sizeof(float));
+		file.read((char*)&normals[0], normals.size() * sizeof(float));
+	}
+	if (!file) {
+		std::cout << "ERROR::VAT::TRUNCATED " << path << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void VATData::stampSource(const std::string& path)
+{
+	if (!sourceStamp(path, sourceSize, sourceTime)) {
+		sourceSize = sourceTime = 0;
+	}
+}
+
+bool VATData::matchesSource(const std::string& path) const
+{
+	long long size, time;
+	return sourceStamp(path, size, time) && size == sourceSize && time == sourceTime;
+}
+
+bool VATData::sourceStamp(const std::string& path, long long& size, long long& time)
+{
+	struct stat info;
+	if (stat(path.c_str(), &info) != 0) {
+		return false;
+	}
+	size = (long long)info.st_size;
+	time = (long long)info.st_mtime;
+	return true;
+}
+
+bool VATBaker::bake(AnimatedModel& model, unsigned int frames, VATData& data)
+{
+	if (!model.isAnimated() || frames == 0) {
+		std::cout << "ERROR::VAT::NOTHING_TO_BAKE " << model.getPath() << std::endl;
+		return false;
+	}
+	data = VATData();
+	data.stampSource(model.getPath());
+	data.frameCount = frames;
+	data.duration = model.clipDuration();
+	for (auto& mesh : model.meshes) {
+		VATMesh entry;
+		entry.firstIndex = data.indices.size();
+		entry.indexCount = mesh.indices.size();
+		entry.material = mesh.mats;
+		data.meshes.push_back(entry);
+		for (auto index : mesh.indices) {
+			data.indices.push_back(data.vertexCount + index);
+		}
+		data.vertexCount += mesh.vertices.size();
+	}
+
+	data.positions.resize((size_t)data.vertexCount * frames * 3);
+	data.normals.resize(data.positions.size());
+	data.boundsMin = glm::vec3(FLT_MAX);
+	data.boundsMax = glm::vec3(-FLT_MAX);
+	vector<Matrix4f> palette;
+	for (unsigned int frame = 0; frame < frames; frame++) {
+		model.poseAt(data.duration * frame / frames, palette);
+		size_t texel = (size_t)frame * data.vertexCount;
+		for (auto& mesh : model.meshes) {
+			for (auto& vertex : mesh.vertices) {
+				glm::vec3 position, normal;
+				skin(vertex, palette, position, normal);
+				for (unsigned int c = 0; c < 3; c++) {
+					data.positions[texel * 3 + c] = position[c];
+					data.normals[texel * 3 + c] = normal[c];
+				}
+				data.boundsMin = glm::min(data.boundsMin, position);
+				data.boundsMax = glm::max(data.boundsMax, position);
+				texel++;
+			}
+		}
+	}
+	if (data.vertexCount == 0) {
+		data.boundsMin = data.boundsMax = glm::vec3(0.0f);
+	}
+	return true;
+}
+
+bool VATBaker::bakeFile(const std::string& modelPath, const std::string& outPath, unsigned int frames)
+{
+	AnimatedModel model(modelPath, true);
+	if (!model.parse()) {
+		std::cout << "ERROR::VAT::CANNOT_LOAD " << modelPath << std::endl;
+		return false;
+	}
+	VATData data;
+	if (!bake(model, frames, data) || !data.save(outPath)) {
+		return false;
+	}
+	std::cout << "VAT: " << modelPath << " -> " << outPath << ", " << data.vertexCount << " vertices x "
+		<< data.frameCount << " frames over " << data.duration << " s" << std::endl;
+	return true;
+}
+
+// the blended bone matrix applied to position and normal, as in animatedModel.vs
+void VATBaker::skin(const Vertex& vertex, const vector<Matrix4f>& palette, glm::vec3& position, glm::vec3& normal)
+{
+	if (vertex.boneID[0] == -1) {
+		position = vertex.Position;
+		normal = vertex.Normal;
+		return;
+	}
+	float blend[3][4] = {};
+	for (unsigned int i = 0; i < BONE_INFO_NUM; i++) {
+		int id = vertex.boneID[i];
+		float weight = vertex.boneWeight[i];
+		if (weight == 0.0f || id < 0 || id >= (int)palette.size())
+			continue;
+		for (unsigned int r = 0; r < 3; r++)
+			for (unsigned int c = 0; c < 4; c++)
+				blend[r][c] += palette[id].m[r][c] * weight;
+	}
+	const glm::vec3& p = vertex.Position;
+	const glm::vec3& n = vertex.Normal;
+	for (unsigned int r = 0; r < 3; r++) {
+		position[r] = blend[r][0] * p.x + blend[r][1] * p.y + blend[r][2] * p.z + blend[r][3];
+		normal[r] = blend[r][0] * n.x + blend[r][1] * n.y + blend[r][2] * n.z;
+	}
+	float length = glm::length(normal);
+	if (length > 0.0f)
+		normal /= length;
+}
+
+#endif // !VAT_BAKER__H
@@ -0,0 +1,304 @@
+#ifndef VAT_CROWD__H
+#define VAT_CROWD__H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/shader.h>
+#include <learnopengl/gl_state.h>
+
+#include <string>
+#include <vector>
+
+#include "vatBaker.h"
+#include "spirit.h"
+
+// texels per row of the position and normal textures
+#define VAT_TEXTURE_WIDTH 2048
+// texture units of the baked clip; 0 holds the shadow map, 1 the bone palettes
+#define VAT_POSITION_UNIT 2
+#define VAT_NORMAL_UNIT 3
+// attribute of the per-instance playback vec2 (vat.vs); 4-7 hold the model matrix
+#define VAT_PLAYBACK_LOCATION 8
+
+// Many copies of one animated model that never need their own skeleton: background
+// walkers, an audience. Instead of evaluating and streaming bone palettes, the clip is
+// baked once into textures of skinned positions and normals (see VATBaker) and vat.vs
+// reads its vertex straight out of them by gl_VertexID and the instance's time, so a
+// copy costs one mat4 and a phase and the whole crowd is one instanced call per mesh,
+// whatever the bone count. The bake is cached next to the model as a .vat file, so
+// resources/ gains one per crowd model; when it is missing, or the model's size or
+// modification time no longer match it, the asset streamer's worker bakes and writes it.
+// Copies share one clip and cannot blend or react; use an InstancedSpiritGroup for those.
+// The crowd is culled as a whole against the bounds of every copy over every frame.
+class VATCrowd
+{
+DISALLOW_COPY_AND_ASSIGN(VATCrowd)
+public:
+	struct Instance
+	{
+		glm::mat4 model;
+		// x: phase in seconds, y: playback rate
+		glm::vec2 playback;
+	};
+
+	// model under resources/; nothing is drawn until the baked clip is uploaded
+	VATCrowd(std::string Path, unsigned int frames = VAT_DEFAULT_FRAMES);
+	~VATCrowd();
+
+	// returns the index of the new copy
+	unsigned int addInstance(const glm::mat4& transform, float phase = 0.0f, float rate = 1.0f);
+	unsigned int addInstance(glm::vec3 position, glm::vec3 scale = glm::vec3(1.0f, 1.0f, 1.0f),
+		glm::vec3 angles = glm::vec3(0.0f, 0.0f, 0.0f), float phase = 0.0f, float rate = 1.0f);
+	void setTransform(unsigned int instance, const glm::mat4& transform);
+	const glm::mat4& getTransform(unsigned int instance) const { return instances[instance].model; }
+	unsigned int size() const { return instances.size(); }
+
+	bool isReady() const { return ready; }
+	// decide which passes see the crowd this frame
+	void cull(const Frustum frusta[PASS_COUNT]);
+	// every copy, if pass saw the crowd; the depth map is already bound for PASS_MAIN
+	void draw(RenderPass pass, bool gamma);
+
+private:
+	void stream();
+	// worker thread: read the cached bake, or bake and cache it
+	bool load();
+	// loader context: textures and index buffer
+	void uploadBuffers();
+	// render thread: VAO and instance buffer
+	void publish();
+	// send the instance data again after copies were added or moved
+	void updateInstances();
+	static GLuint createTexture(const vector<float>& texels, GLsizei height);
+
+	// one program per pass, shared by all crowds
+	static Shader& passShader(RenderPass pass);
+
+	std::string name;
+	std::string source;
+	std::string cache;
+	unsigned int frames;
+	VATData data;
+	vector<unsigned int> materialIndices;
+	vector<Instance> instances;
+	// bounds of all copies over the whole clip
+	glm::vec3 worldMin;
+	glm::vec3 worldMax;
+	unsigned int passMask;
+	bool dirty;
+	bool ready;
+	GLuint positionTexture;
+	GLuint normalTexture;
+	GLuint indexBuffer;
+	GLuint instanceBuffer;
+	GLuint vertexArray;
+};
+
+VATCrowd::VATCrowd(std::string Path, unsigned int frames)
+	: frames(frames)
+{
+	name = Path;
+	source = "resources/" + Path;
+	cache = source.substr(0, source.find_last_of('.')) + ".vat";
+	worldMin = worldMax = glm::vec3(0.0f);
+	passMask = 0;
+	dirty = false;
+	ready = false;
+	positionTexture = normalTexture = 0;
+	indexBuffer = instanceBuffer = 0;
+	vertexArray = 0;
+	stream();
+}
+
+VATCrowd::~VATCrowd()
+{
+	glDeleteTextures(1, &positionTexture);
+	glDeleteTextures(1, &normalTexture);
+	glDeleteBuffers(1, &indexBuffer);
+	glDeleteBuffers(1, &instanceBuffer);
+	glDeleteVertexArrays(1, &vertexArray);
+}
+
+unsigned int VATCrowd::addInstance(const glm::mat4& transform, float phase, float rate)
+{
+	Instance instance;
+	instance.model = transform;
+	instance.playback = glm::vec2(phase, rate);
+	instances.push_back(instance);
+	dirty = true;
+	return instances.size() - 1;
+}
+
+unsigned int VATCrowd::addInstance(glm::vec3 position, glm::vec3 scale, glm::vec3 angles, float phase, float rate)
+{
+	return addInstance(Spirit::modelMatrix(position, scale, angles), phase, rate);
+}
+
+void VATCrowd::setTransform(unsigned int instance, const glm::mat4& transform)
+{
+	instances[instance].model = transform;
+	dirty = true;
+}
+
+void VATCrowd::cull(const Frustum frusta[PASS_COUNT])
+{
+	passMask = 0;
+	if (!ready || instances.empty()) {
+		return;
+	}
+	updateInstances();
+	for (unsigned int pass = 0; pass < PASS_COUNT; pass++) {
+		if (frusta[pass].testAABB(worldMin, worldMax)) {
+			passMask |= PASS_BIT(pass);
+		}
+	}
+}
+
+void VATCrowd::draw(RenderPass pass, bool gamma)
+{
+	if (!(passMask & PASS_BIT(pass))) {
+		return;
+	}
+	Shader& shader = passShader(pass);
+	shader.use();
+	shader.setInt("vatPositions", VAT_POSITION_UNIT);
+	shader.setInt("vatVertexCount", data.vertexCount);
+	shader.setInt("vatFrameCount", data.frameCount);
+	shader.setFloat("vatDuration", data.duration > 0.0f ? data.duration : 1.0f);
+	GLState& glState = GLState::get();
+	glState.bindTexture(VAT_POSITION_UNIT, GL_TEXTURE_2D, positionTexture);
+	if (pass == PASS_MAIN) {
+		shader.setInt("vatNormals", VAT_NORMAL_UNIT);
+		shader.setInt("shadowMap", 0);
+		shader.setInt("gamma", gamma);
+		glState.bindTexture(VAT_NORMAL_UNIT, GL_TEXTURE_2D, normalTexture);
+	}
+	glState.bindVertexArray(vertexArray);
+	for (unsigned int i = 0; i < data.meshes.size(); i++) {
+		if (pass == PASS_MAIN) {
+			shader.setInt("materialIndex", materialIndices[i]);
+		}
+		glDrawElementsInstanced(GL_TRIANGLES, data.meshes[i].indexCount, GL_UNSIGNED_INT,
+			(const GLvoid*)(data.meshes[i].firstIndex * sizeof(unsigned int)), instances.size());
+	}
+}
+
+void VATCrowd::stream()
+{
+	AssetStreamer::getInstance()->submit(name + " (vat)",
+		[this]() { return load(); },
+		[this]() { uploadBuffers(); },
+		[this]() { publish(); });
+}
+
+bool VATCrowd::load()
+{
+	if (!data.load(cache) || data.frameCount != frames || !data.matchesSource(source)) {
+		AnimatedModel model(source, true);
+		if (!model.parse() || !VATBaker::bake(model, frames, data)) {
+			return false;
+		}
+		data.save(cache);
+	}
+	for (auto& mesh : data.meshes) {
+		materialIndices.push_back(MaterialLibrary::getInstance()->add(mesh.material));
+	}
+	return true;
+}
+
+void VATCrowd::uploadBuffers()
+{
+	GLint maxSize = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+	size_t texels = (size_t)data.vertexCount * data.frameCount;
+	GLsizei height = (GLsizei)((texels + VAT_TEXTURE_WIDTH - 1) / VAT_TEXTURE_WIDTH);
+	if (texels == 0 || height > maxSize) {
+		std::cout << "ERROR::VAT::TOO_LARGE " << name << ": " << data.vertexCount << " vertices x "
+			<< data.frameCount << " frames" << std::endl;
+		return;
+	}
+	positionTexture = createTexture(data.positions, height);
+	normalTexture = createTexture(data.normals, height);
+
+	glGenBuffers(1, &indexBuffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, indexBuffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, data.indices.size() * sizeof(unsigned int), &data.indices[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	// the GPU has its copy now
+	vector<float>().swap(data.positions);
+	vector<float>().swap(data.normals);
+	vector<unsigned int>().swap(data.indices);
+}
+
+void VATCrowd::publish()
+{
+	if (positionTexture == 0) {
+		return;
+	}
+	glGenBuffers(1, &instanceBuffer);
+	glGenVertexArrays(1, &vertexArray);
+	GLState::get().bindVertexArray(vertexArray);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	// no per-vertex attributes at all, only the instance stream
+	for (unsigned int column = 0; column < 4; column++) {
+		GLuint location = INSTANCE_MODEL_LOCATION + column;
+		glEnableVertexAttribArray(location);
+		glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)(column * sizeof(glm::vec4)));
+		glVertexAttribDivisor(location, 1);
+	}
+	glEnableVertexAttribArray(VAT_PLAYBACK_LOCATION);
+	glVertexAttribPointer(VAT_PLAYBACK_LOCATION, 2, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)offsetof(Instance, playback));
+	glVertexAttribDivisor(VAT_PLAYBACK_LOCATION, 1);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	GLState::get().bindVertexArray(0);
+	dirty = true;
+	ready = true;
+}
+
+void VATCrowd::updateInstances()
+{
+	if (!dirty) {
+		return;
+	}
+	// copies rarely move, so the buffer is static and only refilled when they do
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(Instance), &instances[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	worldMin = glm::vec3(FLT_MAX);
+	worldMax = glm::vec3(-FLT_MAX);
+	for (auto& instance : instances) {
+		glm::vec3 boxMin, boxMax;
+		RenderQueue::worldBox(data.boundsMin, data.boundsMax, instance.model, boxMin, boxMax);
+		worldMin = glm::min(worldMin, boxMin);
+		worldMax = glm::max(worldMax, boxMax);
+	}
+	dirty = false;
+}
+
+// xyz per texel, padded out to whole rows; read with texelFetch only, so no filtering
+GLuint VATCrowd::createTexture(const vector<float>& texels, GLsizei height)
+{
+	vector<float> rows((size_t)VAT_TEXTURE_WIDTH * height * 3, 0.0f);
+	std::copy(texels.begin(), texels.end(), rows.begin());
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, VAT_TEXTURE_WIDTH, height, 0, GL_RGB, GL_FLOAT, &rows[0]);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return texture;
+}
+
+Shader& VATCrowd::passShader(RenderPass pass)
+{
+	static Shader depth("vatDepth.vs", "shadow_mapping_depth.fs");
+	static Shader lit("vat.vs", "animatedModel.fs");
+	return pass == PASS_SHADOW ? depth : lit;
+}
+
+#endif // !VAT_CROWD__H
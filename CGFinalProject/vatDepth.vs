@@ -0,0 +1,39 @@
+#version 330 core
+// per instance: model matrix, then playback (phase in seconds, rate)
+layout (location = 4) in mat4 model;
+layout (location = 8) in vec2 playback;
+
+layout (std140) uniform FrameData {
+    float time;
+    float deltaTime;
+    vec2 resolution;
+};
+layout (std140) uniform LightData {
+    mat4 spaceMatrix;
+    vec3 direction;
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+} light;
+
+// baked positions, laid out as in vat.vs
+uniform sampler2D vatPositions;
+uniform int vatVertexCount;
+uniform int vatFrameCount;
+uniform float vatDuration;
+
+vec3 fetch(int frame)
+{
+    int texel = frame * vatVertexCount + gl_VertexID;
+    int width = textureSize(vatPositions, 0).x;
+    return texelFetch(vatPositions, ivec2(texel % width, texel / width), 0).xyz;
+}
+
+void main()
+{
+    float frame = fract((time * playback.y + playback.x) / vatDuration) * float(vatFrameCount);
+    int frame0 = min(int(frame), vatFrameCount - 1);
+    int frame1 = (frame0 + 1) % vatFrameCount;
+    vec3 position = mix(fetch(frame0), fetch(frame1), frame - float(frame0));
+    gl_Position = light.spaceMatrix * model * vec4(position, 1.0);
+}
\ No newline at end of file
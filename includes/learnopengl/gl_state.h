@@ -0,0 +1,243 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+#define GL_STATE_TEXTURE_UNITS 16
+
+// Thin cache in front of the render context's most frequently set state: program,
+// vertex array, texture bindings per unit, blend/cull/depth enables and functions,
+// the unpack alignment.
+// A call whose value is already current is dropped. The cache does not read back
+// from the driver (glGet* forces a sync); instead every value starts out unknown
+// and the first call always goes through. isEnabled() is the one exception, and
+// only for a cap that is still unknown. Code that changes this state without going
+// through GLState (third party UI, loaders running on the render thread) must call
+// invalidate() afterwards. Only the render context may use it: state set on the asset
+// streamer's loader context is separate and stays raw GL.
+class GLState
+{
+public:
+    struct Stats
+    {
+        unsigned int issued;
+        unsigned int filtered;
+    };
+
+    static GLState& get()
+    {
+        static GLState state;
+        return state;
+    }
+
+    void useProgram(GLuint program)
+    {
+        if (filter(program, currentProgram))
+            return;
+        glUseProgram(program);
+    }
+
+    void bindVertexArray(GLuint vao)
+    {
+        if (filter(vao, currentVertexArray))
+            return;
+        glBindVertexArray(vao);
+    }
+
+    // selects unit and binds texture to target on it
+    void bindTexture(unsigned int unit, GLenum target, GLuint texture)
+    {
+        int slot = targetSlot(target);
+        if (unit >= GL_STATE_TEXTURE_UNITS || slot < 0)
+        {
+            activeTexture(unit);
+            counters.issued++;
+            glBindTexture(target, texture);
+            return;
+        }
+        if (filter(texture, textures[unit][slot]))
+            return;
+        activeTexture(unit);
+        glBindTexture(target, texture);
+    }
+
+    void activeTexture(unsigned int unit)
+    {
+        if (filter(unit, currentUnit))
+            return;
+        glActiveTexture(GL_TEXTURE0 + unit);
+    }
+
+    void enable(GLenum cap)
+    {
+        setCap(cap, true);
+    }
+
+    void disable(GLenum cap)
+    {
+        setCap(cap, false);
+    }
+
+    // the cached enable, so a pass can put back what it found; only a cap that is
+    // still unknown (or not cached at all) is asked of the driver, and then remembered
+    bool isEnabled(GLenum cap)
+    {
+        int slot = capSlot(cap);
+        if (slot >= 0 && caps[slot] != UNKNOWN)
+            return caps[slot] != 0;
+        bool on = glIsEnabled(cap) == GL_TRUE;
+        if (slot >= 0)
+            caps[slot] = on ? 1 : 0;
+        return on;
+    }
+
+    void setEnabled(GLenum cap, bool on)
+    {
+        setCap(cap, on);
+    }
+
+    void blendFunc(GLenum src, GLenum dst)
+    {
+        if (src == blendSrc && dst == blendDst)
+        {
+            counters.filtered++;
+            return;
+        }
+        counters.issued++;
+        blendSrc = src;
+        blendDst = dst;
+        glBlendFunc(src, dst);
+    }
+
+    void cullFace(GLenum mode)
+    {
+        if (filter(mode, cullMode))
+            return;
+        glCullFace(mode);
+    }
+
+    void depthFunc(GLenum func)
+    {
+        if (filter(func, depthFunction))
+            return;
+        glDepthFunc(func);
+    }
+
+    void depthMask(bool write)
+    {
+        if (filter(write ? 1 : 0, depthWrite))
+            return;
+        glDepthMask(write ? GL_TRUE : GL_FALSE);
+    }
+
+    void unpackAlignment(GLint alignment)
+    {
+        if (filter(alignment, unpack))
+            return;
+        glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+    }
+
+    // forget everything; the next call of each kind is issued again
+    void invalidate()
+    {
+        currentProgram = UNKNOWN;
+        currentVertexArray = UNKNOWN;
+        currentUnit = UNKNOWN;
+        for (unsigned int unit = 0; unit < GL_STATE_TEXTURE_UNITS; unit++)
+            for (unsigned int slot = 0; slot < TARGET_SLOTS; slot++)
+                textures[unit][slot] = UNKNOWN;
+        for (unsigned int cap = 0; cap < CAP_SLOTS; cap++)
+            caps[cap] = UNKNOWN;
+        blendSrc = UNKNOWN;
+        blendDst = UNKNOWN;
+        cullMode = UNKNOWN;
+        depthFunction = UNKNOWN;
+        depthWrite = UNKNOWN;
+        unpack = UNKNOWN;
+    }
+
+    // counters since the last call, meant to be read once per frame
+    Stats frameStats()
+    {
+        Stats stats = counters;
+        counters.issued = 0;
+        counters.filtered = 0;
+        return stats;
+    }
+
+private:
+    enum { UNKNOWN = -1, TARGET_SLOTS = 3, CAP_SLOTS = 5 };
+
+    GLState()
+    {
+        counters.issued = 0;
+        counters.filtered = 0;
+        invalidate();
+    }
+    GLState(const GLState &);
+    GLState &operator=(const GLState &);
+
+    // true when value is already current; otherwise records it and counts the call
+    bool filter(long long value, long long &current)
+    {
+        if (current == value)
+        {
+            counters.filtered++;
+            return true;
+        }
+        counters.issued++;
+        current = value;
+        return false;
+    }
+
+    static int targetSlot(GLenum target)
+    {
+        switch (target)
+        {
+        case GL_TEXTURE_2D: return 0;
+        case GL_TEXTURE_CUBE_MAP: return 1;
+        case GL_TEXTURE_BUFFER: return 2;
+        default: return -1;
+        }
+    }
+
+    static int capSlot(GLenum cap)
+    {
+        switch (cap)
+        {
+        case GL_BLEND: return 0;
+        case GL_CULL_FACE: return 1;
+        case GL_DEPTH_TEST: return 2;
+        case GL_MULTISAMPLE: return 3;
+        case GL_FRAMEBUFFER_SRGB: return 4;
+        default: return -1;
+        }
+    }
+
+    void setCap(GLenum cap, bool on)
+    {
+        int slot = capSlot(cap);
+        if (slot >= 0 && filter(on ? 1 : 0, caps[slot]))
+            return;
+        if (slot < 0)
+            counters.issued++;
+        if (on)
+            glEnable(cap);
+        else
+            glDisable(cap);
+    }
+
+    long long currentProgram;
+    long long currentVertexArray;
+    long long currentUnit;
+    long long textures[GL_STATE_TEXTURE_UNITS][TARGET_SLOTS];
+    long long caps[CAP_SLOTS];
+    long long blendSrc, blendDst;
+    long long cullMode;
+    long long depthFunction;
+    long long depthWrite;
+    long long unpack;
+    Stats counters;
+};
+
+#endif
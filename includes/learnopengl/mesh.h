@@ -7,6 +7,7 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <learnopengl/shader.h>
+#include <learnopengl/gl_state.h>
 
 #include <string>
 #include <fstream>
@@ -76,7 +77,6 @@ public:
         unsigned int heightNr   = 1;
         for(unsigned int i = 0; i < textures.size(); i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
             // retrieve texture number (the N in diffuse_textureN)
             string number;
             string name = textures[i].type;
@@ -90,8 +90,8 @@ public:
 			    number = std::to_string(heightNr++); // transfer unsigned int to stream
 
 													 // now set the sampler to the correct texture unit
-			shader.setInt((name + number).c_str(), i);
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+			shader.setInt(name + number, i);
+            GLState::get().bindTexture(i, GL_TEXTURE_2D, textures[i].id);
         }
 		shader.setVec3("material.ambient", mats.Ka.x, mats.Ka.y, mats.Ka.z);
 		shader.setVec3("material.diffuse", mats.Kd.x, mats.Kd.y, mats.Kd.z);
@@ -99,12 +99,8 @@ public:
 
 
         // draw mesh
-        glBindVertexArray(VAO);
+        GLState::get().bindVertexArray(VAO);
         glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
     }
 
 private:
@@ -120,7 +116,7 @@ private:
         glGenBuffers(1, &VBO);
         glGenBuffers(1, &EBO);
 
-        glBindVertexArray(VAO);
+        GLState::get().bindVertexArray(VAO);
         // load data into vertex buffers
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
         // A great thing about structs is that their memory layout is sequential for all its items.
@@ -148,7 +144,7 @@ private:
         glEnableVertexAttribArray(4);
         glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
 
-        glBindVertexArray(0);
+        GLState::get().bindVertexArray(0);
     }
 };
 #endif
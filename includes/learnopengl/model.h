@@ -12,6 +12,8 @@
 
 #include <learnopengl/mesh.h>
 #include <learnopengl/shader.h>
+#include <learnopengl/texture_registry.h>
+#include <learnopengl/texture_streamer.h>
 
 #include <string>
 #include <fstream>
@@ -39,13 +41,31 @@ public:
         loadModel(path);
     }
 
+    // gives the model's textures back to the TextureRegistry, which deletes the unshared ones
+    ~Model()
+    {
+        for(unsigned int i = 0; i < textures_loaded.size(); i++)
+            TextureRegistry::get().release(textures_loaded[i].id);
+    }
+
     // draws the model, and thus all its meshes
     void Draw(Shader shader)
     {
         for(unsigned int i = 0; i < meshes.size(); i++)
             meshes[i].Draw(shader);
     }
+
+    // tell the TextureStreamer how large the model is on screen this frame
+    void reportTextureUsage(float screenPixels)
+    {
+        for(unsigned int i = 0; i < textures_loaded.size(); i++)
+            TextureStreamer::get().reportUsage(textures_loaded[i].id, screenPixels);
+    }
 private:
+    // each copy would release the textures again
+    Model(const Model &);
+    Model &operator=(const Model &);
+
     /*  Functions   */
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
     void loadModel(string const &path)
@@ -203,7 +223,7 @@ private:
             if(!skip)
             {   // if texture hasn't been loaded already, load it
                 Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
+                texture.id = TextureFromFile(str.C_Str(), this->directory, gammaCorrection);
                 texture.type = typeName;
                 texture.path = str.C_Str();
                 textures.push_back(texture);
@@ -220,23 +240,40 @@ unsigned int TextureFromFile(const char *path, const string &directory, bool gam
     string filename = string(path);
     filename = directory + '/' + filename;
 
-    unsigned int textureID;
+    // textures_loaded only dedups inside one model; the registry shares across models
+    unsigned int textureID = TextureRegistry::get().acquire(filename, gamma);
+    if (textureID)
+        return textureID;
+
     glGenTextures(1, &textureID);
 
     int width, height, nrComponents;
     unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
+    if (data && TextureStreamer::get().isEnabled() && TextureStreamer::wantsStreaming(width, height))
+    {
+        // only the coarse levels go up now, finer ones follow reportTextureUsage()
+        TextureStreamer::get().create(textureID, MipChain::build(data, width, height, nrComponents, gamma));
+        stbi_image_free(data);
+        textureID = TextureRegistry::get().insert(filename, gamma, textureID,
+            TextureRegistry::estimateBytes(width, height, nrComponents));
+    }
+    else if (data)
     {
-        GLenum format;
+        GLenum format, internalFormat;
         if (nrComponents == 1)
             format = GL_RED;
         else if (nrComponents == 3)
             format = GL_RGB;
         else if (nrComponents == 4)
             format = GL_RGBA;
+        internalFormat = format;
+        if (gamma && format == GL_RGB)
+            internalFormat = GL_SRGB;
+        else if (gamma && format == GL_RGBA)
+            internalFormat = GL_SRGB_ALPHA;
 
         glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, GL_UNSIGNED_BYTE, data);
         glGenerateMipmap(GL_TEXTURE_2D);
 
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
@@ -245,6 +282,8 @@ unsigned int TextureFromFile(const char *path, const string &directory, bool gam
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
         stbi_image_free(data);
+        textureID = TextureRegistry::get().insert(filename, gamma, textureID,
+            TextureRegistry::estimateBytes(width, height, nrComponents));
     }
     else
     {
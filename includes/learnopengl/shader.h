@@ -8,6 +8,11 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <memory>
+
+#include <learnopengl/uniform_cache.h>
+#include <learnopengl/gl_state.h>
+#include <learnopengl/uniform_blocks.h>
 
 class Shader
 {
@@ -95,70 +100,117 @@ public:
         if(geometryPath != nullptr)
             glDeleteShader(geometry);
 
+        // per-frame data comes from the shared uniform blocks
+        UniformBlocks::bindProgram(ID);
+        // reflect the active uniforms once, the setters only look them up
+        uniforms = std::make_shared<UniformCache>(ID);
     }
     // activate the shader
     // ------------------------------------------------------------------------
     void use() 
     { 
-        glUseProgram(ID); 
+        GLState::get().useProgram(ID); 
     }
     // utility uniform functions
+    // locations come from the table reflected at link time and values equal to the
+    // last upload are not sent again, see UniformCache
     // ------------------------------------------------------------------------
-    void setBool(const std::string &name, bool value) const
+    void setBool(UniformKey name, bool value) const
     {         
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); 
+        int v = (int)value;
+        GLint location = uniforms->changed(name, &v, sizeof(v));
+        if (location >= 0)
+            glUniform1i(location, v); 
     }
     // ------------------------------------------------------------------------
-    void setInt(const std::string &name, int value) const
+    void setInt(UniformKey name, int value) const
     { 
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value); 
+        GLint location = uniforms->changed(name, &value, sizeof(value));
+        if (location >= 0)
+            glUniform1i(location, value); 
     }
     // ------------------------------------------------------------------------
-    void setFloat(const std::string &name, float value) const
+    void setFloat(UniformKey name, float value) const
     { 
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value); 
+        GLint location = uniforms->changed(name, &value, sizeof(value));
+        if (location >= 0)
+            glUniform1f(location, value); 
     }
     // ------------------------------------------------------------------------
-    void setVec2(const std::string &name, const glm::vec2 &value) const
+    void setVec2(UniformKey name, const glm::vec2 &value) const
     { 
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        GLint location = uniforms->changed(name, &value[0], sizeof(value));
+        if (location >= 0)
+            glUniform2fv(location, 1, &value[0]); 
     }
-    void setVec2(const std::string &name, float x, float y) const
+    void setVec2(UniformKey name, float x, float y) const
     { 
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y); 
+        setVec2(name, glm::vec2(x, y)); 
     }
     // ------------------------------------------------------------------------
-    void setVec3(const std::string &name, const glm::vec3 &value) const
+    void setVec3(UniformKey name, const glm::vec3 &value) const
     { 
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        GLint location = uniforms->changed(name, &value[0], sizeof(value));
+        if (location >= 0)
+            glUniform3fv(location, 1, &value[0]); 
     }
-    void setVec3(const std::string &name, float x, float y, float z) const
+    void setVec3(UniformKey name, float x, float y, float z) const
     { 
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z); 
+        setVec3(name, glm::vec3(x, y, z)); 
     }
     // ------------------------------------------------------------------------
-    void setVec4(const std::string &name, const glm::vec4 &value) const
+    void setVec4(UniformKey name, const glm::vec4 &value) const
     { 
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        GLint location = uniforms->changed(name, &value[0], sizeof(value));
+        if (location >= 0)
+            glUniform4fv(location, 1, &value[0]); 
     }
-    void setVec4(const std::string &name, float x, float y, float z, float w) 
+    void setVec4(UniformKey name, float x, float y, float z, float w) const
     { 
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w); 
+        setVec4(name, glm::vec4(x, y, z, w)); 
     }
     // ------------------------------------------------------------------------
-    void setMat2(const std::string &name, const glm::mat2 &mat) const
+    void setMat2(UniformKey name, const glm::mat2 &mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        GLint location = uniforms->changed(name, &mat[0][0], sizeof(mat));
+        if (location >= 0)
+            glUniformMatrix2fv(location, 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
-    void setMat3(const std::string &name, const glm::mat3 &mat) const
+    void setMat3(UniformKey name, const glm::mat3 &mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        GLint location = uniforms->changed(name, &mat[0][0], sizeof(mat));
+        if (location >= 0)
+            glUniformMatrix3fv(location, 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
-    void setMat4(const std::string &name, const glm::mat4 &mat) const
+    void setMat4(UniformKey name, const glm::mat4 &mat) const
+    {
+        GLint location = uniforms->changed(name, &mat[0][0], sizeof(mat));
+        if (location >= 0)
+            glUniformMatrix4fv(location, 1, GL_FALSE, &mat[0][0]);
+    }
+    // whole mat4 array in one call, e.g. a bone palette; transpose for row-major data
+    void setMat4Array(UniformKey name, const float *mats, int count, bool transpose) const
+    {
+        GLint location = uniforms->changed(name, mats, count * 16 * sizeof(float));
+        if (location >= 0)
+            glUniformMatrix4fv(location, count, transpose ? GL_TRUE : GL_FALSE, mats);
+    }
+    // uniforms were set with raw glUniform* calls; forget the shadow values
+    void invalidateUniforms() const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        uniforms->invalidate();
+    }
+    // link again with the named outputs written to transform feedback buffer 0, interleaved
+    // in that order; glTransformFeedbackVaryings only takes effect on the next link
+    void captureVaryings(const char* const* varyings, int count)
+    {
+        glTransformFeedbackVaryings(ID, count, varyings, GL_INTERLEAVED_ATTRIBS);
+        glLinkProgram(ID);
+        checkCompileErrors(ID, "PROGRAM");
+        UniformBlocks::bindProgram(ID);
+        uniforms = std::make_shared<UniformCache>(ID);
     }
 
 private:
@@ -187,5 +239,7 @@ private:
             }
         }
     }
+
+    std::shared_ptr<UniformCache> uniforms;
 };
 #endif
\ No newline at end of file
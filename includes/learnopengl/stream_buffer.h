@@ -0,0 +1,253 @@
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+
+#include <glad/glad.h>
+
+#include <cstring>
+#include <iostream>
+
+// frames the CPU may run ahead of the GPU before it has to wait
+#define STREAM_FRAMES 3
+// bytes each frame may write into a buffer to begin with
+#define STREAM_VERTEX_REGION (256 * 1024)
+#define STREAM_UNIFORM_REGION (256 * 1024)
+#define STREAM_TEXEL_REGION (8 * 1024 * 1024)
+// how far regions may grow past their initial size
+#define STREAM_MAX_GROWTH 16
+
+// Ring buffer for data written once per frame and read by that frame's draws only.
+// The buffer holds STREAM_FRAMES regions; frame n writes region n % STREAM_FRAMES
+// front to back and ends with a fence, and the region is only written again once that
+// fence has passed. Nothing the GPU may still read is ever touched, so ranges are
+// mapped with GL_MAP_UNSYNCHRONIZED_BIT and the driver neither stalls nor copies, which
+// glBufferSubData into a buffer in use by the previous frame would make it do.
+// GL 3.3 has no persistent mapping, so each write maps and unmaps its own range; the
+// range must be unmapped before a draw reads it. A write that does not fit what is left
+// of the frame's region fails (map() returns NULL, write() -1) and the caller falls
+// back or skips; the frame's earlier writes stay where its draws expect them. The next
+// beginFrame() then grows the regions to the failed frame's demand, re-creating the
+// storage before anything of the new frame is written in it; frames still in flight
+// keep reading the old storage.
+// Render context only, like GLState.
+class StreamBuffer
+{
+public:
+    struct Stats
+    {
+        unsigned int bytes;        // written this frame
+        unsigned int waits;        // frames that found their region still in use
+        unsigned int overflows;    // writes that did not fit
+        unsigned int grows;
+    };
+
+    StreamBuffer(GLsizeiptr regionSize, GLsizeiptr alignment, GLsizeiptr maxRegionSize)
+        : regionSize(regionSize), maxRegionSize(maxRegionSize), alignment(alignment)
+    {
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, regionSize * STREAM_FRAMES, NULL, GL_STREAM_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        for (unsigned int i = 0; i < STREAM_FRAMES; i++)
+            fences[i] = 0;
+        region = 0;
+        used = 0;
+        demand = 0;
+        mapped = false;
+        stats.bytes = 0;
+        stats.waits = 0;
+        stats.overflows = 0;
+        stats.grows = 0;
+    }
+
+    ~StreamBuffer()
+    {
+        for (unsigned int i = 0; i < STREAM_FRAMES; i++)
+            if (fences[i])
+                glDeleteSync(fences[i]);
+        glDeleteBuffers(1, &buffer);
+    }
+
+    // move to the next region, waiting for the GPU to finish the frame that used it last;
+    // grows the regions first if the last frame asked for more than one holds
+    void beginFrame()
+    {
+        if (demand > regionSize && regionSize < maxRegionSize)
+            grow();
+        region = (region + 1) % STREAM_FRAMES;
+        used = 0;
+        demand = 0;
+        stats.bytes = 0;
+        if (!fences[region])
+            return;
+        GLenum status = glClientWaitSync(fences[region], 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+        {
+            stats.waits++;
+            while (status == GL_TIMEOUT_EXPIRED)
+                status = glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+        }
+        glDeleteSync(fences[region]);
+        fences[region] = 0;
+    }
+
+    // after the last draw reading this frame's data
+    void endFrame()
+    {
+        if (fences[region])
+            glDeleteSync(fences[region]);
+        fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    // reserve bytes in this frame's region and map them; offset receives their position
+    // in the buffer. NULL when they do not fit the rest of the region this frame.
+    void *map(GLsizeiptr bytes, GLintptr &offset)
+    {
+        if (mapped)
+            unmap();
+        GLsizeiptr start = (used + alignment - 1) / alignment * alignment;
+        demand = (demand > start ? demand : start) + bytes;
+        if (start + bytes > regionSize)
+        {
+            if (stats.overflows++ == 0 && bytes > maxRegionSize)
+                std::cout << "ERROR::STREAM_BUFFER: " << bytes << " bytes do not fit a region of " << maxRegionSize << std::endl;
+            return NULL;
+        }
+        offset = region * regionSize + start;
+        used = start + bytes;
+        stats.bytes += (unsigned int)bytes;
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        void *data = glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, bytes,
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        mapped = data != NULL;
+        return data;
+    }
+
+    void unmap()
+    {
+        if (!mapped)
+            return;
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        mapped = false;
+    }
+
+    // map, copy and unmap in one go; -1 when it did not fit
+    GLintptr write(const void *data, GLsizeiptr bytes)
+    {
+        GLintptr offset;
+        void *target = map(bytes, offset);
+        if (!target)
+            return -1;
+        std::memcpy(target, data, bytes);
+        unmap();
+        return offset;
+    }
+
+    GLuint getBuffer() const { return buffer; }
+    const Stats &getStats() const { return stats; }
+
+private:
+    StreamBuffer(const StreamBuffer &);
+    StreamBuffer &operator=(const StreamBuffer &);
+
+    // larger storage for the whole ring, between frames only: draws already issued keep
+    // reading the old storage, and the new frame has not written anything yet
+    void grow()
+    {
+        GLsizeiptr size = demand + demand / 2;
+        size = (size + alignment - 1) / alignment * alignment;
+        regionSize = size < maxRegionSize ? size : maxRegionSize;
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, regionSize * STREAM_FRAMES, NULL, GL_STREAM_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        for (unsigned int i = 0; i < STREAM_FRAMES; i++)
+        {
+            if (fences[i])
+                glDeleteSync(fences[i]);
+            fences[i] = 0;
+        }
+        stats.grows++;
+    }
+
+    GLuint buffer;
+    GLsizeiptr regionSize;
+    GLsizeiptr maxRegionSize;
+    GLsizeiptr alignment;
+    GLsync fences[STREAM_FRAMES];
+    unsigned int region;
+    GLsizeiptr used;
+    GLsizeiptr demand;         // bytes this frame asked for, fitting or not
+    bool mapped;
+    Stats stats;
+};
+
+// The renderer's rings: vertex data (glyph quads, particle and model instances), uniform
+// block data (frame/view/light blocks) and texels read through a buffer texture (bone
+// palettes). The render loop brackets every frame with beginFrame() and endFrame().
+class StreamBuffers
+{
+public:
+    static StreamBuffers& get()
+    {
+        static StreamBuffers buffers;
+        return buffers;
+    }
+
+    void beginFrame()
+    {
+        vertex.beginFrame();
+        uniform.beginFrame();
+        texel.beginFrame();
+    }
+
+    void endFrame()
+    {
+        vertex.unmap();
+        uniform.unmap();
+        texel.unmap();
+        vertex.endFrame();
+        uniform.endFrame();
+        texel.endFrame();
+    }
+
+    StreamBuffer vertex;
+    StreamBuffer uniform;
+    StreamBuffer texel;
+
+private:
+    // 16 bytes covers every vertex layout streamed and is one RGBA32F texel; uniform
+    // ranges follow the driver
+    StreamBuffers()
+        : vertex(STREAM_VERTEX_REGION, 16, STREAM_VERTEX_REGION * STREAM_MAX_GROWTH),
+          uniform(STREAM_UNIFORM_REGION, uniformAlignment(), STREAM_UNIFORM_REGION * STREAM_MAX_GROWTH),
+          texel(texelRegion(), 16, texelLimit())
+    {
+    }
+    StreamBuffers(const StreamBuffers &);
+    StreamBuffers &operator=(const StreamBuffers &);
+
+    static GLsizeiptr uniformAlignment()
+    {
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        return alignment > 0 ? alignment : 256;
+    }
+
+    // a buffer texture spans the whole ring, which must stay within the texel limit
+    static GLsizeiptr texelLimit()
+    {
+        GLint texels = 65536;
+        glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &texels);
+        return (GLsizeiptr)texels * 16 / STREAM_FRAMES / 16 * 16;
+    }
+
+    static GLsizeiptr texelRegion()
+    {
+        GLsizeiptr limit = texelLimit();
+        return limit < STREAM_TEXEL_REGION ? limit : STREAM_TEXEL_REGION;
+    }
+};
+
+#endif
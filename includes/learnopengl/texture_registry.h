@@ -0,0 +1,204 @@
+#ifndef TEXTURE_REGISTRY_H
+#define TEXTURE_REGISTRY_H
+
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <iostream>
+#include <cctype>
+#include <cstddef>
+
+// Process-wide cache of 2D textures loaded from image files.
+// Entries are keyed by the canonical file path plus the sRGB (gamma) flag, so the same
+// image loaded by two models, or through both TextureFromFile and loadTexture, is
+// uploaded once and shared. Entries are reference counted; the GL texture is deleted
+// when the last reference is released. The registry may be used from the asset
+// streamer's loader thread, so every call takes the lock.
+class TextureRegistry
+{
+public:
+    struct Stats
+    {
+        unsigned int lookups;
+        unsigned int hits;
+        unsigned int textures;
+        size_t residentBytes;
+        size_t bytesSaved;
+    };
+
+    static TextureRegistry& get()
+    {
+        static TextureRegistry registry;
+        return registry;
+    }
+
+    // lexical canonical form: forward slashes, no "." or "dir/.." segments,
+    // case-folded on Windows where the file system is case-insensitive
+    static std::string canonicalPath(const std::string &path)
+    {
+        std::string p = path;
+        for (size_t i = 0; i < p.size(); i++)
+        {
+            if (p[i] == '\\')
+                p[i] = '/';
+#ifdef _WIN32
+            p[i] = (char)std::tolower((unsigned char)p[i]);
+#endif
+        }
+        bool absolute = !p.empty() && p[0] == '/';
+        std::vector<std::string> parts;
+        size_t start = 0;
+        while (start <= p.size())
+        {
+            size_t end = p.find('/', start);
+            if (end == std::string::npos)
+                end = p.size();
+            std::string part = p.substr(start, end - start);
+            if (part == "..")
+            {
+                if (!parts.empty() && parts.back() != "..")
+                    parts.pop_back();
+                else if (!absolute)
+                    parts.push_back(part);
+            }
+            else if (!part.empty() && part != ".")
+                parts.push_back(part);
+            start = end + 1;
+        }
+        std::string result = absolute ? "/" : "";
+        for (size_t i = 0; i < parts.size(); i++)
+        {
+            if (i > 0)
+                result += '/';
+            result += parts[i];
+        }
+        return result;
+    }
+
+    // returns the shared texture and takes a reference, or 0 when it is not loaded yet
+    unsigned int acquire(const std::string &path, bool gamma)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.lookups++;
+        std::map<std::string, Entry>::iterator it = entries.find(key(path, gamma));
+        if (it == entries.end())
+            return 0;
+        it->second.refCount++;
+        stats.hits++;
+        stats.bytesSaved += it->second.bytes;
+        return it->second.id;
+    }
+
+    // register a freshly uploaded texture with one reference. If another thread got
+    // there first, the duplicate is deleted and the existing texture is returned.
+    unsigned int insert(const std::string &path, bool gamma, unsigned int id, size_t bytes)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::string k = key(path, gamma);
+        std::map<std::string, Entry>::iterator it = entries.find(k);
+        if (it != entries.end())
+        {
+            deleteTexture(id);
+            it->second.refCount++;
+            stats.hits++;
+            stats.bytesSaved += it->second.bytes;
+            return it->second.id;
+        }
+        Entry entry;
+        entry.id = id;
+        entry.bytes = bytes;
+        entry.refCount = 1;
+        entries[k] = entry;
+        keysById[id] = k;
+        stats.residentBytes += bytes;
+        return id;
+    }
+
+    void release(unsigned int id)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::map<unsigned int, std::string>::iterator k = keysById.find(id);
+        if (k == keysById.end())
+            return;
+        std::map<std::string, Entry>::iterator it = entries.find(k->second);
+        if (--it->second.refCount > 0)
+            return;
+        deleteTexture(id);
+        stats.residentBytes -= it->second.bytes;
+        entries.erase(it);
+        keysById.erase(k);
+    }
+
+    // told about every texture the registry deletes, so caches keyed by id can drop it
+    void setDeleteHook(void (*hook)(unsigned int id))
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        deleteHook = hook;
+    }
+
+    Stats getStats()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Stats s = stats;
+        s.textures = (unsigned int)entries.size();
+        return s;
+    }
+
+    void printStats()
+    {
+        Stats s = getStats();
+        float hitRate = s.lookups ? 100.0f * s.hits / s.lookups : 0.0f;
+        std::cout << "TEXTURE::REGISTRY:: " << s.textures << " textures, "
+                  << s.residentBytes / 1024 << " KB resident, "
+                  << s.hits << "/" << s.lookups << " hits (" << hitRate << "%), "
+                  << s.bytesSaved / 1024 << " KB saved" << std::endl;
+    }
+
+    // GPU footprint estimate: 8-bit channels plus a third for the mip chain
+    static size_t estimateBytes(int width, int height, int components)
+    {
+        return (size_t)width * height * components * 4 / 3;
+    }
+
+private:
+    struct Entry
+    {
+        unsigned int id;
+        size_t bytes;
+        int refCount;
+    };
+
+    TextureRegistry() : deleteHook(NULL)
+    {
+        stats.lookups = 0;
+        stats.hits = 0;
+        stats.textures = 0;
+        stats.residentBytes = 0;
+        stats.bytesSaved = 0;
+    }
+    TextureRegistry(const TextureRegistry &);
+    TextureRegistry &operator=(const TextureRegistry &);
+
+    void deleteTexture(unsigned int id)
+    {
+        if (deleteHook)
+            deleteHook(id);
+        glDeleteTextures(1, &id);
+    }
+
+    static std::string key(const std::string &path, bool gamma)
+    {
+        return canonicalPath(path) + (gamma ? "|srgb" : "|linear");
+    }
+
+    std::mutex mutex;
+    std::map<std::string, Entry> entries;
+    std::map<unsigned int, std::string> keysById;
+    Stats stats;
+    void (*deleteHook)(unsigned int id);
+};
+
+#endif
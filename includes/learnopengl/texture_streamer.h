@@ -0,0 +1,349 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include <glad/glad.h>
+#include <learnopengl/texture_registry.h>
+#include <learnopengl/gl_state.h>
+
+#include <vector>
+#include <map>
+#include <mutex>
+#include <algorithm>
+#include <iostream>
+#include <cmath>
+#include <cstddef>
+
+// textures are created with only the levels up to this size resident
+#define STREAM_RESIDENT_SIZE 64
+// at most this many levels are uploaded or dropped per update()
+#define STREAM_LEVELS_PER_FRAME 4
+// textures nobody reported for this many frames fall back to their coarse levels
+#define STREAM_IDLE_FRAMES 120
+
+// Full mip chain of one image kept in system memory, so finer levels can be streamed
+// back in after they have been evicted without going back to the file.
+// Levels are built with a 2x2 box filter, level 0 is the original image.
+struct MipChain
+{
+    int width, height, components;
+    bool gamma;
+    std::vector<std::vector<unsigned char> > levels;
+
+    int levelWidth(int level) const { return std::max(1, width >> level); }
+    int levelHeight(int level) const { return std::max(1, height >> level); }
+    size_t levelBytes(int level) const { return (size_t)levelWidth(level) * levelHeight(level) * components; }
+    int levelCount() const { return (int)levels.size(); }
+
+    static MipChain *build(const unsigned char *data, int width, int height, int components, bool gamma)
+    {
+        MipChain *chain = new MipChain();
+        chain->width = width;
+        chain->height = height;
+        chain->components = components;
+        chain->gamma = gamma;
+        chain->levels.push_back(std::vector<unsigned char>(data, data + (size_t)width * height * components));
+        for (int level = 1; chain->levelWidth(level - 1) > 1 || chain->levelHeight(level - 1) > 1; level++)
+        {
+            const std::vector<unsigned char> &src = chain->levels[level - 1];
+            int sw = chain->levelWidth(level - 1), sh = chain->levelHeight(level - 1);
+            int dw = chain->levelWidth(level), dh = chain->levelHeight(level);
+            std::vector<unsigned char> dst((size_t)dw * dh * components);
+            for (int y = 0; y < dh; y++)
+            {
+                int y0 = std::min(2 * y, sh - 1), y1 = std::min(2 * y + 1, sh - 1);
+                for (int x = 0; x < dw; x++)
+                {
+                    int x0 = std::min(2 * x, sw - 1), x1 = std::min(2 * x + 1, sw - 1);
+                    for (int c = 0; c < components; c++)
+                    {
+                        int sum = src[((size_t)y0 * sw + x0) * components + c] + src[((size_t)y0 * sw + x1) * components + c]
+                                + src[((size_t)y1 * sw + x0) * components + c] + src[((size_t)y1 * sw + x1) * components + c];
+                        dst[((size_t)y * dw + x) * components + c] = (unsigned char)((sum + 2) / 4);
+                    }
+                }
+            }
+            chain->levels.push_back(dst);
+        }
+        return chain;
+    }
+};
+
+// Streams mip levels of large textures in and out under a VRAM budget.
+// A managed texture starts with only its coarse levels (<= STREAM_RESIDENT_SIZE) on the
+// GPU. Every frame the renderer reports how many pixels each texture covers on screen;
+// update() turns that into the finest level actually needed and moves GL_TEXTURE_BASE_LEVEL
+// towards it, uploading finer levels from the MipChain while they fit in the budget and
+// respecifying dropped levels as 0x0 images so the driver can release them. When the
+// budget is full, levels are taken from the texture with the smallest screen size first.
+// create() runs wherever the texture is uploaded (possibly the asset streamer's loader
+// context) and binds raw; everything else belongs to the render thread and binds
+// through GLState.
+class TextureStreamer
+{
+public:
+    struct Stats
+    {
+        unsigned int textures;
+        size_t residentBytes;
+        size_t budget;
+        unsigned int levelsIn;
+        unsigned int levelsOut;
+    };
+
+    static TextureStreamer& get()
+    {
+        static TextureStreamer streamer;
+        return streamer;
+    }
+
+    // 0 disables streaming: textures are then uploaded with all levels as before
+    void setBudget(size_t bytes)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        budget = bytes;
+    }
+    bool isEnabled()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return budget > 0;
+    }
+    // only worth streaming when there is more than the resident tail
+    static bool wantsStreaming(int width, int height)
+    {
+        return std::max(width, height) > STREAM_RESIDENT_SIZE;
+    }
+
+    // upload the coarse tail of chain into texture id; takes ownership of chain
+    void create(unsigned int id, MipChain *chain)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Entry entry;
+        entry.chain = chain;
+        entry.coarseBase = chain->levelCount() - 1;
+        while (entry.coarseBase > 0 && !wantsStreaming(chain->levelWidth(entry.coarseBase - 1), chain->levelHeight(entry.coarseBase - 1)))
+            entry.coarseBase--;
+        entry.base = chain->levelCount();
+        entry.wanted = entry.coarseBase;
+        entry.screenPixels = 0.0f;
+        entry.priority = 0.0f;
+        entry.idleFrames = 0;
+
+        glBindTexture(GL_TEXTURE_2D, id);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, chain->levelCount() - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        GLint alignment;
+        glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        while (entry.base > entry.coarseBase)
+            loadLevel(entry);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, entry.base);
+        entries[id] = entry;
+    }
+
+    // screenPixels: largest on-screen extent, in pixels, of something sampling the texture
+    void reportUsage(unsigned int id, float screenPixels)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::map<unsigned int, Entry>::iterator it = entries.find(id);
+        if (it == entries.end())
+            return;
+        Entry &entry = it->second;
+        entry.screenPixels = std::max(entry.screenPixels, screenPixels);
+        entry.idleFrames = 0;
+    }
+
+    // once per frame on the render thread
+    void update()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<unsigned int> loads;
+        for (std::map<unsigned int, Entry>::iterator it = entries.begin(); it != entries.end(); ++it)
+        {
+            Entry &entry = it->second;
+            if (entry.idleFrames < STREAM_IDLE_FRAMES)
+            {
+                entry.idleFrames++;
+                if (entry.screenPixels > 0.0f)
+                    entry.wanted = std::min(requiredLevel(*entry.chain, entry.screenPixels), entry.coarseBase);
+            }
+            else
+                entry.wanted = entry.coarseBase;
+            entry.priority = entry.screenPixels;
+            entry.screenPixels = 0.0f;
+            if (entry.base > entry.wanted)
+                loads.push_back(it->first);
+        }
+
+        unsigned int changed = 0;
+        // level rows are tightly packed; 1 is left set, it suits every tightly packed
+        // upload, and the cache drops the call on the following frames
+        GLState::get().unpackAlignment(1);
+
+        // drop what is no longer needed first, it makes room for the loads
+        for (std::map<unsigned int, Entry>::iterator it = entries.begin(); it != entries.end() && changed < STREAM_LEVELS_PER_FRAME; ++it)
+        {
+            Entry &entry = it->second;
+            if (entry.base >= entry.wanted)
+                continue;
+            GLState::get().bindTexture(0, GL_TEXTURE_2D, it->first);
+            while (entry.base < entry.wanted && changed < STREAM_LEVELS_PER_FRAME)
+            {
+                dropLevel(entry);
+                changed++;
+            }
+        }
+
+        // biggest on screen first, one level at a time
+        std::sort(loads.begin(), loads.end(), ByPriority(entries));
+        for (size_t i = 0; i < loads.size() && changed < STREAM_LEVELS_PER_FRAME; i++)
+        {
+            Entry &entry = entries[loads[i]];
+            size_t bytes = entry.chain->levelBytes(entry.base - 1);
+            if (stats.residentBytes + bytes > budget && !makeRoom(bytes, entry.priority, loads[i]))
+                continue;
+            GLState::get().bindTexture(0, GL_TEXTURE_2D, loads[i]);
+            loadLevel(entry);
+            changed++;
+        }
+    }
+
+    // the texture is being deleted elsewhere; called by the TextureRegistry
+    void forget(unsigned int id)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::map<unsigned int, Entry>::iterator it = entries.find(id);
+        if (it == entries.end())
+            return;
+        for (int level = it->second.base; level < it->second.chain->levelCount(); level++)
+            stats.residentBytes -= it->second.chain->levelBytes(level);
+        delete it->second.chain;
+        entries.erase(it);
+    }
+
+    Stats getStats()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Stats s = stats;
+        s.textures = (unsigned int)entries.size();
+        s.budget = budget;
+        return s;
+    }
+
+    // pixels covered by an object of worldSize at distance, for a perspective camera
+    static float projectedSize(float worldSize, float distance, float fovY, float viewportHeight)
+    {
+        return worldSize * viewportHeight / (2.0f * std::tan(fovY * 0.5f) * std::max(distance, 0.001f));
+    }
+
+private:
+    struct Entry
+    {
+        MipChain *chain;
+        int base;        // finest resident level
+        int coarseBase;  // base a texture falls back to and never drops below
+        int wanted;
+        float screenPixels;
+        float priority;
+        int idleFrames;
+    };
+
+    struct ByPriority
+    {
+        std::map<unsigned int, Entry> &entries;
+        ByPriority(std::map<unsigned int, Entry> &entries) : entries(entries) {}
+        bool operator()(unsigned int a, unsigned int b) const { return entries[a].priority > entries[b].priority; }
+    };
+
+    TextureStreamer() : budget(0)
+    {
+        stats.textures = 0;
+        stats.residentBytes = 0;
+        stats.budget = 0;
+        stats.levelsIn = 0;
+        stats.levelsOut = 0;
+        TextureRegistry::get().setDeleteHook(&TextureStreamer::onTextureDeleted);
+    }
+    TextureStreamer(const TextureStreamer &);
+    TextureStreamer &operator=(const TextureStreamer &);
+
+    static void onTextureDeleted(unsigned int id)
+    {
+        get().forget(id);
+    }
+
+    static int requiredLevel(const MipChain &chain, float screenPixels)
+    {
+        float ratio = std::max(chain.width, chain.height) / std::max(screenPixels, 1.0f);
+        int level = ratio > 1.0f ? (int)std::floor(std::log2(ratio)) : 0;
+        return std::min(level, chain.levelCount() - 1);
+    }
+
+    static void formats(const MipChain &chain, GLenum &format, GLenum &internalFormat)
+    {
+        format = chain.components == 1 ? GL_RED : chain.components == 3 ? GL_RGB : GL_RGBA;
+        internalFormat = format;
+        if (chain.gamma && format == GL_RGB)
+            internalFormat = GL_SRGB;
+        else if (chain.gamma && format == GL_RGBA)
+            internalFormat = GL_SRGB_ALPHA;
+    }
+
+    // texture must be bound; uploads base - 1 and makes it the base level
+    void loadLevel(Entry &entry)
+    {
+        GLenum format, internalFormat;
+        formats(*entry.chain, format, internalFormat);
+        int level = entry.base - 1;
+        glTexImage2D(GL_TEXTURE_2D, level, internalFormat, entry.chain->levelWidth(level), entry.chain->levelHeight(level),
+            0, format, GL_UNSIGNED_BYTE, &entry.chain->levels[level][0]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+        entry.base = level;
+        stats.residentBytes += entry.chain->levelBytes(level);
+        stats.levelsIn++;
+    }
+
+    // texture must be bound; moves the base up one level and frees the old one
+    void dropLevel(Entry &entry)
+    {
+        GLenum format, internalFormat;
+        formats(*entry.chain, format, internalFormat);
+        int level = entry.base;
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level + 1);
+        glTexImage2D(GL_TEXTURE_2D, level, internalFormat, 0, 0, 0, format, GL_UNSIGNED_BYTE, NULL);
+        entry.base = level + 1;
+        stats.residentBytes -= entry.chain->levelBytes(level);
+        stats.levelsOut++;
+    }
+
+    // evict finest levels of textures smaller on screen than priority until bytes fit
+    bool makeRoom(size_t bytes, float priority, unsigned int requester)
+    {
+        while (stats.residentBytes + bytes > budget)
+        {
+            std::map<unsigned int, Entry>::iterator victim = entries.end();
+            for (std::map<unsigned int, Entry>::iterator it = entries.begin(); it != entries.end(); ++it)
+            {
+                if (it->first == requester || it->second.base >= it->second.coarseBase || it->second.priority >= priority)
+                    continue;
+                if (victim == entries.end() || it->second.priority < victim->second.priority)
+                    victim = it;
+            }
+            if (victim == entries.end())
+                return false;
+            GLState::get().bindTexture(0, GL_TEXTURE_2D, victim->first);
+            dropLevel(victim->second);
+        }
+        return true;
+    }
+
+    std::mutex mutex;
+    std::map<unsigned int, Entry> entries;
+    size_t budget;
+    Stats stats;
+};
+
+#endif
@@ -0,0 +1,148 @@
+#ifndef UNIFORM_BLOCKS_H
+#define UNIFORM_BLOCKS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "stream_buffer.h"
+
+// fixed binding points; GLSL 330 has no layout(binding), so every program is pointed at
+// them after linking (UniformBlocks::bindProgram, called by Shader)
+#define FRAME_DATA_BINDING 0
+#define VIEW_DATA_BINDING 1
+#define LIGHT_DATA_BINDING 2
+// filled at load time by the project's MaterialLibrary
+#define MATERIAL_TABLE_BINDING 3
+
+// std140 mirrors of the blocks the shaders declare:
+//
+//   layout (std140) uniform FrameData { float time; float deltaTime; vec2 resolution; };
+//   layout (std140) uniform ViewData { mat4 view; mat4 projection; vec4 viewPos; };
+//   layout (std140) uniform LightData { mat4 spaceMatrix; vec3 direction; vec3 ambient;
+//                                       vec3 diffuse; vec3 specular; } light;
+//
+// std140 aligns a vec3 to 16 bytes, so the light colours are vec4 on this side.
+struct FrameData
+{
+    float time;
+    float deltaTime;
+    glm::vec2 resolution;
+};
+
+struct ViewData
+{
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec4 viewPos;
+};
+
+struct LightData
+{
+    glm::mat4 spaceMatrix;
+    glm::vec4 direction;
+    glm::vec4 ambient;
+    glm::vec4 diffuse;
+    glm::vec4 specular;
+};
+
+// Each block is written once per frame by the render loop into the uniform StreamBuffer
+// and that range is bound to the block's binding point. Programs only read them, so
+// switching programs no longer means setting view, projection and light again.
+// Render context only, like GLState.
+class UniformBlocks
+{
+public:
+    static UniformBlocks& get()
+    {
+        static UniformBlocks blocks;
+        return blocks;
+    }
+
+    // attach whichever of the blocks program declares to the fixed binding points
+    static void bindProgram(GLuint program)
+    {
+        bindBlock(program, "FrameData", FRAME_DATA_BINDING);
+        bindBlock(program, "ViewData", VIEW_DATA_BINDING);
+        bindBlock(program, "LightData", LIGHT_DATA_BINDING);
+        bindBlock(program, "MaterialTable", MATERIAL_TABLE_BINDING);
+    }
+
+    void setFrame(const FrameData &data)
+    {
+        frame = data;
+        upload(FRAME_DATA_BINDING, &data, sizeof(data));
+    }
+
+    void setView(const ViewData &data)
+    {
+        view = data;
+        upload(VIEW_DATA_BINDING, &data, sizeof(data));
+    }
+
+    void setLight(const LightData &data)
+    {
+        light = data;
+        upload(LIGHT_DATA_BINDING, &data, sizeof(data));
+    }
+
+    // buffers of the blocks' own for frames whose uniform stream is full; call with the
+    // context current, before the first frame and before the context goes away
+    void create()
+    {
+        glGenBuffers(LIGHT_DATA_BINDING + 1, fallback);
+    }
+
+    void destroy()
+    {
+        glDeleteBuffers(LIGHT_DATA_BINDING + 1, fallback);
+        for (unsigned int i = 0; i <= LIGHT_DATA_BINDING; i++)
+            fallback[i] = 0;
+    }
+
+    const FrameData &getFrame() const { return frame; }
+    const ViewData &getView() const { return view; }
+    const LightData &getLight() const { return light; }
+
+private:
+    UniformBlocks()
+    {
+        for (unsigned int i = 0; i <= LIGHT_DATA_BINDING; i++)
+            fallback[i] = 0;
+    }
+    UniformBlocks(const UniformBlocks &);
+    UniformBlocks &operator=(const UniformBlocks &);
+
+    static void bindBlock(GLuint program, const char *name, GLuint binding)
+    {
+        GLuint index = glGetUniformBlockIndex(program, name);
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(program, index, binding);
+    }
+
+    // written every frame even when unchanged: last frame's range is recycled by the ring
+    void upload(unsigned int binding, const void *data, GLsizeiptr bytes)
+    {
+        StreamBuffer &stream = StreamBuffers::get().uniform;
+        GLintptr offset = stream.write(data, bytes);
+        if (offset >= 0)
+        {
+            glBindBufferRange(GL_UNIFORM_BUFFER, binding, stream.getBuffer(), offset, bytes);
+            return;
+        }
+        if (fallback[binding] == 0)
+            return;
+        // the stream is full this frame: re-specify the block's own buffer, so draws
+        // already issued keep the data they were given
+        glBindBuffer(GL_UNIFORM_BUFFER, fallback[binding]);
+        glBufferData(GL_UNIFORM_BUFFER, bytes, data, GL_STREAM_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferRange(GL_UNIFORM_BUFFER, binding, fallback[binding], 0, bytes);
+    }
+
+    FrameData frame;
+    ViewData view;
+    LightData light;
+    GLuint fallback[LIGHT_DATA_BINDING + 1];
+};
+
+#endif
@@ -0,0 +1,204 @@
+#ifndef UNIFORM_CACHE_H
+#define UNIFORM_CACHE_H
+
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <iostream>
+#include <cstring>
+#include <cstddef>
+
+// 64-bit FNV-1a hash of a uniform name. String literals are hashed at compile time
+// through the array constructor; std::string names (built at runtime, e.g. "lights[" +
+// index + "]") are hashed when the call is made. Hashing stops at the first '\0', so a
+// char buffer filled by sprintf works too.
+struct UniformKey
+{
+    unsigned long long hash;
+
+    template <size_t N>
+    constexpr UniformKey(const char (&name)[N]) : hash(fnv1a(name, N))
+    {
+    }
+    UniformKey(const std::string &name) : hash(fnv1a(name.c_str(), name.size() + 1))
+    {
+    }
+
+    static constexpr unsigned long long fnv1a(const char *name, size_t size)
+    {
+        unsigned long long h = 14695981039346656037ULL;
+        for (size_t i = 0; i < size && name[i] != '\0'; i++)
+        {
+            h ^= (unsigned char)name[i];
+            h *= 1099511628211ULL;
+        }
+        return h;
+    }
+};
+
+// Per-program table of active uniforms, reflected once after linking, plus a shadow
+// copy of the last value uploaded to each one so repeated identical sets are skipped.
+// Array uniforms are registered under their base name ("gBones", whole array) and per
+// element ("gBones[3]"); both views share one shadow buffer so they stay consistent.
+// Shader keeps this behind a shared_ptr: Shader objects are passed around by value and
+// every copy must see the same shadow values.
+class UniformCache
+{
+public:
+    struct Stats
+    {
+        unsigned int uploads;   // glUniform* calls actually issued
+        unsigned int skipped;   // value already current, nothing issued
+        unsigned int inactive;  // name not active in the program (glUniform* with -1 before)
+    };
+
+    explicit UniformCache(unsigned int program)
+    {
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<char> name(maxLength + 1);
+        for (GLint i = 0; i < count; i++)
+        {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(program, (GLuint)i, (GLsizei)name.size(), &length, &size, &type, &name[0]);
+            std::string uniform(&name[0], length);
+            // uniform blocks members have no location and are set through their buffer
+            GLint location = glGetUniformLocation(program, uniform.c_str());
+            if (location < 0)
+                continue;
+            size_t elementBytes = typeBytes(type);
+            size_t offset = shadow.size();
+            shadow.resize(offset + elementBytes * size);
+            // arrays are reported as "name[0]"; register the base and every element.
+            // Struct members inside arrays ("lights[0].color") come one by one under
+            // their full names.
+            const std::string suffix = "[0]";
+            bool array = uniform.size() > suffix.size()
+                && uniform.compare(uniform.size() - suffix.size(), suffix.size(), suffix) == 0;
+            if (array)
+            {
+                std::string base = uniform.substr(0, uniform.size() - suffix.size());
+                add(base, location, offset, elementBytes * size);
+                for (GLint e = 0; e < size; e++)
+                {
+                    std::string element = base + "[" + std::to_string(e) + "]";
+                    GLint elementLocation = e == 0 ? location : glGetUniformLocation(program, element.c_str());
+                    add(element, elementLocation, offset + elementBytes * e, elementBytes);
+                }
+            }
+            else
+                add(uniform, location, offset, elementBytes);
+        }
+    }
+
+    // location to upload value to, or -1 when the uniform is inactive or already holds it
+    GLint changed(UniformKey key, const void *value, size_t bytes)
+    {
+        std::unordered_map<unsigned long long, Slot, KeyHash>::iterator it = slots.find(key.hash);
+        if (it == slots.end())
+        {
+            counters().inactive++;
+            return -1;
+        }
+        Slot &slot = it->second;
+        if (bytes > slot.bytes)
+            bytes = slot.bytes;
+        unsigned char *current = &shadow[slot.offset];
+        if (slot.valid && std::memcmp(current, value, bytes) == 0)
+        {
+            counters().skipped++;
+            return -1;
+        }
+        std::memcpy(current, value, bytes);
+        slot.valid = true;
+        counters().uploads++;
+        return slot.location;
+    }
+
+    // the program's uniforms were written behind the cache's back
+    void invalidate()
+    {
+        for (std::unordered_map<unsigned long long, Slot, KeyHash>::iterator it = slots.begin(); it != slots.end(); ++it)
+            it->second.valid = false;
+    }
+
+    // totals over every shader since the last resetStats()
+    static Stats stats()
+    {
+        return counters();
+    }
+    static void resetStats()
+    {
+        counters().uploads = 0;
+        counters().skipped = 0;
+        counters().inactive = 0;
+    }
+
+private:
+    struct Slot
+    {
+        GLint location;
+        size_t offset;
+        size_t bytes;
+        bool valid;
+    };
+
+    // keys are already hashes
+    struct KeyHash
+    {
+        size_t operator()(unsigned long long key) const { return (size_t)(key ^ (key >> 32)); }
+    };
+
+    static Stats &counters()
+    {
+        static Stats totals = { 0, 0, 0 };
+        return totals;
+    }
+
+    void add(const std::string &name, GLint location, size_t offset, size_t bytes)
+    {
+        Slot slot;
+        slot.location = location;
+        slot.offset = offset;
+        slot.bytes = bytes;
+        slot.valid = false;
+        if (!slots.insert(std::make_pair(UniformKey(name).hash, slot)).second)
+            std::cout << "ERROR::SHADER::UNIFORM_HASH_COLLISION: " << name << std::endl;
+    }
+
+    static size_t typeBytes(GLenum type)
+    {
+        switch (type)
+        {
+        case GL_FLOAT_VEC2: case GL_INT_VEC2: case GL_UNSIGNED_INT_VEC2: case GL_BOOL_VEC2:
+            return 8;
+        case GL_FLOAT_VEC3: case GL_INT_VEC3: case GL_UNSIGNED_INT_VEC3: case GL_BOOL_VEC3:
+            return 12;
+        case GL_FLOAT_VEC4: case GL_INT_VEC4: case GL_UNSIGNED_INT_VEC4: case GL_BOOL_VEC4: case GL_FLOAT_MAT2:
+            return 16;
+        case GL_FLOAT_MAT2x3: case GL_FLOAT_MAT3x2:
+            return 24;
+        case GL_FLOAT_MAT2x4: case GL_FLOAT_MAT4x2:
+            return 32;
+        case GL_FLOAT_MAT3:
+            return 36;
+        case GL_FLOAT_MAT3x4: case GL_FLOAT_MAT4x3:
+            return 48;
+        case GL_FLOAT_MAT4:
+            return 64;
+        default:
+            // scalars, bools and samplers
+            return 4;
+        }
+    }
+
+    std::unordered_map<unsigned long long, Slot, KeyHash> slots;
+    std::vector<unsigned char> shadow;
+};
+
+#endif